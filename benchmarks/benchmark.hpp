@@ -0,0 +1,61 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <ratio>
+#include <type_traits>
+#include <utility>
+
+namespace scymnus {
+namespace bench {
+
+/// makes the compiler assume that value is read, and memory written, by an
+/// empty asm statement: the computation of value is kept, and not hoisted out
+/// of the loop that measures it
+template <class T> inline void do_not_optimize(const T &value) {
+    if constexpr (std::is_trivially_copyable_v<T> && sizeof(T) <= sizeof(void *))
+        asm volatile("" : : "r,m"(value) : "memory");
+    else
+        asm volatile("" : : "m"(value) : "memory");
+}
+
+/// makes the compiler assume that every memory location is read and written
+inline void clobber_memory() { asm volatile("" : : : "memory"); }
+
+namespace detail {
+
+template <class F, class... Args> inline void run(F &f, Args &&...args) {
+    if constexpr (std::is_void_v<std::invoke_result_t<F &, Args...>>) {
+        f(std::forward<Args>(args)...);
+        clobber_memory();
+    } else
+        do_not_optimize(f(std::forward<Args>(args)...));
+}
+
+} // namespace detail
+
+/// average time of a call of f(), in Unit (nanoseconds by default), over
+/// rounds calls
+template <class Unit = std::nano, class F> double measure(std::size_t rounds, F f) {
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t r = 0; r < rounds; ++r)
+        detail::run(f);
+    std::chrono::duration<double, Unit> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / static_cast<double>(rounds);
+}
+
+/// average time of a call of f(input), in nanoseconds, over rounds passes on
+/// inputs
+template <class Inputs, class F>
+double measure_each(std::size_t rounds, const Inputs &inputs, F f) {
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t r = 0; r < rounds; ++r)
+        for (auto &input : inputs)
+            detail::run(f, input);
+    std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count() / static_cast<double>(rounds * inputs.size());
+}
+
+} // namespace bench
+} // namespace scymnus
@@ -0,0 +1,128 @@
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "core/compact_model.hpp"
+
+using namespace scymnus;
+
+/// The footprint of model<> and compact_model<> with the same fields, and the
+/// time to scan large collections of them: summing the fields that are set,
+/// which touches every record, and reading one field of each record.
+
+#define SENSOR_FIELDS                                                          \
+    field<"id", std::optional<int>>, field<"station", std::optional<int>>,     \
+        field<"temperature", std::optional<float>>,                            \
+        field<"humidity", std::optional<float>>,                               \
+        field<"pressure", std::optional<int>>,                                 \
+        field<"wind", std::optional<int>>, field<"rain", std::optional<int>>,  \
+        field<"alarm", std::optional<int>>
+
+#define EVENT_FIELDS                                                           \
+    field<"flag", bool>, field<"timestamp", std::optional<int64_t>>,           \
+        field<"kind", std::optional<uint8_t>>, field<"value", double>,         \
+        field<"count", std::optional<int>>, field<"source", std::string>,      \
+        field<"level", std::optional<int16_t>>
+
+using sensor_model = model<SENSOR_FIELDS>;
+using compact_sensor_model = compact_model<SENSOR_FIELDS>;
+
+using event_model = model<EVENT_FIELDS>;
+using compact_event_model = compact_model<EVENT_FIELDS>;
+
+// every optional field is set for two records out of three
+template <class Model> std::vector<Model> sensors(int n) {
+    std::vector<Model> records(n);
+    for (int i = 0; i < n; ++i) {
+        auto &r = records[i];
+        if (i % 3) {
+            r.template get<"id">() = i;
+            r.template get<"station">() = i % 97;
+            r.template get<"temperature">() = 20.5f;
+            r.template get<"humidity">() = 0.4f;
+            r.template get<"pressure">() = 1013;
+            r.template get<"wind">() = i % 11;
+            r.template get<"rain">() = i % 5;
+        }
+        if (i % 7 == 0)
+            r.template get<"alarm">() = 1;
+    }
+    return records;
+}
+
+template <class Model> std::vector<Model> events(int n) {
+    std::vector<Model> records(n);
+    for (int i = 0; i < n; ++i) {
+        auto &r = records[i];
+        r.template get<"flag">() = i % 2;
+        r.template get<"value">() = i * 0.5;
+        if (i % 3)
+            r.template get<"timestamp">() = 1700000000 + i;
+        if (i % 4)
+            r.template get<"count">() = i % 13;
+        if (i % 5 == 0)
+            r.template get<"level">() = static_cast<int16_t>(i % 3);
+    }
+    return records;
+}
+
+template <class Model> int64_t sum_sensor(const Model &r) {
+    int64_t sum = 0;
+    for_each(r, [&sum](const auto &, const auto &v) {
+        if (v)
+            sum += static_cast<int64_t>(*v);
+    });
+    return sum;
+}
+
+template <class Model> int64_t sum_event(const Model &r) {
+    int64_t sum = r.template get<"flag">();
+    if (auto &&t = r.template get<"timestamp">())
+        sum += *t;
+    if (auto &&c = r.template get<"count">())
+        sum += *c;
+    if (auto &&l = r.template get<"level">())
+        sum += *l;
+    return sum;
+}
+
+template <class Model, class Sum, class Field>
+void scan(const char *name, const std::vector<Model> &records, Sum sum, Field field) {
+    constexpr int rounds = 20;
+    auto all = bench::measure<std::milli>(rounds, [&] {
+        int64_t total = 0;
+        for (const auto &r : records)
+            total += sum(r);
+        return total;
+    });
+    auto one = bench::measure<std::milli>(rounds, [&] {
+        int64_t total = 0;
+        for (const auto &r : records)
+            total += field(r);
+        return total;
+    });
+    std::cout << "  " << name << sizeof(Model) << " bytes, "
+              << sizeof(Model) * records.size() / (1024 * 1024) << " MiB, all fields " << all
+              << " ms, one field " << one << " ms\n";
+}
+
+int main() {
+    constexpr int n = 1000000;
+
+    std::cout << "sensor, 8 optional numbers, " << n << " records\n";
+    auto sensor_field = [](const auto &r) { return r.template get<"station">().value_or(0); };
+    scan("model          ", sensors<sensor_model>(n),
+         [](const auto &r) { return sum_sensor(r); }, sensor_field);
+    scan("compact_model  ", sensors<compact_sensor_model>(n),
+         [](const auto &r) { return sum_sensor(r); }, sensor_field);
+
+    std::cout << "event, mixed fields and a string, " << n << " records\n";
+    auto event_field = [](const auto &r) { return r.template get<"count">().value_or(0); };
+    scan("model          ", events<event_model>(n),
+         [](const auto &r) { return sum_event(r); }, event_field);
+    scan("compact_model  ", events<compact_event_model>(n),
+         [](const auto &r) { return sum_event(r); }, event_field);
+}
@@ -0,0 +1,105 @@
+#include <iostream>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "core/cbor.hpp"
+#include "core/json_reader.hpp"
+#include "core/json_writer.hpp"
+#include "core/msgpack.hpp"
+#include "core/wire.hpp"
+
+using namespace scymnus;
+
+/// The formats of bodies compared: size of the encoded models and time to
+/// write them into the output buffer and to read them back, for JSON,
+/// MessagePack, CBOR and the wire format. Every format is read and written
+/// without a DOM, the nlohmann conversions through a DOM are given for
+/// MessagePack as reference. The wire format is also read in place, through a
+/// view that only reads the fields used.
+
+using item_model = model<
+    field<"sku", std::string>,
+    field<"quantity", int>,
+    field<"price", double>,
+    field<"tags", std::vector<std::string>>>;
+
+using order_model = model<
+    field<"id", std::optional<int>>,
+    field<"customer", std::string>,
+    field<"email", std::optional<std::string>>,
+    field<"priority", std::optional<int>, init<[]() { return 1; }>{}>,
+    field<"express", bool>,
+    field<"note", std::optional<std::string>>,
+    field<"items", std::vector<item_model>>>;
+
+using point_model = model<
+    field<"id", std::optional<int>>,
+    field<"x", int>,
+    field<"y", int>,
+    field<"z", int>>;
+
+template <class Writer, class Reader, class T, class Size>
+void run(const char *format, const T &value, Size size) {
+    constexpr int rounds = 20000;
+    std::pmr::string output;
+    auto write = bench::measure(rounds, [&] {
+        output.clear();
+        Writer::write(output, value);
+        return output.size();
+    });
+    std::string body{output};
+    auto read = bench::measure(rounds, [&] { return size(Reader::template read<T>(body)); });
+    std::cout << "  " << format << body.size() << " bytes, write " << write << " ns, read "
+              << read << " ns\n";
+}
+
+template <class T, class Size, class View>
+void compare(const char *name, const T &value, Size size, View view) {
+    constexpr int rounds = 20000;
+    std::cout << name << '\n';
+    run<json_writer, json_reader>("json     ", value, size);
+    run<msgpack_writer, msgpack_reader>("msgpack  ", value, size);
+    run<cbor_writer, cbor_reader>("cbor     ", value, size);
+    run<wire_writer, wire_reader>("wire     ", value, size);
+
+    auto table = wire_codec<T>::encode(value);
+    auto in_place = bench::measure(rounds, [&] { return view(wire_view<T>{table}); });
+    std::cout << "  wire, view  read " << in_place << " ns\n";
+
+    auto encoded = nlohmann::json::to_msgpack(nlohmann::json(value));
+    auto write = bench::measure(rounds, [&] {
+        return nlohmann::json::to_msgpack(nlohmann::json(value)).size();
+    });
+    auto read = bench::measure(rounds, [&] {
+        return size(nlohmann::json::from_msgpack(encoded).template get<T>());
+    });
+    std::cout << "  msgpack, dom " << encoded.size() << " bytes, write " << write
+              << " ns, read " << read << " ns\n";
+}
+
+int main() {
+    auto order = [](int items) {
+        std::string body = R"({"customer": "Jane Doe", "email": "jane@example.com",)"
+                           R"( "express": true, "items": [)";
+        for (int i = 0; i < items; ++i) {
+            if (i)
+                body += ", ";
+            body += R"({"sku": "SKU-)" + std::to_string(100000 + i) +
+                    R"(", "quantity": )" + std::to_string(i % 7 + 1) +
+                    R"(, "price": 19.99, "tags": ["new", "sale"]})";
+        }
+        return json_reader::read<order_model>(body + "]}");
+    };
+
+    compare(
+        "point", json_reader::read<point_model>(R"({"x": 1, "y": 2, "z": 3})"),
+        [](const point_model &p) { return std::get<1>(p) + 1; },
+        [](const wire_view<point_model> &p) { return p.get<1>() + 1; });
+    for (int items : {1, 10, 100})
+        compare(
+            ("order, " + std::to_string(items) + " items").c_str(), order(items),
+            [](const order_model &o) { return std::get<6>(o).size(); },
+            [](const wire_view<order_model> &o) { return o.get<6>().size(); });
+}
@@ -0,0 +1,138 @@
+#include <iostream>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "core/json_reader.hpp"
+#include "core/json_writer.hpp"
+
+using namespace scymnus;
+
+/// Deserialization of request bodies into models: json_reader compared with
+/// parsing into a nlohmann DOM and converting it with from_json, as
+/// body_param did before. Serialization of responses: json_writer appending
+/// to the output buffer compared with building a DOM, dumping it and copying
+/// the dump, as context::write did before. Text bodies written with
+/// write_as<JSON>: json_reader::accept compared with nlohmann::json::accept.
+/// Sparse fieldsets: a projection compiled from ?fields= and written, compared
+/// with writing every field.
+
+using item_model = model<
+    field<"sku", std::string>,
+    field<"quantity", int>,
+    field<"price", double>,
+    field<"tags", std::vector<std::string>>>;
+
+using order_model = model<
+    field<"id", std::optional<int>>,
+    field<"customer", std::string>,
+    field<"email", std::optional<std::string>>,
+    field<"priority", std::optional<int>, init<[]() { return 1; }>{}>,
+    field<"express", bool>,
+    field<"note", std::optional<std::string>>,
+    field<"items", std::vector<item_model>>>;
+
+using point_model = model<
+    field<"id", std::optional<int>>,
+    field<"x", int>,
+    field<"y", int>,
+    field<"z", int>>;
+
+template <class T, class Size> void compare(const char *name, const std::string &body, Size size) {
+    constexpr int rounds = 20000;
+    auto dom = bench::measure(rounds, [&] { return size(nlohmann::json::parse(body).get<T>()); });
+    auto reader = bench::measure(rounds, [&] { return size(json_reader::read<T>(body)); });
+    std::cout << name << " (" << body.size() << " bytes): dom " << dom << " ns, reader "
+              << reader << " ns, " << dom / reader << "x\n";
+}
+
+template <class T> void compare_write(const char *name, const T &value) {
+    constexpr int rounds = 20000;
+    std::pmr::string output;
+    auto dom = bench::measure(rounds, [&] {
+        output.clear();
+        nlohmann::json v = value;
+        auto payload = v.dump();
+        output.append(payload);
+        return output.size();
+    });
+    auto writer = bench::measure(rounds, [&] {
+        output.clear();
+        json_writer::write(output, value);
+        return output.size();
+    });
+    std::cout << name << " (" << output.size() << " bytes): dom " << dom << " ns, writer "
+              << writer << " ns, " << dom / writer << "x\n";
+}
+
+int main() {
+    std::string point = R"({"x": 1, "y": 2, "z": 3})";
+
+    auto order = [](int items) {
+        std::string body = R"({"customer": "Jane Doe", "email": "jane@example.com",)"
+                           R"( "express": true, "unknown": {"a": [1, 2, 3]}, "items": [)";
+        for (int i = 0; i < items; ++i) {
+            if (i)
+                body += ", ";
+            body += R"({"sku": "SKU-)" + std::to_string(100000 + i) +
+                    R"(", "quantity": )" + std::to_string(i % 7 + 1) +
+                    R"(, "price": 19.99, "tags": ["new", "sale"]})";
+        }
+        return body + "]}";
+    };
+
+    compare<point_model>("point      ", point,
+                         [](const point_model &p) { return std::get<1>(p) + 1; });
+    for (int items : {1, 10, 100})
+        compare<order_model>(
+            ("order, " + std::to_string(items) + " items").c_str(), order(items),
+            [](const order_model &o) { return std::get<6>(o).size(); });
+
+    std::cout << '\n';
+    compare_write("point      ", json_reader::read<point_model>(point));
+    for (int items : {1, 10, 100})
+        compare_write(("order, " + std::to_string(items) + " items").c_str(),
+                      json_reader::read<order_model>(order(items)));
+
+    // a long note, with accents and a few escapes
+    auto note = order(1);
+    note.replace(note.find("Jane Doe"), 8, "Jos\u00e9 M\u00fcller");
+    std::string text;
+    while (text.size() < 4000)
+        text += "Caf\xC3\xA9 cr\xC3\xA8me, \"delivered\" to the back door.\n";
+    auto with_note = json_reader::read<order_model>(note);
+    std::get<5>(with_note) = text;
+    compare_write("order, note", with_note);
+
+    std::cout << '\n';
+    constexpr int rounds = 20000;
+    for (auto [name, body] : {std::pair{"order, 100 items", order(100)},
+                              std::pair{"plain text      ", std::string{"not found"}}}) {
+        auto dom = bench::measure(rounds, [&] { return nlohmann::json::accept(body); });
+        auto reader = bench::measure(rounds, [&] { return json_reader::accept(body); });
+        std::cout << "accept " << name << ": nlohmann " << dom << " ns, json_reader " << reader
+                  << " ns, " << dom / reader << "x\n";
+    }
+
+    std::cout << '\n';
+    auto orders = std::vector<order_model>(20, json_reader::read<order_model>(order(10)));
+    std::pmr::string output;
+    auto whole = bench::measure(rounds, [&] {
+        output.clear();
+        json_writer::write(output, orders);
+        return output.size();
+    });
+    auto whole_size = output.size();
+    for (const char *fields : {"id,customer,express", "id,items.sku"}) {
+        auto projected = bench::measure(rounds, [&] {
+            output.clear();
+            auto projection = field_projection::compile<order_model>(fields);
+            json_writer::write(output, orders, projection.root());
+            return output.size();
+        });
+        std::cout << "20 orders, fields=" << fields << " (" << output.size() << " of "
+                  << whole_size << " bytes): every field " << whole << " ns, projected "
+                  << projected << " ns, " << whole / projected << "x\n";
+    }
+}
@@ -0,0 +1,101 @@
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+
+#include "benchmark.hpp"
+#include "server/rate_limit.hpp"
+
+using namespace scymnus;
+
+/// Per request overhead of the rate_limit aspect.
+/// The sharded limiter is compared with the obvious alternative: a token
+/// bucket map protected by a global mutex.
+
+struct mutex_limiter {
+    struct bucket {
+        double tokens;
+        std::chrono::steady_clock::time_point last;
+    };
+
+    bool consume(const std::string &key) {
+        std::lock_guard lock{mutex_};
+        auto now = std::chrono::steady_clock::now();
+        auto [it, inserted] = buckets_.try_emplace(key, bucket{burst_, now});
+        auto &b = it->second;
+        b.tokens = std::min(burst_, b.tokens + rate_ * std::chrono::duration<double>(now - b.last).count());
+        b.last = now;
+        if (b.tokens < 1)
+            return false;
+        b.tokens -= 1;
+        return true;
+    }
+
+    double rate_{1e9};
+    double burst_{1e9};
+    std::mutex mutex_;
+    std::unordered_map<std::string, bucket> buckets_;
+};
+
+template <class F> double measure(std::size_t threads, std::size_t iterations, F f) {
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t t = 0; t < threads; ++t)
+        workers.emplace_back([&, t] {
+            for (std::size_t i = 0; i < iterations; ++i)
+                bench::do_not_optimize(f(t, i));
+        });
+    for (auto &w : workers)
+        w.join();
+    auto elapsed = std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start);
+    return elapsed.count() / iterations;
+}
+
+void report(const char *name, std::size_t threads, double ns) {
+    std::cout << name << " threads:" << threads << " " << ns << " ns/request\n";
+}
+
+int main() {
+    constexpr std::size_t iterations = 2'000'000;
+    std::size_t threads = std::max(2u, std::thread::hardware_concurrency());
+
+    std::vector<std::string> keys;
+    for (int i = 0; i < 10'000; ++i)
+        keys.push_back("10.0." + std::to_string(i / 256) + "." + std::to_string(i % 256));
+
+    for (std::size_t n : {std::size_t{1}, threads}) {
+        rate_limiter sharded{1e9, 1'000'000'000, n};
+        report("sharded, one key   ", n, measure(n, iterations, [&](auto, auto) {
+                   return sharded.consume(keys[0]).allowed;
+               }));
+        report("sharded, 10k keys  ", n, measure(n, iterations, [&](auto t, auto i) {
+                   return sharded.consume(keys[(i * 7 + t) % keys.size()]).allowed;
+               }));
+
+        mutex_limiter locked;
+        report("mutex, one key     ", n, measure(n, iterations, [&](auto, auto) {
+                   return locked.consume(keys[0]);
+               }));
+        report("mutex, 10k keys    ", n, measure(n, iterations, [&](auto t, auto i) {
+                   return locked.consume(keys[(i * 7 + t) % keys.size()]);
+               }));
+    }
+
+    // the aspect as called by the router, the key is read from a header
+    boost::asio::io_context io;
+    io_info().set(&io);
+    std::pmr::string output;
+    context ctx{&output};
+    ctx.add_request_header(std::pmr::string{"X-Api-Key"}, std::pmr::string{"a7f3c2"});
+    auto aspect = rate_limit::per_header("X-Api-Key", 1e9, 1'000'000'000);
+    report("aspect, api key    ", 1, measure(1, iterations, [&](auto, auto) {
+               aspect(ctx);
+               return !ctx.is_response_written();
+           }));
+}
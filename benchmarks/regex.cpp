@@ -0,0 +1,60 @@
+#include <iostream>
+#include <random>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "utilities/regex_dfa.hpp"
+
+using namespace scymnus;
+
+/// Validation of path segments by regular expressions: the DFA compiled
+/// when a :R(...) route is added compared with std::regex_match.
+
+// passes over the inputs of a measure
+constexpr std::size_t rounds = 20;
+
+int main() {
+    struct pattern {
+        const char *name;
+        const char *regex;
+        std::vector<std::string> samples;
+    };
+
+    std::vector<pattern> patterns{
+        {"sku", "[A-Z]{3}-\\d{4,8}", {"ABC-1234", "XYZ-12345678", "AB-1234", "ABC-12a4"}},
+        {"slug",
+         "[a-z0-9]+(-[a-z0-9]+)*",
+         {"hello-world", "a-much-longer-slug-for-some-article-2024", "Bad-Slug", "trailing-"}},
+        {"version", "v(\\d+)(\\.\\d+){0,2}", {"v1", "v2.10", "v3.1.4", "v1.2.3.4"}},
+        {"file", "(?:[a-zA-Z0-9_]+)\\.(png|jpe?g|gif|webp)", {"logo.png", "photo_01.jpeg", "a.bmp", "x.gif"}},
+    };
+
+    std::mt19937 rng{42};
+    for (auto &p : patterns) {
+        utils::regex_dfa dfa{p.regex};
+        std::regex re{p.regex, std::regex::ECMAScript | std::regex::optimize};
+
+        std::vector<std::string> segments;
+        for (int i = 0; i < 100000; ++i)
+            segments.push_back(p.samples[rng() % p.samples.size()]);
+
+        for (auto &s : p.samples)
+            if (dfa.match(s) != std::regex_match(s, re))
+                std::cout << "mismatch on " << s << "\n";
+
+        std::cout << p.name << " (" << p.regex << ", " << dfa.size() << " states)\n";
+        std::cout << "  std::regex:  "
+                  << bench::measure_each(rounds, segments,
+                                         [&](const std::string &s) {
+                                             return std::regex_match(s, re);
+                                         })
+                  << " ns/match\n";
+        std::cout << "  regex_dfa:   "
+                  << bench::measure_each(rounds, segments,
+                                         [&](const std::string &s) { return dfa.match(s); })
+                  << " ns/match\n";
+    }
+}
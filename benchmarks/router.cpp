@@ -0,0 +1,149 @@
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "server/radix_tree.hpp"
+
+using namespace scymnus;
+
+/// Route matching against 10k routes.
+/// The radix tree is compared with the segment trie it replaced: one heap
+/// node per segment, children scanned linearly and compared segment by
+/// segment.
+
+struct segment_trie {
+    struct node {
+        FragmentType type{FragmentType::Simple};
+        std::string value;
+        std::vector<std::unique_ptr<node>> children;
+        int route{-1};
+    };
+
+    void add(std::string_view url, int route) {
+        node *current = &head_;
+        std::size_t start = url.find_first_not_of('/');
+        while (start != std::string_view::npos) {
+            auto end = url.find('/', start);
+            auto part = std::string(url.substr(
+                start, end == std::string_view::npos ? std::string_view::npos : end - start));
+            start = url.find_first_not_of('/', end);
+
+            node *found = nullptr;
+            for (auto &c : current->children)
+                if (c->value == part)
+                    found = c.get();
+            if (!found) {
+                auto n = std::make_unique<node>();
+                if (part == ":I")
+                    n->type = FragmentType::Integer;
+                else if (part == ":*")
+                    n->type = FragmentType::PathWildCard;
+                n->value = part;
+                found = n.get();
+                current->children.push_back(std::move(n));
+            }
+            current = found;
+        }
+        current->route = route;
+    }
+
+    int match(std::string_view url) const {
+        const node *current = &head_;
+        std::size_t start = url.find_first_not_of('/');
+        while (start != std::string_view::npos) {
+            auto end = url.find('/', start);
+            auto part = url.substr(
+                start, end == std::string_view::npos ? std::string_view::npos : end - start);
+            start = url.find_first_not_of('/', end);
+
+            for (auto &c : current->children) {
+                if (c->type == FragmentType::Simple) {
+                    if (part == c->value) {
+                        current = c.get();
+                        break;
+                    }
+                } else if (c->type == FragmentType::Integer) {
+                    bool digits = std::all_of(part.begin(), part.end(),
+                                              [](char ch) { return ch >= '0' && ch <= '9'; });
+                    if (digits) {
+                        current = c.get();
+                        break;
+                    }
+                } else {
+                    current = c.get();
+                    break;
+                }
+            }
+        }
+        return current->route;
+    }
+
+    node head_;
+};
+
+// passes over the inputs of a measure
+constexpr std::size_t rounds = 20;
+
+int main() {
+    constexpr int services = 1000;
+    const char *shapes[] = {"",           "/items",         "/items/:I",
+                            "/items/:I/details", "/items/:I/tags/:I", "/settings",
+                            "/users/:I",  "/users/:I/roles", "/reports/daily",
+                            "/files/:*"};
+
+    std::vector<std::string> routes;
+    for (int s = 0; s < services; ++s)
+        for (auto shape : shapes)
+            routes.push_back("/api/v" + std::to_string(s % 3) + "/service" +
+                             std::to_string(s) + shape);
+
+    radix_tree tree;
+    segment_trie baseline;
+    for (std::size_t i = 0; i < routes.size(); ++i) {
+        tree.add(routes[i], http_method::GET, [](context &) {});
+        baseline.add(routes[i], static_cast<int>(i));
+    }
+    auto table = tree.seal();
+
+    std::mt19937 rng{42};
+    std::vector<std::string> urls;
+    for (int i = 0; i < 100000; ++i) {
+        auto route = routes[rng() % routes.size()];
+        std::string url;
+        std::size_t pos = 0;
+        while (pos < route.size()) {
+            if (route.compare(pos, 2, ":I") == 0) {
+                url += std::to_string(rng() % 100000);
+                pos += 2;
+            } else if (route.compare(pos, 2, ":*") == 0) {
+                url += "docs/readme.txt";
+                pos += 2;
+            } else
+                url += route[pos++];
+        }
+        urls.push_back(std::move(url));
+    }
+
+    std::cout << routes.size() << " routes, " << table->size()
+              << " radix tree nodes\n";
+
+    path_captures captures;
+    auto not_found = &table->match("/no/such/route", http_method::GET, captures);
+    std::cout << "segment trie:  "
+              << bench::measure_each(rounds, urls,
+                                     [&](const std::string &u) {
+                                         return baseline.match(u) >= 0;
+                                     })
+              << " ns/match\n";
+    std::cout << "radix tree:    "
+              << bench::measure_each(rounds, urls,
+                                     [&](const std::string &u) {
+                                         return &table->match(u, http_method::GET, captures) !=
+                                                not_found;
+                                     })
+              << " ns/match\n";
+}
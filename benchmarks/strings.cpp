@@ -0,0 +1,156 @@
+#include <cctype>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "utilities/simd.hpp"
+
+using namespace scymnus;
+
+/// Scanning and case folding of utils::simd compared with the scalar
+/// versions and with std::string_view, for inputs of the sizes of paths,
+/// query strings and header values, and the JSON string kernels (bytes to
+/// escape, UTF-8 validation) for the sizes of string fields.
+
+// passes over the inputs of a measure
+constexpr std::size_t rounds = 200;
+
+int main() {
+    std::mt19937 rng{42};
+    const std::string alphabet =
+        "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_.";
+
+    for (std::size_t size : {16, 48, 128, 512, 2048}) {
+        // the byte searched for is at the end, so the whole input is scanned
+        std::vector<std::string> inputs, upper;
+        for (int i = 0; i < 1000; ++i) {
+            std::string s(size, ' ');
+            for (auto &c : s)
+                c = alphabet[rng() % alphabet.size()];
+            s.back() = '%';
+            inputs.push_back(s);
+            for (auto &c : s)
+                c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+            upper.push_back(std::move(s));
+        }
+        // leading whitespace to skip
+        std::vector<std::string> padded(inputs.size(), std::string(size - 1, ' ') + "x");
+
+        auto results = [&](const char *name, auto std_f, auto scalar_f, auto simd_f) {
+            std::cout << "  " << name << ": std " << bench::measure_each(rounds, inputs, std_f) << " ns, scalar "
+                      << bench::measure_each(rounds, inputs, scalar_f) << " ns, simd " << bench::measure_each(rounds, inputs, simd_f)
+                      << " ns\n";
+        };
+
+        std::cout << size << " bytes\n";
+        results(
+            "find '%'        ", [](std::string_view s) { return s.find('%'); },
+            [](std::string_view s) { return utils::simd::scalar::find(s, '%'); },
+            [](std::string_view s) { return utils::simd::find(s, '%'); });
+        results(
+            "find_first_of   ", [](std::string_view s) { return s.find_first_of("%+&="); },
+            [](std::string_view s) { return utils::simd::scalar::find_first_of(s, "%+&="); },
+            [](std::string_view s) { return utils::simd::find_first_of(s, "%+&="); });
+
+        std::size_t i = 0;
+        auto trim = [&](auto f) {
+            i = 0;
+            return [&, f](const std::string &) {
+                return f(std::string_view{padded[i++ % padded.size()]});
+            };
+        };
+        std::cout << "  find_first_not_of: std "
+                  << bench::measure_each(rounds, inputs, trim([](std::string_view s) {
+                         return s.find_first_not_of(" \t\f\v\n\r");
+                     }))
+                  << " ns, scalar "
+                  << bench::measure_each(rounds, inputs, trim([](std::string_view s) {
+                         return utils::simd::scalar::find_first_not_of(s, " \t\f\v\n\r");
+                     }))
+                  << " ns, simd "
+                  << bench::measure_each(rounds, inputs, trim([](std::string_view s) {
+                         return utils::simd::find_first_not_of(s, " \t\f\v\n\r");
+                     }))
+                  << " ns\n";
+
+        auto compare = [&](auto f) {
+            i = 0;
+            return [&, f](const std::string &s) {
+                return static_cast<std::size_t>(f(s, upper[i++ % upper.size()]));
+            };
+        };
+        std::cout << "  iequals:           scalar "
+                  << bench::measure_each(rounds, inputs,
+                                         compare([](std::string_view a, std::string_view b) {
+                                             return utils::simd::scalar::iequals(a, b);
+                                         }))
+                  << " ns, simd "
+                  << bench::measure_each(rounds, inputs,
+                                         compare([](std::string_view a, std::string_view b) {
+                                             return utils::simd::iequals(a, b);
+                                         }))
+                  << " ns\n";
+
+        std::vector<std::string> copies = upper;
+        auto lower = [&](auto f) {
+            i = 0;
+            return [&, f](const std::string &) {
+                auto &s = copies[i++ % copies.size()];
+                f(s.data(), s.size());
+                return static_cast<std::size_t>(s[0]);
+            };
+        };
+        std::cout << "  to_lower:          scalar "
+                  << bench::measure_each(rounds, inputs, lower([](char *d, std::size_t n) {
+                         utils::simd::scalar::to_lower(d, n);
+                     }))
+                  << " ns, simd "
+                  << bench::measure_each(rounds, inputs, lower([](char *d, std::size_t n) {
+                         utils::simd::to_lower(d, n);
+                     }))
+                  << " ns\n";
+
+        // nothing to escape, so the whole input is scanned
+        std::cout << "  find_json_escape:  scalar "
+                  << bench::measure_each(rounds, inputs, [](std::string_view s) {
+                         return utils::simd::scalar::find_json_escape(s);
+                     })
+                  << " ns, simd "
+                  << bench::measure_each(rounds, inputs, [](std::string_view s) {
+                         return utils::simd::find_json_escape(s);
+                     })
+                  << " ns\n";
+
+        // one two byte sequence every eight bytes
+        std::vector<std::string> text = inputs;
+        for (auto &s : text)
+            for (std::size_t k = 0; k + 1 < s.size(); k += 8) {
+                s[k] = '\xC3';
+                s[k + 1] = '\xA9';
+            }
+        auto valid = [](auto f) {
+            return [f](const std::string &s) { return static_cast<std::size_t>(f(s)); };
+        };
+        std::cout << "  valid_utf8 ascii:  scalar "
+                  << bench::measure_each(rounds, inputs, valid([](std::string_view s) {
+                         return utils::simd::scalar::valid_utf8(s);
+                     }))
+                  << " ns, simd "
+                  << bench::measure_each(rounds, inputs, valid([](std::string_view s) {
+                         return utils::simd::valid_utf8(s);
+                     }))
+                  << " ns\n";
+        std::cout << "  valid_utf8 text:   scalar "
+                  << bench::measure_each(rounds, text, valid([](std::string_view s) {
+                         return utils::simd::scalar::valid_utf8(s);
+                     }))
+                  << " ns, simd "
+                  << bench::measure_each(rounds, text, valid([](std::string_view s) {
+                         return utils::simd::valid_utf8(s);
+                     }))
+                  << " ns\n";
+    }
+}
@@ -0,0 +1,410 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "core/exception.hpp"
+#include "core/model_reader.hpp"
+#include "core/model_writer.hpp"
+#include "external/json.hpp"
+#include "utilities/simd.hpp"
+
+namespace scymnus {
+
+// CBOR (application/cbor) bodies, read into and written from models without a
+// DOM (see model_reader.hpp and model_writer.hpp). Indefinite lengths and half
+// precision floats are read, tags are skipped. Keys without chunks are read
+// in place, other types are decoded and encoded by nlohmann.
+
+class cbor_reader : model_reader<cbor_reader> {
+    friend class model_reader<cbor_reader>;
+
+public:
+    /// reads a document holding a T, throws sc_exception if the document is
+    /// malformed, exceeds the limits or does not match T and
+    /// validation_exception if constraints are violated
+    template <class T>
+    static T read(std::string_view document,
+                  const read_options &options = body_read_options()) {
+        if (options.max_size && document.size() > options.max_size)
+            throw sc_exception{"cbor: document exceeds the maximum size"};
+
+        if constexpr (!model_detail::is_streamed<T>::value) {
+            return deserializing_json<T>::from_cbor(document.begin(), document.end(), true, true,
+                                                    nlohmann::json::cbor_tag_handler_t::ignore)
+                .template get<T>();
+        } else {
+            cbor_reader reader{document, options};
+            auto value = reader.read_value<T>();
+            if (reader.p_ != reader.end_)
+                reader.error("unexpected data after the document");
+            return value;
+        }
+    }
+
+private:
+    cbor_reader(std::string_view document, const read_options &options)
+        : model_reader{options}, begin_{document.data()}, p_{document.data()},
+          end_{document.data() + document.size()} {}
+
+    // the cursor of a map or an array, the number of elements left or
+    // elements up to a break
+    struct cursor {
+        uint64_t left;
+        bool indefinite;
+    };
+
+    static constexpr unsigned char break_byte = 0xFF;
+
+    [[noreturn]] void error(const char *what) const {
+        throw sc_exception{"cbor: " + std::string{what} + " at offset " +
+                           std::to_string(p_ - begin_)};
+    }
+
+    void need(uint64_t n) {
+        if (static_cast<uint64_t>(end_ - p_) < n)
+            error("unexpected end of document");
+    }
+
+    void skip(uint64_t n) {
+        need(n);
+        p_ += n;
+    }
+
+    unsigned char byte() {
+        need(1);
+        return static_cast<unsigned char>(*p_);
+    }
+
+    // the initial byte of the next value, after its tags
+    unsigned char peek() {
+        auto b = byte();
+        while (b >> 5 == 6) {
+            ++p_;
+            argument(b & 0x1F);
+            b = byte();
+        }
+        return b;
+    }
+
+    template <class U> U load() {
+        need(sizeof(U));
+        auto v = model_detail::load_big_endian<U>(p_);
+        p_ += sizeof(U);
+        return v;
+    }
+
+    // the value encoded by the additional information of an initial byte
+    uint64_t argument(unsigned info) {
+        if (info < 24)
+            return info;
+        switch (info) {
+        case 24: return load<uint8_t>();
+        case 25: return load<uint16_t>();
+        case 26: return load<uint32_t>();
+        case 27: return load<uint64_t>();
+        default: error("invalid additional information");
+        }
+    }
+
+    static double half(uint16_t h) {
+        int exponent = (h >> 10) & 0x1F;
+        int mantissa = h & 0x3FF;
+        double v = exponent == 0    ? std::ldexp(mantissa, -24)
+                   : exponent != 31 ? std::ldexp(mantissa + 1024, exponent - 25)
+                   : mantissa == 0  ? std::numeric_limits<double>::infinity()
+                                    : std::numeric_limits<double>::quiet_NaN();
+        return h & 0x8000 ? -v : v;
+    }
+
+    // null and undefined
+    bool null() {
+        auto b = peek();
+        if (b != 0xF6 && b != 0xF7)
+            return false;
+        ++p_;
+        return true;
+    }
+
+    bool boolean() {
+        auto b = peek();
+        if (b != 0xF4 && b != 0xF5)
+            error("expected a boolean");
+        ++p_;
+        return b == 0xF5;
+    }
+
+    // as in JSON, true and false are 1 and 0
+    template <class T> T number() {
+        auto b = peek();
+        auto info = b & 0x1F;
+        switch (b >> 5) {
+        case 0: ++p_; return narrow<T>(argument(info));
+        case 1: {
+            ++p_;
+            auto n = argument(info);
+            if (n > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()))
+                error("number out of range");
+            return narrow<T>(-1 - static_cast<int64_t>(n));
+        }
+        default: break;
+        }
+        switch (b) {
+        case 0xF4:
+        case 0xF5: return static_cast<T>(boolean());
+        case 0xF9: ++p_; return narrow<T>(half(load<uint16_t>()));
+        case 0xFA: ++p_; return narrow<T>(load<float>());
+        case 0xFB: ++p_; return narrow<T>(load<double>());
+        default: error("expected a number");
+        }
+    }
+
+    // appends a text string, definite or made of chunks
+    template <class String> void string(String &out) {
+        auto b = peek();
+        if (b >> 5 != 3)
+            error("expected a string");
+        ++p_;
+        if ((b & 0x1F) != 31) {
+            auto n = argument(b & 0x1F);
+            need(n);
+            utf8(n);
+            out.append(p_, n);
+            p_ += n;
+            return;
+        }
+        while (byte() != break_byte) {
+            auto chunk = byte();
+            if (chunk >> 5 != 3 || (chunk & 0x1F) == 31)
+                error("invalid string chunk");
+            ++p_;
+            auto n = argument(chunk & 0x1F);
+            need(n);
+            utf8(n);
+            out.append(p_, n);
+            p_ += n;
+        }
+        ++p_;
+    }
+
+    // the n bytes of a string or of a chunk at p_, which are stored as they
+    // are. Chunks do not split characters
+    void utf8(uint64_t n) {
+        if (!utils::simd::valid_utf8({p_, static_cast<std::size_t>(n)}))
+            error("invalid UTF-8 in string");
+    }
+
+    // a definite key refers to the document, one made of chunks is decoded
+    // into key_
+    std::string_view key() {
+        auto b = peek();
+        if (b >> 5 != 3)
+            error("expected a key");
+        if ((b & 0x1F) == 31) {
+            key_.clear();
+            string(key_);
+            return key_;
+        }
+        ++p_;
+        auto n = argument(b & 0x1F);
+        need(n);
+        std::string_view k{p_, static_cast<std::size_t>(n)};
+        p_ += n;
+        return k;
+    }
+
+    cursor begin(unsigned major, const char *what) {
+        auto b = peek();
+        if (b >> 5 != major)
+            error(what);
+        ++p_;
+        if ((b & 0x1F) == 31)
+            return {0, true};
+        return {argument(b & 0x1F), false};
+    }
+
+    cursor begin_object() { return begin(5, "expected a map"); }
+
+    cursor begin_array() { return begin(4, "expected an array"); }
+
+    bool next_key(cursor &c, std::string_view &k) {
+        if (!next_element(c))
+            return false;
+        k = key();
+        return true;
+    }
+
+    bool next_element(cursor &c) {
+        if (c.indefinite) {
+            if (byte() != break_byte)
+                return true;
+            ++p_;
+            return false;
+        }
+        if (!c.left)
+            return false;
+        --c.left;
+        return true;
+    }
+
+    template <class T> T fallback() {
+        auto start = p_;
+        skip_value();
+        return deserializing_json<T>::from_cbor(start, p_, true, true,
+                                                nlohmann::json::cbor_tag_handler_t::ignore)
+            .template get<T>();
+    }
+
+    // moves past a value that is not stored
+    void skip_value() {
+        auto b = peek();
+        auto major = b >> 5;
+        auto info = b & 0x1F;
+
+        switch (major) {
+        case 0:
+        case 1: ++p_; argument(info); return;
+        case 2:
+        case 3:
+            if (info != 31) {
+                ++p_;
+                skip(argument(info));
+                return;
+            }
+            ++p_;
+            while (byte() != break_byte) {
+                auto chunk = byte();
+                if (chunk >> 5 != major || (chunk & 0x1F) == 31)
+                    error("invalid string chunk");
+                ++p_;
+                skip(argument(chunk & 0x1F));
+            }
+            ++p_;
+            return;
+        case 4:
+        case 5: {
+            enter();
+            auto c = begin(major, "");
+            while (next_element(c)) {
+                skip_value();
+                if (major == 5)
+                    skip_value();
+            }
+            leave();
+            return;
+        }
+        default:
+            break;
+        }
+
+        // simple values and floats
+        switch (info) {
+        case 24: skip(2); return;
+        case 25: skip(3); return;
+        case 26: skip(5); return;
+        case 27: skip(9); return;
+        case 28:
+        case 29:
+        case 30: error("invalid additional information");
+        case 31: error("unexpected break");
+        default: ++p_; return;
+        }
+    }
+
+    const char *begin_;
+    const char *p_;
+    const char *end_;
+    // a key made of chunks
+    std::string key_;
+};
+
+// the encoding of the items written by model_writer, as nlohmann::to_cbor
+struct cbor_encoding {
+    template <class String> static void null(String &out) { out.push_back('\xF6'); }
+
+    template <class String> static void boolean(String &out, bool b) {
+        out.push_back(b ? '\xF5' : '\xF4');
+    }
+
+    template <class String, class T> static void integer(String &out, T v) {
+        if constexpr (std::is_signed_v<T>) {
+            if (v < 0) {
+                head(out, 1, static_cast<uint64_t>(-1 - static_cast<int64_t>(v)));
+                return;
+            }
+        }
+        head(out, 0, static_cast<uint64_t>(v));
+    }
+
+    // half precision for NaN and the infinities, single precision when the
+    // value is exact in it
+    template <class String> static void floating(String &out, double d) {
+        if (std::isnan(d))
+            out.append("\xF9\x7E\x00", 3);
+        else if (std::isinf(d))
+            out.append(d > 0 ? "\xF9\x7C\x00" : "\xF9\xFC\x00", 3);
+        else if (d >= static_cast<double>(std::numeric_limits<float>::lowest()) &&
+                 d <= static_cast<double>(std::numeric_limits<float>::max()) &&
+                 static_cast<double>(static_cast<float>(d)) == d) {
+            out.push_back('\xFA');
+            model_detail::append_big_endian(out, static_cast<float>(d));
+        } else {
+            out.push_back('\xFB');
+            model_detail::append_big_endian(out, d);
+        }
+    }
+
+    template <class String> static void string(String &out, std::string_view s) {
+        head(out, 3, s.size());
+        out.append(s.data(), s.size());
+    }
+
+    template <class String> static void array(String &out, std::size_t n) { head(out, 4, n); }
+
+    template <class String> static void map(String &out, std::size_t n) { head(out, 5, n); }
+
+    template <class String, class Json> static void fallback(String &out, const Json &j) {
+        auto bytes = Json::to_cbor(j);
+        out.append(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+    }
+
+    static constexpr std::size_t head_size(uint64_t n) {
+        return n < 24 ? 1 : n <= 0xFF ? 2 : n <= 0xFFFF ? 3 : n <= 0xFFFFFFFF ? 5 : 9;
+    }
+
+    static constexpr std::size_t string_head_size(std::size_t n) { return head_size(n); }
+
+    template <std::size_t N>
+    static constexpr std::size_t string_head(std::size_t n, std::array<char, N> &text,
+                                             std::size_t i) {
+        return encode_head(3, n, text, i);
+    }
+
+private:
+    // the initial byte of a major type and the bytes of its argument
+    template <std::size_t N>
+    static constexpr std::size_t encode_head(unsigned major, uint64_t n,
+                                             std::array<char, N> &text, std::size_t i) {
+        auto size = head_size(n);
+        constexpr unsigned char info[] = {0, 0, 24, 25, 0, 26, 0, 0, 0, 27};
+        text[i] = static_cast<char>(major << 5 | (size == 1 ? n : info[size]));
+        for (std::size_t k = 1; k < size; ++k)
+            text[i + k] = static_cast<char>(n >> (8 * (size - 1 - k)));
+        return i + size;
+    }
+
+    template <class String> static void head(String &out, unsigned major, uint64_t n) {
+        std::array<char, 9> text{};
+        out.append(text.data(), encode_head(major, n, text, 0));
+    }
+};
+
+using cbor_writer = model_writer<cbor_encoding>;
+
+} // namespace scymnus
@@ -0,0 +1,543 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "core/named_tuple.hpp"
+#include "core/request_resource.hpp"
+#include "core/traits.hpp"
+
+namespace scymnus {
+
+// compact_model<field<...>...> holds the same fields as model<field<...>...>
+// with a smaller footprint, for large in-memory collections of records. The
+// fields are laid out at compile time by decreasing alignment, so that no
+// padding is left between them, and optional fields keep their value without
+// the bool of std::optional: their presence is one bit of a bitmask stored
+// after the fields. A model of eight std::optional<int> takes 36 bytes instead
+// of 64.
+//
+// get<"name">() and operator[] work as for model<>, except that get<> returns
+// a compact_optional for optional fields, a reference to the value and its
+// bit that behaves as an std::optional. for_each visits the fields in their
+// declared order. JSON, MessagePack and CBOR bodies are read and written as
+// for the equivalent model, with the same output, and a compact_model is
+// converted from and to one with its constructor and to_model().
+
+template <class... N> class compact_model;
+
+namespace compact_detail {
+
+// the type kept in the storage of a field
+template <class T> struct stored {
+    using type = T;
+    static constexpr bool optional = false;
+};
+
+template <class T> struct stored<std::optional<T>> {
+    using type = T;
+    static constexpr bool optional = true;
+};
+
+template <class T> using stored_t = typename stored<T>::type;
+
+// the offsets of the fields of a tuple of field types and of the bitmask
+template <class Tuple> struct layout;
+
+template <class... T> struct layout<std::tuple<T...>> {
+    static constexpr std::size_t count = sizeof...(T);
+
+    static constexpr std::array<bool, count> optional{stored<T>::optional...};
+
+    // the bit of each optional field
+    static constexpr std::array<std::size_t, count> bits = [] {
+        std::array<std::size_t, count> bits{};
+        std::size_t next = 0;
+        for (std::size_t i = 0; i < count; ++i)
+            if (optional[i])
+                bits[i] = next++;
+        return bits;
+    }();
+
+    static constexpr std::size_t optionals = (std::size_t{stored<T>::optional} + ... + 0);
+
+    static constexpr std::size_t mask_size = (optionals + 7) / 8;
+
+    // fields by decreasing alignment, in declaration order for equal ones:
+    // the size of a type is a multiple of its alignment, so each field
+    // starts where the previous one ends
+    static constexpr std::array<std::size_t, count> offsets = [] {
+        constexpr std::array<std::size_t, count> sizes{sizeof(stored_t<T>)...};
+        constexpr std::array<std::size_t, count> alignments{alignof(stored_t<T>)...};
+
+        // an insertion sort, stable and usable in constant expressions
+        std::array<std::size_t, count> order{};
+        for (std::size_t i = 0; i < count; ++i) {
+            auto j = i;
+            for (; j > 0 && alignments[order[j - 1]] < alignments[i]; --j)
+                order[j] = order[j - 1];
+            order[j] = i;
+        }
+
+        std::array<std::size_t, count> offsets{};
+        std::size_t at = 0;
+        for (auto i : order) {
+            offsets[i] = at;
+            at += sizes[i];
+        }
+        return offsets;
+    }();
+
+    static constexpr bool nothrow_move = (std::is_nothrow_move_constructible_v<stored_t<T>> && ...);
+
+    static constexpr std::size_t mask_offset = (sizeof(stored_t<T>) + ... + 0);
+
+    static constexpr std::size_t alignment = std::max({std::size_t{1}, alignof(stored_t<T>)...});
+
+    // at least one byte, as any object
+    static constexpr std::size_t size =
+        std::max<std::size_t>(1, (mask_offset + mask_size + alignment - 1) / alignment * alignment);
+};
+
+} // namespace compact_detail
+
+/// an optional field of a compact_model: refers to the value stored in the
+/// model and to its presence bit, and behaves as an std::optional of it.
+/// Assigning to it assigns the field
+template <class T> class compact_optional {
+    using byte = std::conditional_t<std::is_const_v<T>, const unsigned char, unsigned char>;
+
+public:
+    using value_type = std::remove_const_t<T>;
+
+    compact_optional(T *value, byte *mask, unsigned char bit)
+        : value_{value}, mask_{mask}, bit_{bit} {}
+
+    compact_optional(const compact_optional &) = default;
+
+    /// a non const reference converts to a const one
+    template <class U>
+        requires std::is_same_v<const U, T> && (!std::is_same_v<U, T>)
+    compact_optional(const compact_optional<U> &other)
+        : value_{other.value_}, mask_{other.mask_}, bit_{other.bit_} {}
+
+    bool has_value() const noexcept { return *mask_ & bit_; }
+
+    explicit operator bool() const noexcept { return has_value(); }
+
+    T &operator*() const noexcept { return *value_; }
+
+    T *operator->() const noexcept { return value_; }
+
+    T &value() const {
+        if (!has_value())
+            throw std::bad_optional_access{};
+        return *value_;
+    }
+
+    template <class U> value_type value_or(U &&fallback) const {
+        return has_value() ? *value_ : static_cast<value_type>(std::forward<U>(fallback));
+    }
+
+    operator std::optional<value_type>() const {
+        if (has_value())
+            return *value_;
+        return std::nullopt;
+    }
+
+    void reset() const noexcept {
+        if (has_value()) {
+            std::destroy_at(value_);
+            *mask_ &= ~bit_;
+        }
+    }
+
+    template <class... Args> T &emplace(Args &&...args) const {
+        reset();
+        std::construct_at(value_, std::forward<Args>(args)...);
+        *mask_ |= bit_;
+        return *value_;
+    }
+
+    compact_optional &operator=(std::nullopt_t) {
+        reset();
+        return *this;
+    }
+
+    // assigns the value, a copy of the reference would rebind it
+    compact_optional &operator=(const compact_optional &other) { return assign(other); }
+
+    template <class U>
+        requires std::is_same_v<std::remove_const_t<U>, value_type>
+    compact_optional &operator=(const compact_optional<U> &other) {
+        return assign(other);
+    }
+
+    compact_optional &operator=(const std::optional<value_type> &other) { return assign(other); }
+
+    compact_optional &operator=(std::optional<value_type> &&other) {
+        if (other)
+            set(std::move(*other));
+        else
+            reset();
+        return *this;
+    }
+
+    template <class U = value_type>
+        requires(!is_optional<std::remove_cvref_t<U>>::value &&
+                 std::is_constructible_v<value_type, U> && std::is_assignable_v<value_type &, U>)
+    compact_optional &operator=(U &&v) {
+        set(std::forward<U>(v));
+        return *this;
+    }
+
+    friend bool operator==(const compact_optional &o, std::nullopt_t) noexcept {
+        return !o.has_value();
+    }
+
+    template <class U>
+        requires(!is_optional<U>::value && !std::is_same_v<U, std::nullopt_t>)
+    friend bool operator==(const compact_optional &o, const U &v) {
+        return o.has_value() && *o == v;
+    }
+
+private:
+    template <class U> friend class compact_optional;
+
+    template <class U> void set(U &&v) const {
+        if (has_value())
+            *value_ = std::forward<U>(v);
+        else
+            emplace(std::forward<U>(v));
+    }
+
+    template <class Other> compact_optional &assign(const Other &other) {
+        if (other)
+            set(*other);
+        else
+            reset();
+        return *this;
+    }
+
+    T *value_;
+    byte *mask_;
+    unsigned char bit_;
+};
+
+template <class T> struct is_optional<compact_optional<T>> : std::true_type {};
+
+/// sets an optional field of a compact_model, allocator-aware types allocate
+/// from the resource of the request
+template <class T, class U> void assign_request_value(compact_optional<T> v, U &&value) {
+    if constexpr (std::uses_allocator_v<T, std::pmr::polymorphic_allocator<>>)
+        v.emplace(make_request_value<T>()) = std::forward<U>(value);
+    else
+        v = std::forward<U>(value);
+}
+
+template <class... N> class compact_model {
+    using fields_tuple = tl::remove_if<is_properties, tl::typelist<N...>, std::tuple<>>;
+    using fields_internal_type = tl::transform<internal_type, fields_tuple>;
+    using layout = compact_detail::layout<fields_internal_type>;
+
+    template <std::size_t I> using type_at = std::tuple_element_t<I, fields_internal_type>;
+
+    template <std::size_t I> using stored_at = compact_detail::stored_t<type_at<I>>;
+
+    template <std::size_t I> static constexpr bool optional_at = layout::optional[I];
+
+    using indexes = std::make_index_sequence<layout::count>;
+
+public:
+    /// the model with the same fields
+    using model_type = model<N...>;
+
+    static constexpr size_t object_size = model_type::object_size;
+
+    static constexpr const auto &names = model_type::names;
+
+    static constexpr const auto &properties = model_type::properties;
+
+    compact_model() {
+        construct(
+            [this](auto i) {
+                if constexpr (!optional_at<i>)
+                    std::construct_at(slot<i>());
+            },
+            indexes{});
+    }
+
+    compact_model(const compact_model &other) {
+        construct([&](auto i) { copy<i>(other.template get<i>()); }, indexes{});
+    }
+
+    compact_model(compact_model &&other) noexcept(layout::nothrow_move) {
+        construct([&](auto i) { copy<i>(std::move(other).template take_or_get<i>()); },
+                  indexes{});
+    }
+
+    compact_model(const model_type &m) {
+        construct([&](auto i) { copy<i>(std::get<i>(m)); }, indexes{});
+    }
+
+    compact_model(model_type &&m) {
+        construct([&](auto i) { copy<i>(std::move(std::get<i>(m))); }, indexes{});
+    }
+
+    /// the values of the fields, in their declared order
+    template <class... U>
+        requires(sizeof...(U) == object_size && sizeof...(U) > 1 &&
+                 std::is_constructible_v<model_type, U...>)
+    compact_model(U &&...values) : compact_model(model_type(std::forward<U>(values)...)) {}
+
+    compact_model &operator=(const compact_model &other) {
+        if (this != &other)
+            assign(other, indexes{});
+        return *this;
+    }
+
+    compact_model &operator=(compact_model &&other) {
+        if (this != &other)
+            assign(std::move(other), indexes{});
+        return *this;
+    }
+
+    ~compact_model() { destroy(layout::count, indexes{}); }
+
+    /// the equivalent model
+    model_type to_model() const & {
+        model_type m;
+        to_model(m, *this, indexes{});
+        return m;
+    }
+
+    model_type to_model() && {
+        model_type m;
+        to_model(m, std::move(*this), indexes{});
+        return m;
+    }
+
+    template <std::size_t I> decltype(auto) get() {
+        if constexpr (optional_at<I>)
+            return compact_optional<stored_at<I>>{slot<I>(), mask_byte<I>(), mask_bit<I>()};
+        else
+            return *slot<I>();
+    }
+
+    template <std::size_t I> decltype(auto) get() const {
+        if constexpr (optional_at<I>)
+            return compact_optional<const stored_at<I>>{slot<I>(), mask_byte<I>(), mask_bit<I>()};
+        else
+            return *slot<I>();
+    }
+
+    template <meta::ct_string u> decltype(auto) get() {
+        constexpr int idx = index(u.str());
+        static_assert(idx >= 0, "compact_model: get<>() called with a non existing field name");
+        return get<idx>();
+    }
+
+    template <meta::ct_string u> decltype(auto) get() const {
+        constexpr int idx = index(u.str());
+        static_assert(idx >= 0, "compact_model: get<>() called with a non existing field name");
+        return get<idx>();
+    }
+
+    /// as model::operator[], an optional field that is not set takes its init
+    /// meta-property or is default constructed
+    template <class T> auto &operator[](T field) {
+        constexpr int idx = index(field());
+        static_assert(idx >= 0,
+                      "compact_model: operator[] called with a non existing field name");
+
+        if constexpr (optional_at<idx>) {
+            auto v = get<idx>();
+            if (v)
+                return *v;
+
+            using properties_t = std::remove_cvref_t<decltype(std::get<idx>(properties))>;
+
+            if constexpr (has_init<properties_t>::value) {
+                constexpr int prop_idx = tl::index_if<is_init, properties_t>::value;
+                using initializer = typename std::tuple_element<prop_idx, properties_t>::type;
+                return v.emplace(initializer{}.value());
+            } else
+                return v.emplace();
+        } else
+            return get<idx>();
+    }
+
+    constexpr bool has_field(const char *field) const noexcept { return index(field) >= 0; }
+
+    static constexpr const char *name() { return model_type::name(); }
+
+    static constexpr const char *description() { return model_type::description(); }
+
+    static constexpr int index(char const *field) { return model_type::index(field); }
+
+    friend bool operator==(const compact_model &a, const compact_model &b) {
+        return equal(a, b, indexes{});
+    }
+
+private:
+    template <std::size_t I> stored_at<I> *slot() {
+        return std::launder(reinterpret_cast<stored_at<I> *>(data_ + layout::offsets[I]));
+    }
+
+    template <std::size_t I> const stored_at<I> *slot() const {
+        return std::launder(reinterpret_cast<const stored_at<I> *>(data_ + layout::offsets[I]));
+    }
+
+    template <std::size_t I> unsigned char *mask_byte() {
+        return reinterpret_cast<unsigned char *>(data_ + layout::mask_offset + layout::bits[I] / 8);
+    }
+
+    template <std::size_t I> const unsigned char *mask_byte() const {
+        return reinterpret_cast<const unsigned char *>(data_ + layout::mask_offset +
+                                                       layout::bits[I] / 8);
+    }
+
+    template <std::size_t I> static constexpr unsigned char mask_bit() {
+        return static_cast<unsigned char>(1u << layout::bits[I] % 8);
+    }
+
+    // constructs field I from a value, an std::optional or a compact_optional
+    template <std::size_t I, class V> void copy(V &&v) {
+        if constexpr (optional_at<I>) {
+            if (v)
+                get<I>().emplace(*std::forward<V>(v));
+        } else
+            std::construct_at(slot<I>(), std::forward<V>(v));
+    }
+
+    // constructs the fields with make(index), which constructs field index or
+    // leaves an optional one absent; if one throws, those already constructed
+    // are destroyed
+    template <class Make, std::size_t... I>
+    void construct(Make &&make, std::index_sequence<I...>) {
+        std::memset(data_ + layout::mask_offset, 0, layout::mask_size);
+        std::size_t constructed = 0;
+        try {
+            ((make(std::integral_constant<std::size_t, I>{}), ++constructed), ...);
+        } catch (...) {
+            destroy(constructed, indexes{});
+            throw;
+        }
+    }
+
+    // destroys the first n fields
+    template <std::size_t... I> void destroy(std::size_t n, std::index_sequence<I...>) noexcept {
+        ((I < n ? destroy_field<I>() : void()), ...);
+    }
+
+    template <std::size_t I> void destroy_field() noexcept {
+        if constexpr (optional_at<I>)
+            get<I>().reset();
+        else
+            std::destroy_at(slot<I>());
+    }
+
+    template <class Other, std::size_t... I>
+    void assign(Other &&other, std::index_sequence<I...>) {
+        ((get<I>() = std::forward<Other>(other).template take_or_get<I>()), ...);
+    }
+
+    template <std::size_t I> decltype(auto) take_or_get() const & { return get<I>(); }
+
+    template <std::size_t I> decltype(auto) take_or_get() && {
+        if constexpr (optional_at<I>)
+            return std::optional<stored_at<I>>{
+                get<I>() ? std::optional<stored_at<I>>{std::move(*get<I>())} : std::nullopt};
+        else
+            return std::move(*slot<I>());
+    }
+
+    template <class Self, std::size_t... I>
+    static void to_model(model_type &m, Self &&self, std::index_sequence<I...>) {
+        ((std::get<I>(m) = std::forward<Self>(self).template take_or_get<I>()), ...);
+    }
+
+    template <std::size_t... I>
+    static bool equal(const compact_model &a, const compact_model &b, std::index_sequence<I...>) {
+        return (field_equal<I>(a, b) && ...);
+    }
+
+    template <std::size_t I> static bool field_equal(const compact_model &a, const compact_model &b) {
+        if constexpr (optional_at<I>) {
+            auto x = a.get<I>(), y = b.get<I>();
+            return x.has_value() == y.has_value() && (!x || *x == *y);
+        } else
+            return a.get<I>() == b.get<I>();
+    }
+
+    alignas(layout::alignment) std::byte data_[layout::size];
+};
+
+namespace detail {
+template <class T> struct is_compact_model : std::false_type {};
+
+template <class... N> struct is_compact_model<compact_model<N...>> : std::true_type {};
+} // namespace detail
+
+template <class T>
+constexpr bool is_compact_model_v = detail::is_compact_model<std::decay_t<T>>::value;
+
+/// field I of a model or a compact_model, through which the serializers
+/// access both: a reference, or a compact_optional for an optional field of a
+/// compact_model
+template <std::size_t I, class Model> decltype(auto) field_value(Model &m) {
+    if constexpr (is_compact_model_v<Model>)
+        return m.template get<I>();
+    else
+        return std::get<I>(m);
+}
+
+namespace detail {
+
+template <class Model, std::size_t I> auto compact_field() {
+    constexpr const char *str = Model::names[I];
+    constexpr size_t l = strlen(str);
+    constexpr meta::ct_string<l> a(str);
+    using type = std::remove_cvref_t<decltype(std::get<I>(
+        std::declval<const typename Model::model_type &>()))>;
+
+    return field_wrapper<a, type, decltype(std::get<I>(Model::properties))>(
+        std::get<I>(Model::properties));
+}
+
+template <class Model, class F, std::size_t... I>
+constexpr void for_each_compact(Model &t, F &&f, std::index_sequence<I...>) {
+    (f(compact_field<std::remove_const_t<Model>, I>(), t.template get<I>()), ...);
+}
+
+} // namespace detail
+
+template <class... N, class F> constexpr void for_each(compact_model<N...> &t, F &&f) {
+    detail::for_each_compact(t, f, std::make_index_sequence<compact_model<N...>::object_size>{});
+}
+
+template <class... N, class F> constexpr void for_each(const compact_model<N...> &t, F &&f) {
+    detail::for_each_compact(t, f, std::make_index_sequence<compact_model<N...>::object_size>{});
+}
+
+template <class... N, class F> constexpr void for_each(compact_model<N...> &&t, F &&f) {
+    detail::for_each_compact(t, f, std::make_index_sequence<compact_model<N...>::object_size>{});
+}
+
+} // namespace scymnus
+
+namespace std {
+
+template <class... N>
+class tuple_size<scymnus::compact_model<N...>>
+    : public std::integral_constant<std::size_t, scymnus::compact_model<N...>::object_size> {};
+
+} // namespace std
@@ -0,0 +1,239 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "core/compact_model.hpp"
+#include "core/model_reader.hpp"
+#include "core/named_tuple.hpp"
+#include "core/traits.hpp"
+
+namespace scymnus {
+
+// Sparse fieldsets: the fields of a response selected by a comma separated
+// list of paths, as in ?fields=id,name,address.city. The list is compiled once
+// against model::names into one bitmask per object. A path that ends at a
+// field selects it whole, a longer path selects the field and only the fields
+// of the nested object that it names; the items of vectors and optionals are
+// selected as the object itself. Paths that do not match the model are
+// ignored: the list is only read once the handler has run. The writers skip
+// the fields that are not selected without building them.
+
+namespace projection_detail {
+
+// the model of the values of T: T itself, or the items of optionals and
+// vectors, void for other types
+template <class T> constexpr auto object_of() {
+    if constexpr (is_model_v<T> || is_compact_model_v<T>)
+        return std::type_identity<T>{};
+    else if constexpr (is_optional_v<T> || is_vector_v<T>)
+        return object_of<typename T::value_type>();
+    else
+        return std::type_identity<void>{};
+}
+
+} // namespace projection_detail
+
+/// the model projected when a value of type T is written
+template <class T>
+using projected_model_t =
+    typename decltype(projection_detail::object_of<std::remove_cvref_t<T>>())::type;
+
+/// models, and vectors and optionals of models
+template <class T>
+constexpr bool is_projectable_v = !std::is_void_v<projected_model_t<T>>;
+
+class field_projection;
+
+/// the fields selected in one object of a response, every field when empty
+class field_selection {
+public:
+    field_selection() = default;
+
+    /// false when every field is selected
+    explicit operator bool() const { return projection_ != nullptr; }
+
+    inline bool contains(std::size_t field) const;
+
+    /// the number of fields selected
+    inline std::size_t size() const;
+
+    /// the selection in the object held by field, empty when the field is
+    /// selected whole
+    inline field_selection nested(std::size_t field) const;
+
+private:
+    friend class field_projection;
+
+    field_selection(const field_projection *projection, uint32_t node)
+        : projection_{projection}, node_{node} {}
+
+    const field_projection *projection_{nullptr};
+    uint32_t node_{0};
+};
+
+class field_projection {
+public:
+    /// selects every field
+    explicit field_projection(
+        std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+        : words_{resource}, nodes_{resource}, links_{resource} {}
+
+    /// compiles the paths of list against Model. Empty paths, paths naming a
+    /// field that Model does not have and paths through a field that is not
+    /// an object are ignored
+    template <class Model>
+    static field_projection
+    compile(std::string_view list,
+            std::pmr::memory_resource *resource = std::pmr::get_default_resource()) {
+        field_projection projection{resource};
+        projection.add_node(Model::object_size);
+        while (!list.empty()) {
+            auto end = list.find(',');
+            auto path = list.substr(0, end);
+            list.remove_prefix(end == std::string_view::npos ? list.size() : end + 1);
+            if (!path.empty() && known<Model>(path))
+                projection.select<Model>(0, path);
+        }
+        return projection;
+    }
+
+    /// the selection in the top level object
+    field_selection root() const {
+        if (nodes_.empty())
+            return {};
+        return {this, 0};
+    }
+
+private:
+    friend class field_selection;
+
+    // the bitmask of an object is words_[first, first + size)
+    struct node {
+        uint32_t first;
+        uint32_t size;
+    };
+
+    // the object selected by longer paths through field of parent
+    struct link {
+        uint32_t parent;
+        uint32_t field;
+        uint32_t child;
+    };
+
+    uint32_t add_node(std::size_t fields) {
+        nodes_.push_back({static_cast<uint32_t>(words_.size()),
+                          static_cast<uint32_t>((fields + 63) / 64)});
+        words_.resize(words_.size() + nodes_.back().size);
+        return static_cast<uint32_t>(nodes_.size() - 1);
+    }
+
+    bool contains(uint32_t n, std::size_t field) const {
+        return (words_[nodes_[n].first + field / 64] >> (field % 64)) & 1;
+    }
+
+    void set(uint32_t n, std::size_t field) {
+        words_[nodes_[n].first + field / 64] |= uint64_t{1} << (field % 64);
+    }
+
+    std::size_t size(uint32_t n) const {
+        std::size_t count = 0;
+        for (uint32_t w = 0; w < nodes_[n].size; ++w)
+            count += std::popcount(words_[nodes_[n].first + w]);
+        return count;
+    }
+
+    // the node of the nested selection, 0 when there is none: the root is
+    // never nested
+    uint32_t child(uint32_t n, std::size_t field) const {
+        for (auto &l : links_)
+            if (l.parent == n && l.field == field)
+                return l.child;
+        return 0;
+    }
+
+    // whether every segment of path names a field, and every field but the
+    // last one holds objects
+    template <class Model> static bool known(std::string_view path) {
+        auto dot = path.find('.');
+        int field = model_detail::perfect_hash<Model>::find(path.substr(0, dot));
+        if (field < 0)
+            return false;
+        if (dot == std::string_view::npos)
+            return true;
+
+        bool result = false;
+        with_field<Model>(field, [&]<std::size_t I>() {
+            using type = std::remove_cvref_t<decltype(field_value<I>(std::declval<Model &>()))>;
+            using nested = projected_model_t<type>;
+            if constexpr (!std::is_void_v<nested>)
+                result = known<nested>(path.substr(dot + 1));
+        });
+        return result;
+    }
+
+    // path is known<Model>
+    template <class Model> void select(uint32_t n, std::string_view path) {
+        auto dot = path.find('.');
+        int field = model_detail::perfect_hash<Model>::find(path.substr(0, dot));
+
+        // the field whole, even if longer paths named it before
+        if (dot == std::string_view::npos) {
+            set(n, field);
+            std::erase_if(links_, [&](const link &l) {
+                return l.parent == n && l.field == static_cast<uint32_t>(field);
+            });
+            return;
+        }
+
+        with_field<Model>(field, [&]<std::size_t I>() {
+            using type = std::remove_cvref_t<decltype(field_value<I>(std::declval<Model &>()))>;
+            using nested = projected_model_t<type>;
+            if constexpr (!std::is_void_v<nested>) {
+                auto c = child(n, I);
+                if (contains(n, I) && c == 0)
+                    return;
+                if (c == 0) {
+                    c = add_node(nested::object_size);
+                    links_.push_back({n, static_cast<uint32_t>(I), c});
+                    set(n, I);
+                }
+                select<nested>(c, path.substr(dot + 1));
+            }
+        });
+    }
+
+    // calls f<I>() for the field at index
+    template <class Model, class F> static void with_field(std::size_t index, F &&f) {
+        [&]<std::size_t... I>(std::index_sequence<I...>) {
+            ((index == I ? (f.template operator()<I>(), 0) : 0), ...);
+        }(std::make_index_sequence<Model::object_size>{});
+    }
+
+    std::pmr::vector<uint64_t> words_;
+    std::pmr::vector<node> nodes_;
+    std::pmr::vector<link> links_;
+};
+
+bool field_selection::contains(std::size_t field) const {
+    return !projection_ || projection_->contains(node_, field);
+}
+
+std::size_t field_selection::size() const { return projection_->size(node_); }
+
+field_selection field_selection::nested(std::size_t field) const {
+    if (!projection_)
+        return {};
+    auto c = projection_->child(node_, field);
+    if (c == 0)
+        return {};
+    return {projection_, c};
+}
+
+} // namespace scymnus
@@ -0,0 +1,417 @@
+#pragma once
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "core/exception.hpp"
+#include "core/model_reader.hpp"
+#include "core/named_tuples_utils.hpp"
+#include "external/json.hpp"
+#include "utilities/simd.hpp"
+
+namespace scymnus {
+
+// Streaming deserialization of JSON into models (see model_reader.hpp). Keys
+// and strings without escapes are copied at most once and the values of other
+// types are located without a DOM, only their text is parsed by nlohmann.
+
+class json_reader : model_reader<json_reader> {
+    friend class model_reader<json_reader>;
+
+public:
+    /// reads a document holding a T, throws sc_exception if the document is
+    /// malformed, exceeds the limits or does not match T and
+    /// validation_exception if constraints are violated
+    template <class T>
+    static T read(std::string_view document,
+                  const read_options &options = body_read_options()) {
+        if (options.max_size && document.size() > options.max_size)
+            throw sc_exception{"json: document exceeds the maximum size"};
+
+        if constexpr (!model_detail::is_streamed<T>::value) {
+            return deserializing_json<T>::parse(document).template get<T>();
+        } else {
+            // strings are copied as they are, so the document is checked at
+            // once, as nlohmann does while parsing
+            if (!utils::simd::valid_utf8(document))
+                throw sc_exception{"json: invalid UTF-8"};
+            json_reader reader{document, options};
+            auto value = reader.read_value<T>();
+            reader.skip_ws();
+            if (reader.p_ != reader.end_)
+                reader.error("unexpected data after the document");
+            return value;
+        }
+    }
+
+    /// whether document is one JSON value with valid UTF-8 strings, checked
+    /// without building anything
+    static bool accept(std::string_view document) {
+        // text that cannot start a value is rejected without an exception
+        auto first = document.find_first_not_of(" \t\r\n");
+        if (first == std::string_view::npos ||
+            std::string_view{"{[\"-0123456789tfn"}.find(document[first]) == std::string_view::npos)
+            return false;
+        // a literal is the whole document: plain text such as "not found" is
+        // the common case here
+        if (auto c = document[first]; c == 't' || c == 'f' || c == 'n') {
+            auto last = document.find_last_not_of(" \t\r\n");
+            auto literal = document.substr(first, last - first + 1);
+            return literal == "true" || literal == "false" || literal == "null";
+        }
+        if (!utils::simd::valid_utf8(document))
+            return false;
+
+        static const read_options options{.max_depth = 512};
+        json_reader reader{document, options};
+        try {
+            reader.skip_value();
+            reader.skip_ws();
+            return reader.p_ == reader.end_;
+        } catch (const sc_exception &) {
+            return false;
+        }
+    }
+
+private:
+    json_reader(std::string_view document, const read_options &options)
+        : model_reader{options}, begin_{document.data()}, p_{document.data()},
+          end_{document.data() + document.size()} {}
+
+    [[noreturn]] void error(const char *what) const {
+        throw sc_exception{"json: " + std::string{what} + " at offset " +
+                           std::to_string(p_ - begin_)};
+    }
+
+    void skip_ws() {
+        while (p_ != end_ && (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t'))
+            ++p_;
+    }
+
+    // next significant character, 0 at the end of the document
+    char peek() {
+        skip_ws();
+        return p_ != end_ ? *p_ : 0;
+    }
+
+    void expect(char c) {
+        if (peek() != c)
+            error(c == ':' ? "expected ':'" : "unexpected character");
+        ++p_;
+    }
+
+    bool literal(std::string_view word) {
+        if (static_cast<std::size_t>(end_ - p_) < word.size() ||
+            std::memcmp(p_, word.data(), word.size()) != 0)
+            return false;
+        p_ += word.size();
+        return true;
+    }
+
+    bool null() {
+        if (peek() != 'n')
+            return false;
+        if (!literal("null"))
+            error("invalid literal");
+        return true;
+    }
+
+    // the cursor of an object or an array tells whether an element was read
+    bool begin_object() {
+        expect('{');
+        return false;
+    }
+
+    bool next_key(bool &started, std::string_view &k) {
+        if (!separator(started, '}'))
+            return false;
+        if (peek() != '"')
+            error("expected a key");
+        k = key();
+        expect(':');
+        return true;
+    }
+
+    bool begin_array() {
+        expect('[');
+        return false;
+    }
+
+    bool next_element(bool &started) { return separator(started, ']'); }
+
+    // moves past the ',' before an element or the closing character
+    bool separator(bool &started, char close) {
+        auto c = peek();
+        if (c == close) {
+            ++p_;
+            return false;
+        }
+        if (started) {
+            if (c != ',')
+                error(close == '}' ? "expected ',' or '}'" : "expected ',' or ']'");
+            ++p_;
+        }
+        started = true;
+        return true;
+    }
+
+    template <class String> void string(String &out) {
+        if (peek() != '"')
+            error("expected a string");
+        quoted(out);
+    }
+
+    template <class T> T fallback() {
+        auto start = p_;
+        skip_value();
+        return deserializing_json<T>::parse(start, p_).template get<T>();
+    }
+
+    bool boolean() {
+        auto c = peek();
+        if (c == 't' && literal("true"))
+            return true;
+        if (c == 'f' && literal("false"))
+            return false;
+        error("expected a boolean");
+    }
+
+    // the extent of a number, checked against the JSON grammar
+    std::string_view number_token(bool &integral) {
+        auto start = p_;
+        auto digits = [this] {
+            auto first = p_;
+            while (p_ != end_ && *p_ >= '0' && *p_ <= '9')
+                ++p_;
+            return p_ != first;
+        };
+
+        integral = true;
+        if (p_ != end_ && *p_ == '-')
+            ++p_;
+        if (p_ != end_ && *p_ == '0')
+            ++p_;
+        else if (!digits())
+            error("expected a number");
+        if (p_ != end_ && *p_ == '.') {
+            ++p_;
+            integral = false;
+            if (!digits())
+                error("invalid number");
+        }
+        if (p_ != end_ && (*p_ == 'e' || *p_ == 'E')) {
+            ++p_;
+            integral = false;
+            if (p_ != end_ && (*p_ == '+' || *p_ == '-'))
+                ++p_;
+            if (!digits())
+                error("invalid number");
+        }
+        return {start, static_cast<std::size_t>(p_ - start)};
+    }
+
+    // as nlohmann, true and false are 1 and 0 and a fractional number
+    // assigned to an integer is truncated
+    template <class T> T number() {
+        auto c = peek();
+        if (c == 't' || c == 'f')
+            return static_cast<T>(boolean());
+
+        bool integral;
+        auto token = number_token(integral);
+        auto first = token.data(), last = token.data() + token.size();
+
+        if constexpr (std::is_integral_v<T>) {
+            if (integral) {
+                T v{};
+                auto [ptr, ec] = std::from_chars(first, last, v);
+                if (ec != std::errc{} || ptr != last)
+                    error("number out of range");
+                return v;
+            }
+        }
+
+        double d{};
+        auto [ptr, ec] = std::from_chars(first, last, d);
+        if (ec != std::errc{} || ptr != last)
+            error("number out of range");
+        if constexpr (std::is_integral_v<T>) {
+            if (!model_detail::truncates_into<T>(d))
+                error("number out of range");
+        }
+        return static_cast<T>(d);
+    }
+
+    // a key without escapes refers to the document, one with escapes is
+    // decoded into key_
+    std::string_view key() {
+        auto start = ++p_;
+        auto end = utils::simd::find_first_of({p_, static_cast<std::size_t>(end_ - p_)}, "\"\\");
+        if (end != utils::simd::npos && p_[end] == '"') {
+            std::string_view k{start, end};
+            for (char c : k)
+                if (static_cast<unsigned char>(c) < 0x20)
+                    error("control character in string");
+            p_ += end + 1;
+            return k;
+        }
+        --p_;
+        key_.clear();
+        quoted(key_);
+        return key_;
+    }
+
+    // appends the string starting at p_ (on the opening quote) to out
+    template <class String> void quoted(String &out) {
+        ++p_;
+        for (;;) {
+            auto run = p_;
+            while (p_ != end_ && *p_ != '"' && *p_ != '\\') {
+                if (static_cast<unsigned char>(*p_) < 0x20)
+                    error("control character in string");
+                ++p_;
+            }
+            out.append(run, p_);
+            if (p_ == end_)
+                error("unterminated string");
+            if (*p_++ == '"')
+                return;
+            escape(out);
+        }
+    }
+
+    template <class String> void escape(String &out) {
+        if (p_ == end_)
+            error("unterminated string");
+        switch (*p_++) {
+        case '"': out.push_back('"'); return;
+        case '\\': out.push_back('\\'); return;
+        case '/': out.push_back('/'); return;
+        case 'b': out.push_back('\b'); return;
+        case 'f': out.push_back('\f'); return;
+        case 'n': out.push_back('\n'); return;
+        case 'r': out.push_back('\r'); return;
+        case 't': out.push_back('\t'); return;
+        case 'u': break;
+        default: error("invalid escape");
+        }
+
+        uint32_t cp = code_unit();
+        if (cp >= 0xD800 && cp <= 0xDBFF) {
+            if (!literal("\\u"))
+                error("unpaired surrogate");
+            auto low = code_unit();
+            if (low < 0xDC00 || low > 0xDFFF)
+                error("unpaired surrogate");
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+        } else if (cp >= 0xDC00 && cp <= 0xDFFF)
+            error("unpaired surrogate");
+
+        if (cp < 0x80)
+            out.push_back(static_cast<char>(cp));
+        else if (cp < 0x800) {
+            out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        } else if (cp < 0x10000) {
+            out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        } else {
+            out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        }
+    }
+
+    // the four hex digits of a \u escape
+    uint32_t code_unit() {
+        if (end_ - p_ < 4)
+            error("invalid escape");
+        uint32_t cp = 0;
+        for (int i = 0; i < 4; ++i, ++p_) {
+            char c = *p_;
+            cp <<= 4;
+            if (c >= '0' && c <= '9')
+                cp |= c - '0';
+            else if (c >= 'a' && c <= 'f')
+                cp |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                cp |= c - 'A' + 10;
+            else
+                error("invalid escape");
+        }
+        return cp;
+    }
+
+    // moves past a value that is not stored, checking its syntax
+    void skip_value() {
+        switch (peek()) {
+        case '{':
+            enter();
+            ++p_;
+            if (peek() != '}')
+                for (;;) {
+                    if (peek() != '"')
+                        error("expected a key");
+                    key();
+                    expect(':');
+                    skip_value();
+                    auto c = peek();
+                    if (c == '}')
+                        break;
+                    if (c != ',')
+                        error("expected ',' or '}'");
+                    ++p_;
+                }
+            ++p_;
+            leave();
+            return;
+        case '[':
+            enter();
+            ++p_;
+            if (peek() != ']')
+                for (;;) {
+                    skip_value();
+                    auto c = peek();
+                    if (c == ']')
+                        break;
+                    if (c != ',')
+                        error("expected ',' or ']'");
+                    ++p_;
+                }
+            ++p_;
+            leave();
+            return;
+        case '"':
+            key();
+            return;
+        case 't':
+        case 'f':
+            boolean();
+            return;
+        case 'n':
+            if (!literal("null"))
+                error("invalid literal");
+            return;
+        default: {
+            bool integral;
+            number_token(integral);
+        }
+        }
+    }
+
+    const char *begin_;
+    const char *p_;
+    const char *end_;
+    // a key with escapes
+    std::string key_;
+};
+
+} // namespace scymnus
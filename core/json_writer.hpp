@@ -0,0 +1,327 @@
+#pragma once
+
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "core/exception.hpp"
+#include "core/field_projection.hpp"
+#include "core/json_reader.hpp"
+#include "core/model_writer.hpp"
+#include "core/named_tuple.hpp"
+#include "core/named_tuples_utils.hpp"
+#include "core/traits.hpp"
+#include "external/json.hpp"
+#include "utilities/simd.hpp"
+
+namespace scymnus {
+
+// Serialization of models without a DOM, the counterpart of json_reader. The
+// keys of a model are rendered at compile time as quoted and escaped literals
+// ("{\"id\":", ",\"x\":", ...) and the values are appended straight to the
+// output. The output is the same as dumping the DOM built by to_json: keys in
+// the order of a std::map, empty optionals written as their init<> value or
+// null, numbers formatted by nlohmann. Types other than models, vectors,
+// optionals, strings, numbers and enumerations are converted by nlohmann.
+
+namespace json_detail {
+
+constexpr char hex_digit(unsigned v) { return "0123456789abcdef"[v & 0xF]; }
+
+// size of s quoted and escaped as nlohmann does
+constexpr std::size_t quoted_size(std::string_view s) {
+    std::size_t size = 2;
+    for (char c : s) {
+        auto u = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\' || c == '\b' || c == '\f' || c == '\n' || c == '\r' ||
+            c == '\t')
+            size += 2;
+        else if (u < 0x20)
+            size += 6;
+        else
+            ++size;
+    }
+    return size;
+}
+
+template <std::size_t N>
+constexpr std::size_t quote(std::string_view s, std::array<char, N> &out, std::size_t i) {
+    out[i++] = '"';
+    for (char c : s) {
+        auto u = static_cast<unsigned char>(c);
+        switch (c) {
+        case '"': out[i++] = '\\'; out[i++] = '"'; continue;
+        case '\\': out[i++] = '\\'; out[i++] = '\\'; continue;
+        case '\b': out[i++] = '\\'; out[i++] = 'b'; continue;
+        case '\f': out[i++] = '\\'; out[i++] = 'f'; continue;
+        case '\n': out[i++] = '\\'; out[i++] = 'n'; continue;
+        case '\r': out[i++] = '\\'; out[i++] = 'r'; continue;
+        case '\t': out[i++] = '\\'; out[i++] = 't'; continue;
+        default: break;
+        }
+        if (u < 0x20) {
+            for (char e : {'\\', 'u', '0', '0'})
+                out[i++] = e;
+            out[i++] = hex_digit(u >> 4);
+            out[i++] = hex_digit(u);
+        } else
+            out[i++] = c;
+    }
+    out[i++] = '"';
+    return i;
+}
+
+// the keys of a model in the order of std::map, each one rendered with the
+// '{' or ',' before it and the ':' after it
+template <class Model> struct model_keys {
+    static constexpr std::size_t size = Model::object_size;
+
+    static constexpr auto order = model_detail::map_order<Model>::value;
+
+    static constexpr std::size_t text_size = [] {
+        std::size_t total = 0;
+        for (std::size_t i = 0; i < size; ++i)
+            total += quoted_size(Model::names[i]) + 2;
+        return total;
+    }();
+
+    struct rendered {
+        std::array<char, text_size> text{};
+        std::array<std::size_t, size + 1> offsets{};
+    };
+
+    static constexpr rendered keys = [] {
+        rendered r{};
+        std::size_t position = 0;
+        for (std::size_t k = 0; k < size; ++k) {
+            r.offsets[k] = position;
+            r.text[position++] = k == 0 ? '{' : ',';
+            position = quote(Model::names[order[k]], r.text, position);
+            r.text[position++] = ':';
+        }
+        r.offsets[size] = position;
+        return r;
+    }();
+
+    static constexpr std::string_view key(std::size_t k) {
+        return {keys.text.data() + keys.offsets[k], keys.offsets[k + 1] - keys.offsets[k]};
+    }
+};
+
+} // namespace json_detail
+
+/// JSON text written as is, without validation or escaping: for documents
+/// serialized beforehand by trusted code, a cache for instance. The text must
+/// stay alive until it is written
+struct raw_json {
+    std::string_view text;
+};
+
+// the binary formats convert it through a DOM
+template <class BasicJsonType> void to_json(BasicJsonType &j, const raw_json &raw) {
+    j = BasicJsonType::parse(raw.text);
+}
+
+class json_writer {
+public:
+    /// appends the JSON of value to out, throws sc_exception if a string is
+    /// not valid UTF-8
+    template <class String, class T> static void write(String &out, const T &value) {
+        json_writer::value(out, value);
+    }
+
+    /// appends the JSON of value with only the fields of selection
+    template <class String, class T>
+    static void write(String &out, const T &value, field_selection selection) {
+        json_writer::value(out, value, selection);
+    }
+
+    /// types written without nlohmann
+    template <class T>
+    static constexpr bool streamed = model_detail::is_streamed<std::remove_cvref_t<T>>::value;
+
+private:
+    template <class String, class T> static void value(String &out, const T &v) {
+        if constexpr (is_model_v<T> || is_compact_model_v<T>)
+            object(out, v, std::make_index_sequence<T::object_size>{});
+        else if constexpr (is_optional_v<T>) {
+            if (v)
+                value(out, *v);
+            else
+                out.append("null", 4);
+        } else if constexpr (is_vector_v<T>) {
+            out.push_back('[');
+            bool first = true;
+            for (const auto &item : v) {
+                if (!first)
+                    out.push_back(',');
+                first = false;
+                value(out, static_cast<const typename T::value_type &>(item));
+            }
+            out.push_back(']');
+        } else if constexpr (std::is_same_v<T, bool>) {
+            if (v)
+                out.append("true", 4);
+            else
+                out.append("false", 5);
+        } else if constexpr (std::is_integral_v<T>) {
+            char buffer[24];
+            auto end = std::to_chars(buffer, buffer + sizeof(buffer), v).ptr;
+            out.append(buffer, end);
+        } else if constexpr (std::is_floating_point_v<T>) {
+            auto d = static_cast<double>(v);
+            if (!std::isfinite(d)) {
+                out.append("null", 4);
+                return;
+            }
+            char buffer[64];
+            auto end = nlohmann::detail::to_chars(buffer, buffer + sizeof(buffer), d);
+            out.append(buffer, end);
+        } else if constexpr (is_string_v<T> || std::is_same_v<T, std::string_view>) {
+            string(out, v);
+        } else if constexpr (std::is_same_v<T, raw_json>) {
+            out.append(v.text.data(), v.text.size());
+        } else if constexpr (model_detail::is_enumeration<T>::value) {
+            value(out, v.value());
+        } else {
+            auto dump = serializing_json<T>(v).dump();
+            out.append(dump.data(), dump.size());
+        }
+    }
+
+    template <class String, class T>
+    static void value(String &out, const T &v, field_selection selection) {
+        if (!selection)
+            return value(out, v);
+        if constexpr (is_model_v<T> || is_compact_model_v<T>)
+            object(out, v, selection, std::make_index_sequence<T::object_size>{});
+        else if constexpr (is_optional_v<T>) {
+            if (v)
+                value(out, *v, selection);
+            else
+                out.append("null", 4);
+        } else if constexpr (is_vector_v<T>) {
+            out.push_back('[');
+            bool first = true;
+            for (const auto &item : v) {
+                if (!first)
+                    out.push_back(',');
+                first = false;
+                value(out, static_cast<const typename T::value_type &>(item), selection);
+            }
+            out.push_back(']');
+        } else
+            value(out, v);
+    }
+
+    template <class String, class Model, std::size_t... K>
+    static void object(String &out, const Model &m, std::index_sequence<K...>) {
+        using keys = json_detail::model_keys<Model>;
+        if constexpr (sizeof...(K) == 0) {
+            // to_json leaves the DOM of an empty model null
+            out.append("null", 4);
+        } else {
+            (field<keys::order[K]>(out, m, keys::key(K)), ...);
+            out.push_back('}');
+        }
+    }
+
+    // the rendered keys start with their separator, which depends on the
+    // fields selected before
+    template <class String, class Model, std::size_t... K>
+    static void object(String &out, const Model &m, field_selection selection,
+                       std::index_sequence<K...>) {
+        using keys = json_detail::model_keys<Model>;
+        char separator = '{';
+        (selected_field<keys::order[K]>(out, m, keys::key(K), selection, separator), ...);
+        if (separator == '{')
+            out.push_back('{');
+        out.push_back('}');
+    }
+
+    template <std::size_t I, class String, class Model>
+    static void selected_field(String &out, const Model &m, std::string_view key,
+                               field_selection selection, char &separator) {
+        if (!selection.contains(I))
+            return;
+        out.push_back(separator);
+        separator = ',';
+        field<I>(out, m, key.substr(1), selection.nested(I));
+    }
+
+    template <std::size_t I, class String, class Model>
+    static void field(String &out, const Model &m, std::string_view key,
+                      field_selection selection = {}) {
+        out.append(key.data(), key.size());
+
+        using type = std::remove_cvref_t<decltype(field_value<I>(m))>;
+        using properties = std::remove_cvref_t<decltype(std::get<I>(Model::properties))>;
+
+        if constexpr (is_optional_v<type> && has_init<properties>::value) {
+            if (!field_value<I>(m)) {
+                constexpr int idx = tl::index_if<is_init, properties>::value;
+                auto init = std::get<idx>(std::get<I>(Model::properties)).value();
+                // numbers keep their own type, as in the documentation: an
+                // int default of a double field is written 5, not 5.0
+                if constexpr (std::is_arithmetic_v<decltype(init)>)
+                    value(out, init);
+                else
+                    value(out, typename type::value_type(init));
+                return;
+            }
+        }
+        value(out, field_value<I>(m), selection);
+    }
+
+    // quoted, with the escapes of nlohmann: the short forms, \u00xx for the
+    // other control characters, and everything else as is
+    template <class String> static void string(String &out, std::string_view s) {
+        if (!utils::simd::valid_utf8(s))
+            throw sc_exception{"json: invalid UTF-8 in string"};
+
+        // the runs between the bytes to escape are appended in bulk
+        out.push_back('"');
+        std::size_t run = 0;
+        for (auto i = utils::simd::find_json_escape(s); i != utils::simd::npos;
+             i = utils::simd::find_json_escape(s, run)) {
+            out.append(s.data() + run, i - run);
+            escape(out, s[i]);
+            run = i + 1;
+        }
+        out.append(s.data() + run, s.size() - run);
+        out.push_back('"');
+    }
+
+    template <class String> static void escape(String &out, char c) {
+        char short_form = 0;
+        switch (c) {
+        case '"': short_form = '"'; break;
+        case '\\': short_form = '\\'; break;
+        case '\b': short_form = 'b'; break;
+        case '\f': short_form = 'f'; break;
+        case '\n': short_form = 'n'; break;
+        case '\r': short_form = 'r'; break;
+        case '\t': short_form = 't'; break;
+        default: break;
+        }
+        if (short_form) {
+            char text[2] = {'\\', short_form};
+            out.append(text, 2);
+        } else {
+            auto u = static_cast<unsigned char>(c);
+            char text[6] = {'\\', 'u', '0', '0', json_detail::hex_digit(u >> 4),
+                              json_detail::hex_digit(u)};
+            out.append(text, 6);
+        }
+    }
+};
+
+} // namespace scymnus
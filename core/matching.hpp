@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string_view>
+
+#include "meta/ct_string.hpp"
+#include "utilities/regex_dfa.hpp"
+
+namespace scymnus {
+
+/// path parameter constrained by a regular expression matching the whole
+/// segment, e.g. path_param<"sku", matching<"[A-Z]{3}-\\d+">>. The value
+/// refers to the request path
+template <meta::ct_string Pattern> struct matching {
+    static constexpr std::string_view pattern{Pattern.str(), Pattern.size()};
+
+    static_assert(pattern.find('/') == std::string_view::npos,
+                  "a path segment pattern cannot contain '/'");
+
+    /// the automaton of the pattern, compiled on first use
+    static const utils::regex_dfa &dfa() {
+        static const utils::regex_dfa compiled{pattern};
+        return compiled;
+    }
+
+    std::string_view value;
+
+    operator std::string_view() const { return value; }
+};
+
+} // namespace scymnus
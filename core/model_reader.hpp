@@ -0,0 +1,416 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "core/compact_model.hpp"
+#include "core/enumeration.hpp"
+#include "core/exception.hpp"
+#include "core/named_tuple.hpp"
+#include "core/request_json.hpp"
+#include "core/traits.hpp"
+#include "core/validator.hpp"
+
+namespace scymnus {
+
+// Streaming deserialization of documents into models, shared by the JSON,
+// MessagePack and CBOR readers. A document is read once, from left to right,
+// and every value is written straight into its field: keys are resolved to
+// field indexes with a perfect hash computed at compile time from
+// model::names and no DOM is built. Nested models, vectors and optionals are
+// read the same way, other types are delegated to nlohmann (the value is
+// located without building a DOM and only that part is parsed). Fields are
+// filled as from_json of named_tuples_utils does: missing required fields are
+// errors, missing optional fields take their init<> value and unknown keys are
+// skipped.
+//
+// The constraints of each field (see validator.hpp) are checked as soon as its
+// value is read. Violations are recorded with the path of the field and
+// thrown as one validation_exception once the document is read, or when the
+// first one is found in validation_mode::first_error. Malformed documents
+// throw sc_exception right away.
+
+/// limits of a document, 0 disables a limit, and how its constraints are
+/// reported
+struct read_options {
+    // nesting of maps and arrays
+    std::size_t max_depth{64};
+    // size of the document in bytes
+    std::size_t max_size{0};
+    validation_mode validation{validation_mode::first_error};
+};
+
+/// the options used for the bodies of body_param, set through app
+inline read_options &body_read_options() {
+    static read_options options;
+    return options;
+}
+
+namespace model_detail {
+
+// FNV-1a
+constexpr uint32_t hash(std::string_view s, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (char c : s) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// a power of two number of slots and a seed for which the names do not
+// collide, the table grows when a few seeds fail
+template <class Model> struct perfect_hash {
+    static constexpr std::size_t size = Model::object_size;
+
+    struct parameters {
+        std::size_t slots;
+        uint32_t seed;
+    };
+
+    static constexpr parameters search() {
+        std::size_t slots = 1;
+        while (slots < 2 * size)
+            slots <<= 1;
+        for (;; slots <<= 1)
+            for (uint32_t seed = 0; seed < 64; ++seed) {
+                bool collision = false;
+                for (std::size_t i = 0; i < size && !collision; ++i)
+                    for (std::size_t j = i + 1; j < size && !collision; ++j)
+                        collision = (hash(Model::names[i], seed) & (slots - 1)) ==
+                                    (hash(Model::names[j], seed) & (slots - 1));
+                if (!collision)
+                    return {slots, seed};
+            }
+    }
+
+    static constexpr parameters params = search();
+
+    static constexpr auto build() {
+        std::array<int16_t, params.slots> table{};
+        for (auto &slot : table)
+            slot = -1;
+        for (std::size_t i = 0; i < size; ++i)
+            table[hash(Model::names[i], params.seed) & (params.slots - 1)] =
+                static_cast<int16_t>(i);
+        return table;
+    }
+
+    static constexpr auto table = build();
+
+    static constexpr auto keys = [] {
+        std::array<std::string_view, size> keys{};
+        for (std::size_t i = 0; i < size; ++i)
+            keys[i] = Model::names[i];
+        return keys;
+    }();
+
+    /// index of the field named key, or -1
+    static int find(std::string_view key) {
+        int i = table[hash(key, params.seed) & (params.slots - 1)];
+        if (i < 0 || key != keys[i])
+            return -1;
+        return i;
+    }
+};
+
+template <class T> struct is_enumeration : std::false_type {};
+
+template <class T, class... sl>
+struct is_enumeration<enumeration<T, sl...>> : std::true_type {};
+
+// types that are read and written without nlohmann
+template <class T> struct is_streamed {
+    static constexpr bool value = is_model_v<T> || is_compact_model_v<T> ||
+                                  std::is_arithmetic_v<T> ||
+                                  is_string_v<T> ||
+                                  is_enumeration<T>::value;
+};
+
+template <class T> struct is_streamed<std::optional<T>> : is_streamed<T> {};
+
+template <class T, class A> struct is_streamed<std::vector<T, A>> : is_streamed<T> {};
+
+// the value of the sizeof(U) bytes at p, most significant first
+template <class U> U load_big_endian(const char *p) {
+    using bits = std::conditional_t<sizeof(U) == 8, uint64_t,
+                                    std::conditional_t<sizeof(U) == 4, uint32_t,
+                                                       std::conditional_t<sizeof(U) == 2,
+                                                                          uint16_t, uint8_t>>>;
+    bits v = 0;
+    for (std::size_t i = 0; i < sizeof(U); ++i)
+        v = static_cast<bits>((v << 8) | static_cast<unsigned char>(p[i]));
+    return std::bit_cast<U>(v);
+}
+
+// whether the integer T holds the truncated value of d. The bounds are powers
+// of two, exact as floating point numbers where max() is not: the truncated
+// value must be in [lowest, 2^digits)
+template <class T, class U> bool truncates_into(U d) {
+    auto whole = std::trunc(d);
+    auto bound = std::ldexp(U{1}, std::numeric_limits<T>::digits);
+    auto lowest = std::is_signed_v<T> ? -bound : U{0};
+    return whole >= lowest && whole < bound;
+}
+
+} // namespace model_detail
+
+// The constraint violations found while a document is read, each with the
+// path of the value that holds it. Shared by model_reader and wire_reader.
+class constraint_report {
+protected:
+    explicit constraint_report(const read_options &options) : options_{options} {}
+
+    // the constraints of a field on its value, a field that is an empty
+    // optional only fails when it is required
+    template <class Properties, class T>
+    void check(const Properties &properties, const T &value) {
+        if constexpr (is_optional_v<T>) {
+            if (!value) {
+                if constexpr (is_required_v<Properties>)
+                    violate("missing required field");
+                return;
+            }
+            check(properties, *value);
+        } else if (!check_constraints(properties, value))
+            constraint_violations(properties, value);
+    }
+
+    [[noreturn]] void throw_violations() {
+        std::vector<std::string> messages;
+        for (auto &v : errors_)
+            messages.push_back((v.path.empty() ? "body" : v.path) + ": " + v.reason);
+        throw validation_exception{std::move(messages)};
+    }
+
+    void violate(std::string reason) {
+        errors_.push_back({{}, std::move(reason)});
+        if (options_.validation == validation_mode::first_error)
+            stop_ = true;
+    }
+
+    // prefixes the paths of the violations found since first with a field
+    // name or an array index
+    void prefix(std::size_t first, std::string_view segment, bool index) {
+        for (auto i = first; i < errors_.size(); ++i) {
+            auto &path = errors_[i].path;
+            auto separator = path.empty() || path.front() == '[' ? "" : ".";
+            if (index)
+                path.insert(0, "[" + std::string{segment} + "]" + separator);
+            else
+                path.insert(0, std::string{segment} + separator);
+        }
+    }
+
+    const read_options &options_;
+
+    // a constraint violation, path is relative to the value being read
+    struct violation {
+        std::string path;
+        std::string reason;
+    };
+
+    std::vector<violation> errors_;
+    // set by the first violation in validation_mode::first_error
+    bool stop_{false};
+
+private:
+    template <class Properties, class T>
+    void constraint_violations(const Properties &properties, const T &value) {
+        std::vector<std::string> reasons;
+        check_constraints(properties, value, &reasons);
+        for (auto &reason : reasons) {
+            violate(std::move(reason));
+            if (stop_)
+                return;
+        }
+    }
+};
+
+// The structure of models, vectors and optionals, the validation and the
+// reporting of violations. Format reads the tokens:
+//   bool null()                      consumes a null, if the next value is one
+//   bool boolean()
+//   T number<T>()                    of an arithmetic type
+//   void string(String &)            appends a string, std::string or pmr
+//   cursor begin_object()            and next_key(cursor &, std::string_view &)
+//   cursor begin_array()             and next_element(cursor &)
+//   void skip_value()
+//   T fallback<T>()                  a value of a type read by nlohmann
+//   void error(const char *)         throws sc_exception
+template <class Format> class model_reader : protected constraint_report {
+protected:
+    explicit model_reader(const read_options &options) : constraint_report{options} {}
+
+    Format &format() { return static_cast<Format &>(*this); }
+
+    // the document holding a T, then the violations if any
+    template <class T> T read_value() {
+        auto v = make_request_value<T>();
+        value(v);
+        if (!errors_.empty())
+            throw_violations();
+        return v;
+    }
+
+    void enter() {
+        if (++depth_ > options_.max_depth && options_.max_depth)
+            format().error("maximum depth exceeded");
+    }
+
+    void leave() { --depth_; }
+
+    // a number decoded by a binary format, stored in a T as nlohmann does: a
+    // fractional number is truncated, out of range values are errors
+    template <class T, class U> T narrow(U v) {
+        if constexpr (std::is_integral_v<T> && std::is_integral_v<U>) {
+            if (!std::in_range<T>(v))
+                format().error("number out of range");
+        } else if constexpr (std::is_integral_v<T>) {
+            if (!model_detail::truncates_into<T>(v))
+                format().error("number out of range");
+        }
+        return static_cast<T>(v);
+    }
+
+    template <class T> void value(T &v) {
+        if constexpr (is_model_v<T> || is_compact_model_v<T>)
+            object(v);
+        else if constexpr (is_optional_v<T>) {
+            using type = typename T::value_type;
+            if (format().null())
+                v.reset();
+            else if constexpr (std::uses_allocator_v<type, std::pmr::polymorphic_allocator<>>)
+                value(v.emplace(make_request_value<type>()));
+            else
+                value(v.emplace());
+        } else if constexpr (is_vector_v<T>)
+            array(v);
+        else if constexpr (std::is_same_v<T, bool>)
+            v = format().boolean();
+        else if constexpr (std::is_arithmetic_v<T>)
+            v = format().template number<T>();
+        else if constexpr (is_string_v<T>) {
+            v.clear();
+            format().string(v);
+        } else if constexpr (model_detail::is_enumeration<T>::value) {
+            std::remove_cvref_t<decltype(v.value())> underlying{};
+            value(underlying);
+            v = T{std::move(underlying)};
+        } else
+            v = format().template fallback<T>();
+    }
+
+private:
+    template <class Model> void object(Model &m) {
+        using hash = model_detail::perfect_hash<Model>;
+        constexpr auto size = Model::object_size;
+
+        enter();
+        auto cursor = format().begin_object();
+        std::array<bool, size> seen{};
+
+        std::string_view key;
+        while (format().next_key(cursor, key)) {
+            auto i = hash::find(key);
+            if (i < 0) {
+                format().skip_value();
+                continue;
+            }
+
+            auto first = errors_.size();
+            field(m, i, std::make_index_sequence<size>{});
+            seen[i] = true;
+            if (errors_.size() != first) {
+                prefix(first, Model::names[i], false);
+                if (stop_)
+                    return;
+            }
+        }
+        leave();
+
+        defaults(m, seen, std::make_index_sequence<size>{});
+    }
+
+    template <class Model, std::size_t... I>
+    void field(Model &m, int i, std::index_sequence<I...>) {
+        ((i == static_cast<int>(I) ? (field<I>(m), true) : false) || ...);
+    }
+
+    template <std::size_t I, class Model> void field(Model &m) {
+        // a reference, or the compact_optional of a compact_model
+        decltype(auto) v = field_value<I>(m);
+        value(v);
+        validate<I>(m);
+    }
+
+    template <class T, class A> void array(std::vector<T, A> &v) {
+        enter();
+        auto cursor = format().begin_array();
+        v.clear();
+
+        while (format().next_element(cursor)) {
+            // the elements of std::vector<bool> are not addressable
+            if constexpr (std::is_same_v<T, bool>)
+                v.push_back(format().boolean());
+            else {
+                auto first = errors_.size();
+                value(v.emplace_back());
+                if (errors_.size() != first) {
+                    prefix(first, std::to_string(v.size() - 1), true);
+                    if (stop_)
+                        return;
+                }
+            }
+        }
+        leave();
+    }
+
+    // the constraints of field I, on the value just read
+    template <std::size_t I, class Model> void validate(const Model &m) {
+        if (!stop_)
+            check(std::get<I>(Model::properties), field_value<I>(m));
+    }
+
+    template <class Model, std::size_t... I>
+    void defaults(Model &m, const std::array<bool, sizeof...(I)> &seen,
+                  std::index_sequence<I...>) {
+        (default_field<I>(m, seen[I]), ...);
+    }
+
+    // a field left out of the document
+    template <std::size_t I, class Model> void default_field(Model &m, bool seen) {
+        if (seen || stop_)
+            return;
+
+        using type = std::remove_cvref_t<decltype(field_value<I>(m))>;
+        using properties = std::remove_cvref_t<decltype(std::get<I>(Model::properties))>;
+
+        if constexpr (is_optional_v<type> && !is_required_v<properties>) {
+            if constexpr (has_init<properties>::value) {
+                constexpr int idx = tl::index_if<is_init, properties>::value;
+                assign_request_value(field_value<I>(m),
+                                     std::get<idx>(std::get<I>(Model::properties)).value());
+            }
+        } else {
+            auto first = errors_.size();
+            violate("missing field");
+            prefix(first, Model::names[I], false);
+        }
+    }
+
+    std::size_t depth_{0};
+};
+
+} // namespace scymnus
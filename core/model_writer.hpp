@@ -0,0 +1,215 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "core/field_projection.hpp"
+#include "core/model_reader.hpp"
+#include "core/named_tuple.hpp"
+#include "core/request_json.hpp"
+#include "core/traits.hpp"
+#include "external/json.hpp"
+
+namespace scymnus {
+
+// Serialization of models into the binary formats (MessagePack, CBOR) without
+// a DOM. The keys of a model are encoded at compile time, with their string
+// headers, and the values are appended straight to the output. As with
+// json_writer, the output is the one nlohmann produces from the DOM built by
+// to_json: keys in the order of a std::map, the smallest encoding of every
+// integer, floats that are exact as single precision written as such.
+
+namespace model_detail {
+
+// the fields of a model in the order of the keys of a std::map
+template <class Model> struct map_order {
+    static constexpr std::size_t size = Model::object_size;
+
+    static constexpr auto value = [] {
+        std::array<std::size_t, size> order{};
+        for (std::size_t i = 0; i < size; ++i) {
+            std::size_t j = i;
+            for (; j > 0 && std::string_view{Model::names[i]} <
+                                std::string_view{Model::names[order[j - 1]]};
+                 --j)
+                order[j] = order[j - 1];
+            order[j] = i;
+        }
+        return order;
+    }();
+};
+
+template <class U, class String> void append_big_endian(String &out, U value) {
+    using bits = std::conditional_t<sizeof(U) == 8, uint64_t,
+                                    std::conditional_t<sizeof(U) == 4, uint32_t,
+                                                       std::conditional_t<sizeof(U) == 2,
+                                                                          uint16_t, uint8_t>>>;
+    auto v = std::bit_cast<bits>(value);
+    char bytes[sizeof(U)];
+    for (std::size_t i = 0; i < sizeof(U); ++i)
+        bytes[i] = static_cast<char>(v >> (8 * (sizeof(U) - 1 - i)));
+    out.append(bytes, sizeof(U));
+}
+
+// the keys of a model in map_order, each one encoded as a string by Format
+template <class Format, class Model> struct encoded_keys {
+    static constexpr std::size_t size = Model::object_size;
+
+    static constexpr std::size_t text_size = [] {
+        std::size_t total = 0;
+        for (std::size_t i = 0; i < size; ++i) {
+            std::string_view name = Model::names[i];
+            total += Format::string_head_size(name.size()) + name.size();
+        }
+        return total;
+    }();
+
+    struct encoded {
+        std::array<char, text_size> text{};
+        std::array<std::size_t, size + 1> offsets{};
+    };
+
+    static constexpr encoded keys = [] {
+        encoded e{};
+        std::size_t position = 0;
+        for (std::size_t k = 0; k < size; ++k) {
+            std::string_view name = Model::names[map_order<Model>::value[k]];
+            e.offsets[k] = position;
+            position = Format::string_head(name.size(), e.text, position);
+            for (char c : name)
+                e.text[position++] = c;
+        }
+        e.offsets[size] = position;
+        return e;
+    }();
+
+    static constexpr std::string_view key(std::size_t k) {
+        return {keys.text.data() + keys.offsets[k], keys.offsets[k + 1] - keys.offsets[k]};
+    }
+};
+
+} // namespace model_detail
+
+// Format writes the items:
+//   null(out), boolean(out, b), integer(out, v), floating(out, d)
+//   string(out, s), array(out, size), map(out, size)   the heads of containers
+//   fallback(out, json)                                 a value built by nlohmann
+//   constexpr string_head_size(n), string_head(n, text, position)
+template <class Format> class model_writer {
+public:
+    /// appends the encoding of value to out
+    template <class String, class T> static void write(String &out, const T &value) {
+        model_writer::value(out, value);
+    }
+
+    /// appends the encoding of value with only the fields of selection
+    template <class String, class T>
+    static void write(String &out, const T &value, field_selection selection) {
+        model_writer::value(out, value, selection);
+    }
+
+    /// types written without nlohmann
+    template <class T>
+    static constexpr bool streamed = model_detail::is_streamed<std::remove_cvref_t<T>>::value;
+
+private:
+    template <class String, class T> static void value(String &out, const T &v) {
+        if constexpr (is_model_v<T> || is_compact_model_v<T>)
+            object(out, v, std::make_index_sequence<T::object_size>{});
+        else if constexpr (is_optional_v<T>) {
+            if (v)
+                value(out, *v);
+            else
+                Format::null(out);
+        } else if constexpr (is_vector_v<T>) {
+            Format::array(out, v.size());
+            for (const auto &item : v)
+                value(out, static_cast<const typename T::value_type &>(item));
+        } else if constexpr (std::is_same_v<T, bool>)
+            Format::boolean(out, v);
+        else if constexpr (std::is_integral_v<T>)
+            Format::integer(out, v);
+        else if constexpr (std::is_floating_point_v<T>)
+            Format::floating(out, static_cast<double>(v));
+        else if constexpr (is_string_v<T>)
+            Format::string(out, v);
+        else if constexpr (model_detail::is_enumeration<T>::value)
+            value(out, v.value());
+        else
+            Format::fallback(out, serializing_json<T>(v));
+    }
+
+    template <class String, class T>
+    static void value(String &out, const T &v, field_selection selection) {
+        if (!selection)
+            return value(out, v);
+        if constexpr (is_model_v<T> || is_compact_model_v<T>)
+            object(out, v, selection, std::make_index_sequence<T::object_size>{});
+        else if constexpr (is_optional_v<T>) {
+            if (v)
+                value(out, *v, selection);
+            else
+                Format::null(out);
+        } else if constexpr (is_vector_v<T>) {
+            Format::array(out, v.size());
+            for (const auto &item : v)
+                value(out, static_cast<const typename T::value_type &>(item), selection);
+        } else
+            value(out, v);
+    }
+
+    template <class String, class Model, std::size_t... K>
+    static void object(String &out, const Model &m, std::index_sequence<K...>) {
+        using keys = model_detail::encoded_keys<Format, Model>;
+        if constexpr (sizeof...(K) == 0) {
+            // to_json leaves the DOM of an empty model null
+            Format::null(out);
+        } else {
+            Format::map(out, sizeof...(K));
+            (field<model_detail::map_order<Model>::value[K]>(out, m, keys::key(K)), ...);
+        }
+    }
+
+    template <class String, class Model, std::size_t... K>
+    static void object(String &out, const Model &m, field_selection selection,
+                       std::index_sequence<K...>) {
+        using keys = model_detail::encoded_keys<Format, Model>;
+        Format::map(out, selection.size());
+        constexpr auto &order = model_detail::map_order<Model>::value;
+        ((selection.contains(order[K])
+              ? field<order[K]>(out, m, keys::key(K), selection.nested(order[K]))
+              : void()),
+         ...);
+    }
+
+    template <std::size_t I, class String, class Model>
+    static void field(String &out, const Model &m, std::string_view key,
+                      field_selection selection = {}) {
+        out.append(key.data(), key.size());
+
+        using type = std::remove_cvref_t<decltype(field_value<I>(m))>;
+        using properties = std::remove_cvref_t<decltype(std::get<I>(Model::properties))>;
+
+        if constexpr (is_optional_v<type> && has_init<properties>::value) {
+            if (!field_value<I>(m)) {
+                constexpr int idx = tl::index_if<is_init, properties>::value;
+                auto init = std::get<idx>(std::get<I>(Model::properties)).value();
+                // numbers keep their own type, as in the documentation: an
+                // int default of a double field is written 5, not 5.0
+                if constexpr (std::is_arithmetic_v<decltype(init)>)
+                    value(out, init);
+                else
+                    value(out, typename type::value_type(init));
+                return;
+            }
+        }
+        value(out, field_value<I>(m), selection);
+    }
+};
+
+} // namespace scymnus
@@ -0,0 +1,376 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "core/exception.hpp"
+#include "core/model_reader.hpp"
+#include "core/model_writer.hpp"
+#include "external/json.hpp"
+#include "utilities/simd.hpp"
+
+namespace scymnus {
+
+// MessagePack (application/msgpack) bodies, read into and written from models
+// without a DOM (see model_reader.hpp and model_writer.hpp). Keys are read in
+// place, other types are decoded and encoded by nlohmann.
+
+class msgpack_reader : model_reader<msgpack_reader> {
+    friend class model_reader<msgpack_reader>;
+
+public:
+    /// reads a document holding a T, throws sc_exception if the document is
+    /// malformed, exceeds the limits or does not match T and
+    /// validation_exception if constraints are violated
+    template <class T>
+    static T read(std::string_view document,
+                  const read_options &options = body_read_options()) {
+        if (options.max_size && document.size() > options.max_size)
+            throw sc_exception{"msgpack: document exceeds the maximum size"};
+
+        if constexpr (!model_detail::is_streamed<T>::value) {
+            return deserializing_json<T>::from_msgpack(document.begin(), document.end())
+                .template get<T>();
+        } else {
+            msgpack_reader reader{document, options};
+            auto value = reader.read_value<T>();
+            if (reader.p_ != reader.end_)
+                reader.error("unexpected data after the document");
+            return value;
+        }
+    }
+
+private:
+    msgpack_reader(std::string_view document, const read_options &options)
+        : model_reader{options}, begin_{document.data()}, p_{document.data()},
+          end_{document.data() + document.size()} {}
+
+    [[noreturn]] void error(const char *what) const {
+        throw sc_exception{"msgpack: " + std::string{what} + " at offset " +
+                           std::to_string(p_ - begin_)};
+    }
+
+    void need(uint64_t n) {
+        if (static_cast<uint64_t>(end_ - p_) < n)
+            error("unexpected end of document");
+    }
+
+    void skip(uint64_t n) {
+        need(n);
+        p_ += n;
+    }
+
+    // the type byte of the next value
+    unsigned char peek() {
+        need(1);
+        return static_cast<unsigned char>(*p_);
+    }
+
+    template <class U> U load() {
+        need(sizeof(U));
+        auto v = model_detail::load_big_endian<U>(p_);
+        p_ += sizeof(U);
+        return v;
+    }
+
+    bool null() {
+        if (peek() != 0xC0)
+            return false;
+        ++p_;
+        return true;
+    }
+
+    bool boolean() {
+        auto b = peek();
+        if (b != 0xC2 && b != 0xC3)
+            error("expected a boolean");
+        ++p_;
+        return b == 0xC3;
+    }
+
+    // as in JSON, true and false are 1 and 0
+    template <class T> T number() {
+        auto b = peek();
+        // positive and negative fixint
+        if (b <= 0x7F || b >= 0xE0) {
+            ++p_;
+            return narrow<T>(int{static_cast<int8_t>(b)});
+        }
+        switch (b) {
+        case 0xC2:
+        case 0xC3: return static_cast<T>(boolean());
+        case 0xCA: ++p_; return narrow<T>(load<float>());
+        case 0xCB: ++p_; return narrow<T>(load<double>());
+        case 0xCC: ++p_; return narrow<T>(load<uint8_t>());
+        case 0xCD: ++p_; return narrow<T>(load<uint16_t>());
+        case 0xCE: ++p_; return narrow<T>(load<uint32_t>());
+        case 0xCF: ++p_; return narrow<T>(load<uint64_t>());
+        case 0xD0: ++p_; return narrow<T>(load<int8_t>());
+        case 0xD1: ++p_; return narrow<T>(load<int16_t>());
+        case 0xD2: ++p_; return narrow<T>(load<int32_t>());
+        case 0xD3: ++p_; return narrow<T>(load<int64_t>());
+        default: error("expected a number");
+        }
+    }
+
+    // the size of the string whose head is next
+    uint64_t string_size(const char *what) {
+        auto b = peek();
+        if (b >= 0xA0 && b <= 0xBF) {
+            ++p_;
+            return b & 0x1F;
+        }
+        switch (b) {
+        case 0xD9: ++p_; return load<uint8_t>();
+        case 0xDA: ++p_; return load<uint16_t>();
+        case 0xDB: ++p_; return load<uint32_t>();
+        default: error(what);
+        }
+    }
+
+    template <class String> void string(String &out) {
+        auto n = string_size("expected a string");
+        need(n);
+        utf8(n);
+        out.append(p_, n);
+        p_ += n;
+    }
+
+    // the n bytes of a string at p_, which are stored as they are
+    void utf8(uint64_t n) {
+        if (!utils::simd::valid_utf8({p_, static_cast<std::size_t>(n)}))
+            error("invalid UTF-8 in string");
+    }
+
+    std::string_view key() {
+        auto n = string_size("expected a key");
+        need(n);
+        std::string_view k{p_, static_cast<std::size_t>(n)};
+        p_ += n;
+        return k;
+    }
+
+    // the cursor of a map or an array is the number of elements left
+    uint64_t begin_object() {
+        auto b = peek();
+        if (b >= 0x80 && b <= 0x8F) {
+            ++p_;
+            return b & 0x0F;
+        }
+        switch (b) {
+        case 0xDE: ++p_; return load<uint16_t>();
+        case 0xDF: ++p_; return load<uint32_t>();
+        default: error("expected a map");
+        }
+    }
+
+    bool next_key(uint64_t &left, std::string_view &k) {
+        if (!next_element(left))
+            return false;
+        k = key();
+        return true;
+    }
+
+    uint64_t begin_array() {
+        auto b = peek();
+        if (b >= 0x90 && b <= 0x9F) {
+            ++p_;
+            return b & 0x0F;
+        }
+        switch (b) {
+        case 0xDC: ++p_; return load<uint16_t>();
+        case 0xDD: ++p_; return load<uint32_t>();
+        default: error("expected an array");
+        }
+    }
+
+    bool next_element(uint64_t &left) {
+        if (!left)
+            return false;
+        --left;
+        return true;
+    }
+
+    template <class T> T fallback() {
+        auto start = p_;
+        skip_value();
+        return deserializing_json<T>::from_msgpack(start, p_).template get<T>();
+    }
+
+    // moves past a value that is not stored
+    void skip_value() {
+        auto b = peek();
+        if (b <= 0x7F || b >= 0xE0 || b == 0xC0 || b == 0xC2 || b == 0xC3) {
+            ++p_;
+            return;
+        }
+        if ((b >= 0x80 && b <= 0x8F) || b == 0xDE || b == 0xDF) {
+            enter();
+            for (auto n = begin_object(); n; --n) {
+                skip_value();
+                skip_value();
+            }
+            leave();
+            return;
+        }
+        if ((b >= 0x90 && b <= 0x9F) || b == 0xDC || b == 0xDD) {
+            enter();
+            for (auto n = begin_array(); n; --n)
+                skip_value();
+            leave();
+            return;
+        }
+        if ((b >= 0xA0 && b <= 0xBF) || (b >= 0xD9 && b <= 0xDB)) {
+            skip(string_size("expected a string"));
+            return;
+        }
+
+        ++p_;
+        switch (b) {
+        // bin
+        case 0xC4: skip(load<uint8_t>()); return;
+        case 0xC5: skip(load<uint16_t>()); return;
+        case 0xC6: skip(load<uint32_t>()); return;
+        // ext, the data and its type
+        case 0xC7: skip(uint64_t{load<uint8_t>()} + 1); return;
+        case 0xC8: skip(uint64_t{load<uint16_t>()} + 1); return;
+        case 0xC9: skip(uint64_t{load<uint32_t>()} + 1); return;
+        case 0xD4: skip(2); return;
+        case 0xD5: skip(3); return;
+        case 0xD6: skip(5); return;
+        case 0xD7: skip(9); return;
+        case 0xD8: skip(17); return;
+        // numbers
+        case 0xCC:
+        case 0xD0: skip(1); return;
+        case 0xCD:
+        case 0xD1: skip(2); return;
+        case 0xCA:
+        case 0xCE:
+        case 0xD2: skip(4); return;
+        case 0xCB:
+        case 0xCF:
+        case 0xD3: skip(8); return;
+        default: --p_; error("invalid type");
+        }
+    }
+
+    const char *begin_;
+    const char *p_;
+    const char *end_;
+};
+
+// the encoding of the items written by model_writer, as nlohmann::to_msgpack
+struct msgpack_encoding {
+    template <class String> static void null(String &out) { out.push_back('\xC0'); }
+
+    template <class String> static void boolean(String &out, bool b) {
+        out.push_back(b ? '\xC3' : '\xC2');
+    }
+
+    template <class String, class T> static void integer(String &out, T v) {
+        if constexpr (std::is_signed_v<T>) {
+            if (v < 0) {
+                negative(out, v);
+                return;
+            }
+        }
+        uint64_t u = static_cast<uint64_t>(v);
+        if (u < 128)
+            out.push_back(static_cast<char>(u));
+        else if (u <= 0xFF)
+            tagged(out, '\xCC', static_cast<uint8_t>(u));
+        else if (u <= 0xFFFF)
+            tagged(out, '\xCD', static_cast<uint16_t>(u));
+        else if (u <= 0xFFFFFFFF)
+            tagged(out, '\xCE', static_cast<uint32_t>(u));
+        else
+            tagged(out, '\xCF', u);
+    }
+
+    // float 32 when the value is exact in single precision
+    template <class String> static void floating(String &out, double d) {
+        if (d >= static_cast<double>(std::numeric_limits<float>::lowest()) &&
+            d <= static_cast<double>(std::numeric_limits<float>::max()) &&
+            static_cast<double>(static_cast<float>(d)) == d)
+            tagged(out, '\xCA', static_cast<float>(d));
+        else
+            tagged(out, '\xCB', d);
+    }
+
+    template <class String> static void string(String &out, std::string_view s) {
+        std::array<char, 5> head{};
+        out.append(head.data(), string_head(s.size(), head, 0));
+        out.append(s.data(), s.size());
+    }
+
+    template <class String> static void array(String &out, std::size_t n) {
+        if (n <= 15)
+            out.push_back(static_cast<char>(0x90 | n));
+        else if (n <= 0xFFFF)
+            tagged(out, '\xDC', static_cast<uint16_t>(n));
+        else
+            tagged(out, '\xDD', static_cast<uint32_t>(n));
+    }
+
+    template <class String> static void map(String &out, std::size_t n) {
+        if (n <= 15)
+            out.push_back(static_cast<char>(0x80 | n));
+        else if (n <= 0xFFFF)
+            tagged(out, '\xDE', static_cast<uint16_t>(n));
+        else
+            tagged(out, '\xDF', static_cast<uint32_t>(n));
+    }
+
+    template <class String, class Json> static void fallback(String &out, const Json &j) {
+        auto bytes = Json::to_msgpack(j);
+        out.append(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+    }
+
+    static constexpr std::size_t string_head_size(std::size_t n) {
+        return n <= 31 ? 1 : n <= 0xFF ? 2 : n <= 0xFFFF ? 3 : 5;
+    }
+
+    template <std::size_t N>
+    static constexpr std::size_t string_head(std::size_t n, std::array<char, N> &text,
+                                             std::size_t i) {
+        auto size = string_head_size(n);
+        if (size == 1) {
+            text[i] = static_cast<char>(0xA0 | n);
+            return i + 1;
+        }
+        text[i] = size == 2 ? '\xD9' : size == 3 ? '\xDA' : '\xDB';
+        for (std::size_t k = 1; k < size; ++k)
+            text[i + k] = static_cast<char>(n >> (8 * (size - 1 - k)));
+        return i + size;
+    }
+
+private:
+    template <class String> static void negative(String &out, int64_t v) {
+        if (v >= -32)
+            out.push_back(static_cast<char>(v));
+        else if (v >= std::numeric_limits<int8_t>::min())
+            tagged(out, '\xD0', static_cast<int8_t>(v));
+        else if (v >= std::numeric_limits<int16_t>::min())
+            tagged(out, '\xD1', static_cast<int16_t>(v));
+        else if (v >= std::numeric_limits<int32_t>::min())
+            tagged(out, '\xD2', static_cast<int32_t>(v));
+        else
+            tagged(out, '\xD3', v);
+    }
+
+    // a type byte followed by a big endian value
+    template <class String, class U> static void tagged(String &out, char type, U v) {
+        out.push_back(type);
+        model_detail::append_big_endian(out, v);
+    }
+};
+
+using msgpack_writer = model_writer<msgpack_encoding>;
+
+} // namespace scymnus
@@ -4,6 +4,7 @@
 #include <cstring>
 #include <functional>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <tuple>
 #include <type_traits>
@@ -330,6 +331,15 @@ template <class... A> struct is_model<model<A...>> {
 };
 } // namespace detail
 
+namespace detail {
+// whether one of the types of a tuple is allocator-aware
+template <class Tuple, class Alloc> struct uses_allocator_any;
+
+template <class... T, class Alloc>
+struct uses_allocator_any<std::tuple<T...>, Alloc>
+    : std::disjunction<std::uses_allocator<T, Alloc>...> {};
+} // namespace detail
+
 template <class T> using is_model = detail::is_model<std::decay_t<T>>;
 
 template <class T>
@@ -344,4 +354,14 @@ template <class... Types>
 class tuple_size<scymnus::model<Types...>>
     : public std::integral_constant<std::size_t,
                                     scymnus::model<Types...>::object_size> {};
+
+// models with allocator-aware fields (see pmr_model.hpp) are constructed with
+// an allocator through the std::allocator_arg constructor of std::tuple
+template <class... Types, class Alloc>
+struct uses_allocator<scymnus::model<Types...>, Alloc>
+    : scymnus::detail::uses_allocator_any<
+          scymnus::tl::transform<scymnus::internal_type,
+                                 scymnus::tl::remove_if<scymnus::is_properties,
+                                                        std::tuple<Types...>, std::tuple<>>>,
+          Alloc> {};
 } // namespace std
@@ -2,6 +2,7 @@
 
 #include <optional>
 
+#include "core/compact_model.hpp"
 #include "core/enumeration.hpp"
 #include "core/traits.hpp"
 #include "external/json.hpp"
@@ -11,7 +12,8 @@
 namespace nlohmann {
 
 template <typename T> struct adl_serializer<std::optional<T>> {
-    static void to_json(json &j, const std::optional<T> &opt) {
+    template <class BasicJsonType>
+    static void to_json(BasicJsonType &j, const std::optional<T> &opt) {
         if (opt == std::nullopt) {
             j = nullptr;
         } else {
@@ -19,18 +21,20 @@ template <typename T> struct adl_serializer<std::optional<T>> {
         }
     }
     
-    static void from_json(const json &j, std::optional<T> &opt) {
+    template <class BasicJsonType>
+    static void from_json(const BasicJsonType &j, std::optional<T> &opt) {
         
         if (j.is_null()) {
             opt = std::nullopt;
         } else {
-            opt = j.get<T>();
+            opt = j.template get<T>();
         }
     }
 };
 
 template <typename... T> struct adl_serializer<scymnus::model<T...>> {
-    static void to_json(json &j, const scymnus::model<T...> &p) {
+    template <class BasicJsonType>
+    static void to_json(BasicJsonType &j, const scymnus::model<T...> &p) {
         // foreach
         for_each(p, [&j](const auto &f, const auto &v) {
             using properties = std::remove_cvref_t<decltype(f.properties)>;
@@ -56,7 +60,8 @@ template <typename... T> struct adl_serializer<scymnus::model<T...>> {
         });
     }
     
-    static void from_json(const json &j, scymnus::model<T...> &p) {
+    template <class BasicJsonType>
+    static void from_json(const BasicJsonType &j, scymnus::model<T...> &p) {
         for_each(p, [&](auto &&f, auto &&v) {
             using properties = std::remove_cvref_t<decltype(f.properties)>;
             using type = std::remove_cvref_t<decltype(v)>;
@@ -83,4 +88,17 @@ template <typename... T> struct adl_serializer<scymnus::model<T...>> {
     }
 };
 
+// converted through the model with the same fields
+template <typename... T> struct adl_serializer<scymnus::compact_model<T...>> {
+    template <class BasicJsonType>
+    static void to_json(BasicJsonType &j, const scymnus::compact_model<T...> &p) {
+        j = p.to_model();
+    }
+
+    template <class BasicJsonType>
+    static void from_json(const BasicJsonType &j, scymnus::compact_model<T...> &p) {
+        p = j.template get<scymnus::model<T...>>();
+    }
+};
+
 } // namespace nlohmann
@@ -188,6 +188,10 @@ public:
         v = traits<dtype>::describe();
         v["in"] = "query";
 
+        // the values are given by repeating the key
+        if constexpr (is_vector_v<dtype>)
+            v["collectionFormat"] = "multi";
+
         if (!is_optional_v<T>) {
             v["required"] = true;
         }
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "core/named_tuple.hpp"
+#include "core/request_resource.hpp"
+
+namespace scymnus {
+
+// pmr_model<field<"name", std::string>, field<"tags", std::vector<std::string>>>
+// is the model whose strings and vectors, at any depth, are std::pmr::string
+// and std::pmr::vector. A body_param of a pmr_model is allocated from the
+// arena of the request and released with it, without a delete per string:
+// a copy (std::pmr containers are copied with the default resource) keeps the
+// value after the request, a move does not.
+
+namespace pmr_detail {
+
+template <class T> struct rebind {
+    using type = T;
+};
+
+template <class A> struct rebind<std::basic_string<char, std::char_traits<char>, A>> {
+    using type = std::pmr::string;
+};
+
+template <class T, class A> struct rebind<std::vector<T, A>> {
+    using type = std::pmr::vector<typename rebind<T>::type>;
+};
+
+template <class T> struct rebind<std::optional<T>> {
+    using type = std::optional<typename rebind<T>::type>;
+};
+
+template <meta::ct_string Name, class U, auto... Properties>
+struct rebind<field<Name, U, Properties...>> {
+    using type = field<Name, typename rebind<U>::type, Properties...>;
+};
+
+template <class... N> struct rebind<model<N...>> {
+    using type = model<typename rebind<N>::type...>;
+};
+
+} // namespace pmr_detail
+
+template <class... N> using pmr_model = typename pmr_detail::rebind<model<N...>>::type;
+
+} // namespace scymnus
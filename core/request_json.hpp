@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "core/request_resource.hpp"
+#include "external/json.hpp"
+
+namespace scymnus {
+
+// A nlohmann::json whose nodes (objects, arrays, the pairs of objects and the
+// string and binary values) are allocated from the resource of the request
+// (see request_resource.hpp). nlohmann default-constructs its allocator for
+// every allocation and deallocation, so every block records the resource it
+// came from: values built outside a request use the heap and may be destroyed
+// anywhere. A request_json built while handling a request must not outlive
+// it. The characters of strings longer than the small string buffer still
+// come from the heap (nlohmann converts string_t from and to std::string).
+
+template <class T> class request_allocator {
+public:
+    using value_type = T;
+    using is_always_equal = std::true_type;
+
+    request_allocator() = default;
+
+    template <class U> request_allocator(const request_allocator<U> &) noexcept {}
+
+    T *allocate(std::size_t n) {
+        static_assert(alignof(T) <= header, "over-aligned json node");
+        if (n > (std::numeric_limits<std::size_t>::max() - header) / sizeof(T))
+            throw std::bad_array_new_length{};
+
+        auto resource = request_resource();
+        auto block = static_cast<std::byte *>(resource->allocate(header + n * sizeof(T), header));
+        std::memcpy(block, &resource, sizeof(resource));
+        return reinterpret_cast<T *>(block + header);
+    }
+
+    void deallocate(T *p, std::size_t n) noexcept {
+        auto block = reinterpret_cast<std::byte *>(p) - header;
+        std::pmr::memory_resource *resource;
+        std::memcpy(&resource, block, sizeof(resource));
+        resource->deallocate(block, header + n * sizeof(T), header);
+    }
+
+    template <class U> bool operator==(const request_allocator<U> &) const noexcept {
+        return true;
+    }
+
+private:
+    // the resource of the block, in front of it
+    static constexpr std::size_t header = alignof(std::max_align_t);
+};
+
+using request_json = nlohmann::basic_json<std::map, std::vector, std::string, bool, std::int64_t,
+                                          std::uint64_t, double, request_allocator>;
+
+/// the DOM a value of type T is written through: T itself if it is a json,
+/// request_json unless the to_json of T only takes a nlohmann::json
+template <class T>
+using serializing_json = std::conditional_t<
+    nlohmann::detail::is_basic_json<std::remove_cvref_t<T>>::value, std::remove_cvref_t<T>,
+    std::conditional_t<std::is_constructible_v<request_json, const T &>, request_json,
+                       nlohmann::json>>;
+
+/// the DOM a value of type T is read through: T itself if it is a json,
+/// request_json unless the from_json of T only takes a nlohmann::json
+template <class T>
+using deserializing_json = std::conditional_t<
+    nlohmann::detail::is_basic_json<T>::value, T,
+    std::conditional_t<nlohmann::detail::has_from_json<request_json, T>::value ||
+                           nlohmann::detail::has_non_default_from_json<request_json, T>::value,
+                       request_json, nlohmann::json>>;
+
+} // namespace scymnus
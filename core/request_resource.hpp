@@ -0,0 +1,67 @@
+#pragma once
+
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <utility>
+
+namespace scymnus {
+
+// The memory resource of the request being handled on this thread: the arena
+// of its context, set by request_resource_scope while the router runs and
+// released in bulk when the context is reset. request_json values and the
+// std::pmr containers of models read from the body are allocated from it.
+// Outside of a request it is the heap.
+
+namespace request_resource_detail {
+
+inline std::pmr::memory_resource *&current() {
+    thread_local std::pmr::memory_resource *resource = nullptr;
+    return resource;
+}
+
+} // namespace request_resource_detail
+
+/// the resource of the request being handled, the heap outside of a
+/// request_resource_scope
+inline std::pmr::memory_resource *request_resource() {
+    auto resource = request_resource_detail::current();
+    return resource ? resource : std::pmr::new_delete_resource();
+}
+
+/// makes resource the one of the request being handled on this thread until
+/// destroyed
+class request_resource_scope {
+public:
+    explicit request_resource_scope(std::pmr::memory_resource *resource)
+        : previous_{std::exchange(request_resource_detail::current(), resource)} {}
+
+    ~request_resource_scope() { request_resource_detail::current() = previous_; }
+
+    request_resource_scope(const request_resource_scope &) = delete;
+    request_resource_scope &operator=(const request_resource_scope &) = delete;
+
+private:
+    std::pmr::memory_resource *previous_;
+};
+
+/// a value-initialized T, allocator-aware types (std::pmr containers, models
+/// of them) allocate from the resource of the request
+template <class T> T make_request_value() {
+    if constexpr (std::uses_allocator_v<T, std::pmr::polymorphic_allocator<>>)
+        return std::make_obj_using_allocator<T>(
+            std::pmr::polymorphic_allocator<>{request_resource()});
+    else
+        return T{};
+}
+
+/// sets v to value, allocator-aware types allocate from the resource of the
+/// request
+template <class T, class U> void assign_request_value(std::optional<T> &v, U &&value) {
+    if constexpr (std::uses_allocator_v<T, std::pmr::polymorphic_allocator<>>)
+        v.emplace(make_request_value<T>()) = std::forward<U>(value);
+    else
+        v = std::forward<U>(value);
+}
+
+} // namespace scymnus
@@ -2,11 +2,18 @@
 
 #include <charconv>
 #include <optional>
+#include <stdexcept>
+#include <string>
 #include <string_view>
+#include <vector>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/lexical_cast.hpp>
 
+#include "core/enumeration.hpp"
+#include "core/matching.hpp"
+#include "core/request_json.hpp"
+#include "core/uuid.hpp"
 #include "external/json.hpp"
 #include "http/query_parser.hpp"
 #include "server/headers_container.hpp"
@@ -34,36 +41,77 @@ namespace scymnus {
 
 namespace path {
 
+// path parameters are converted from the segment captured by the router, a
+// value that cannot be converted has already been rejected while matching
+
 template <typename T> struct traits;
 
 //"string", "number", "integer", "boolean", "array" or "file".
 
-template <> struct traits<int> {
-    static int get(std::string_view path, int index) {
-        std::vector<std::string_view> parts = utils::split(path);
-        std::string t{parts[index].data(), parts[index].size()};
-        
-        try {
-            return boost::lexical_cast<int>(t);
-        }
-        
-        catch (boost::bad_lexical_cast &exp) {
+template <typename T>
+    requires(std::is_arithmetic_v<T> && !std::is_same_v<T, bool>)
+struct traits<T> {
+    static bool valid(std::string_view segment) {
+        T value;
+        return utils::parse_number(segment, value);
+    }
+
+    static T get(std::string_view segment) {
+        T value;
+        if (!utils::parse_number(segment, value))
             throw std::runtime_error(
                 "Value for path parameter cannot be converted to the specified type");
-        }
+        return value;
     }
 };
 
 template <> struct traits<std::string> {
-    static std::string get(std::string_view path, int index) {
-        
-        std::vector<std::string_view> parts = utils::split(path);
-        std::string t{parts[index].data(), parts[index].size()};
-        
-        return t;
+    static bool valid(std::string_view segment) { return !segment.empty(); }
+
+    static std::string get(std::string_view segment) {
+        return std::string{segment.data(), segment.size()};
     }
 };
 
+template <> struct traits<std::string_view> {
+    static bool valid(std::string_view segment) { return !segment.empty(); }
+
+    static std::string_view get(std::string_view segment) { return segment; }
+};
+
+template <> struct traits<uuid> {
+    static bool valid(std::string_view segment) { return uuid::valid(segment); }
+
+    static uuid get(std::string_view segment) {
+        auto id = uuid::parse(segment);
+        if (!id)
+            throw std::runtime_error("Value for path parameter is not a valid uuid");
+        return *id;
+    }
+};
+
+template <class T, class... sl> struct traits<enumeration<T, sl...>> {
+    static bool valid(std::string_view segment) {
+        if (!traits<T>::valid(segment))
+            return false;
+        auto value = traits<T>::get(segment);
+        auto &values = enumeration<T, sl...>::data();
+        return std::find(values.begin(), values.end(), value) != values.end();
+    }
+
+    static enumeration<T, sl...> get(std::string_view segment) {
+        return enumeration<T, sl...>{traits<T>::get(segment)};
+    }
+};
+
+template <meta::ct_string Pattern> struct traits<matching<Pattern>> {
+    static bool valid(std::string_view segment) {
+        return matching<Pattern>::dfa().match(segment);
+    }
+
+    static matching<Pattern> get(std::string_view segment) { return {segment}; }
+};
+
 } // namespace path
 
 namespace header {
@@ -219,7 +267,8 @@ template <class T> struct traits<std::vector<T>> {
     static std::vector<T> get(headers_t const &v, const std::pmr::string &field) {
         if (v.count(field)) {
             try {
-                auto data = json::parse(v.find(field)->second).get<std::vector<T>>();
+                auto data = deserializing_json<std::vector<T>>::parse(v.find(field)->second)
+                                .template get<std::vector<T>>();
                 return data;
             }
             
@@ -247,7 +296,8 @@ template <class T> struct traits<std::vector<T>> {
         
         else {
             try {
-                auto data = json::parse(v.find(field)->second).get<std::vector<T>>();
+                auto data = deserializing_json<std::vector<T>>::parse(v.find(field)->second)
+                                .template get<std::vector<T>>();
                 return data;
             }
             
@@ -278,44 +328,92 @@ template <class T> struct traits<std::optional<T>> {
 
 namespace query {
 
+// a value is converted like a path segment, except that strings may be empty.
+// Repeated keys are collected by std::vector<T>, a missing key is an error
+// unless the type is an optional
+
 template <typename T> struct traits;
 
-// TODO: fix error handling when calling from_chars
-#define SCYMNUS_QUERY_PARAMETER_SPECIALIZE_CORE_TYPE(type)                     \
-  template <> struct traits<type> {                                            \
-    static type get(query_string const &v, const std::string_view key) {       \
-      auto value = v.get(key);                                                 \
-      if (!value) {                                                            \
-        std::string msg = "query parameter: ";                                 \
-        msg.append(key);                                                       \
-        msg.append("is missing but required");                                 \
-        throw std::logic_error(msg);                                           \
-      }                                                                        \
-      std::string_view sv = value.value();                                     \
-      type ret;                                                                \
-      auto result = std::from_chars(sv.data(), sv.data() + sv.size(), ret);    \
-      if (result.ec == std::errc::invalid_argument) {                          \
-        std::cout << "Could not convert.\n";                                   \
-      }                                                                        \
-      return ret;                                                              \
-    }                                                                          \
-  };
+namespace detail {
+
+[[noreturn]] inline void missing(std::string_view key) {
+    std::string msg = "query parameter: ";
+    msg.append(key);
+    msg.append(" is missing but required");
+    throw std::runtime_error(msg);
+}
+
+[[noreturn]] inline void invalid(std::string_view key) {
+    std::string msg = "Value for query parameter with name: ";
+    msg.append(key);
+    msg.append(" cannot be converted to the specified type");
+    throw std::runtime_error(msg);
+}
+
+template <typename T> struct single {
+    static T get(query_string const &v, const std::string_view key) {
+        auto value = v.get(key);
+        if (!value)
+            missing(key);
+        return traits<T>::convert(key, *value);
+    }
+};
+
+} // namespace detail
+
+template <typename T> struct traits : detail::single<T> {
+    static T convert(std::string_view key, std::string_view value) {
+        if (!path::traits<T>::valid(value))
+            detail::invalid(key);
+        return path::traits<T>::get(value);
+    }
+};
+
+template <> struct traits<std::string> : detail::single<std::string> {
+    static std::string convert(std::string_view, std::string_view value) {
+        return std::string{value};
+    }
+};
 
-SCYMNUS_QUERY_PARAMETER_SPECIALIZE_CORE_TYPE(unsigned char)
-// SCYMNUS_QUERY_PARAMETER_SPECIALIZE_CORE_TYPE(signed char)
-// SCYMNUS_QUERY_PARAMETER_SPECIALIZE_CORE_TYPE(wchar_t)
-SCYMNUS_QUERY_PARAMETER_SPECIALIZE_CORE_TYPE(short)
-SCYMNUS_QUERY_PARAMETER_SPECIALIZE_CORE_TYPE(unsigned short)
-SCYMNUS_QUERY_PARAMETER_SPECIALIZE_CORE_TYPE(int)
-SCYMNUS_QUERY_PARAMETER_SPECIALIZE_CORE_TYPE(unsigned int)
-SCYMNUS_QUERY_PARAMETER_SPECIALIZE_CORE_TYPE(long)
-SCYMNUS_QUERY_PARAMETER_SPECIALIZE_CORE_TYPE(unsigned long)
-SCYMNUS_QUERY_PARAMETER_SPECIALIZE_CORE_TYPE(long long)
-SCYMNUS_QUERY_PARAMETER_SPECIALIZE_CORE_TYPE(unsigned long long)
-// SCYMNUS_QUERY_PARAMETER_SPECIALIZE_CORE_TYPE(float)
-// SCYMNUS_QUERY_PARAMETER_SPECIALIZE_CORE_TYPE(double)
-// SCYMNUS_QUERY_PARAMETER_SPECIALIZE_CORE_TYPE(long double)
-#undef SCYMNUS_QUERY_PARAMETER_SPECIALIZE_CORE_TYPE
+// the value points into the request and is valid until the response is sent
+template <> struct traits<std::string_view> : detail::single<std::string_view> {
+    static std::string_view convert(std::string_view, std::string_view value) {
+        return value;
+    }
+};
+
+// a key without a value is true
+template <> struct traits<bool> : detail::single<bool> {
+    static bool convert(std::string_view key, std::string_view value) {
+        if (value.empty() || value == "true" || value == "True" || value == "1")
+            return true;
+        if (value == "false" || value == "False" || value == "0")
+            return false;
+        detail::invalid(key);
+    }
+};
+
+template <class T> struct traits<std::vector<T>> {
+    static std::vector<T> get(query_string const &v, const std::string_view key) {
+        auto count = v.count(key);
+        if (!count)
+            detail::missing(key);
+        std::vector<T> result;
+        result.reserve(count);
+        v.for_each(key, [&](std::string_view value) {
+            result.push_back(traits<T>::convert(key, value));
+        });
+        return result;
+    }
+};
+
+template <class T> struct traits<std::optional<T>> {
+    static std::optional<T> get(query_string const &v, const std::string_view key) {
+        if (!v.count(key))
+            return {};
+        return traits<T>::get(v, key);
+    }
+};
 
 } // namespace query
 } // namespace scymnus
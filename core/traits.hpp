@@ -2,6 +2,7 @@
 #include <iostream>
 #include <memory_resource>
 #include <optional>
+#include <string>
 #include <string_view>
 #include <utility>
 #include <vector>
@@ -42,5 +43,13 @@ struct is_vector<std::vector<T, A>> : std::true_type {};
 
 template <class T> constexpr bool is_vector_v = is_vector<T>::value;
 
+// std::string and strings with other allocators, like std::pmr::string
+template <typename> struct is_string : std::false_type {};
+
+template <typename A>
+struct is_string<std::basic_string<char, std::char_traits<char>, A>> : std::true_type {};
+
+template <class T> constexpr bool is_string_v = is_string<T>::value;
+
 
 } // namespace scymnus
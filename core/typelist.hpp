@@ -385,6 +385,34 @@ struct rename<A<T...>, B> {
 template <class A, template <class...> class B>
 using rename_t = typename detail::rename<A, B>::type;
 
+// unique: keeps the first occurrence of each type
+// e.g. unique<typelist<int, char, int>> is typelist<int, char>
+
+namespace detail {
+
+template <class L, class R> struct unique;
+
+template <template <class...> class L, class H, class... T, class... R>
+struct unique<L<H, T...>, L<R...>> {
+    using type = typename unique<
+        L<T...>, std::conditional_t<std::disjunction_v<std::is_same<H, R>...>,
+                                    L<R...>, L<R..., H>>>::type;
+};
+
+template <template <class...> class L, class... R> struct unique<L<>, L<R...>> {
+    using type = L<R...>;
+};
+
+} // namespace detail
+
+template <class L> struct unique;
+
+template <template <class...> class L, class... T> struct unique<L<T...>> {
+    using type = typename detail::unique<L<T...>, L<>>::type;
+};
+
+template <class L> using unique_t = typename unique<L>::type;
+
 // appends an index
 namespace detail {
 template <class S, std::size_t I> struct append_index;
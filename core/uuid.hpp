@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "external/json.hpp"
+
+namespace scymnus {
+
+/// UUID in its textual form xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx (RFC 4122),
+/// upper and lower case hex digits are accepted
+struct uuid {
+    std::array<uint8_t, 16> bytes{};
+
+    static constexpr std::size_t text_size = 36;
+
+    static constexpr std::optional<uuid> parse(std::string_view text) {
+        if (text.size() != text_size)
+            return {};
+
+        uuid result;
+        std::size_t byte = 0;
+        for (std::size_t i = 0; i < text_size;) {
+            if (i == 8 || i == 13 || i == 18 || i == 23) {
+                if (text[i++] != '-')
+                    return {};
+                continue;
+            }
+            auto high = hex_value(text[i]);
+            auto low = hex_value(text[i + 1]);
+            if (high < 0 || low < 0)
+                return {};
+            result.bytes[byte++] = static_cast<uint8_t>(high << 4 | low);
+            i += 2;
+        }
+        return result;
+    }
+
+    static constexpr bool valid(std::string_view text) { return parse(text).has_value(); }
+
+    /// lower case textual form
+    std::string to_string() const {
+        constexpr char digits[] = "0123456789abcdef";
+        std::string text;
+        text.reserve(text_size);
+        for (std::size_t i = 0; i < bytes.size(); ++i) {
+            if (i == 4 || i == 6 || i == 8 || i == 10)
+                text.push_back('-');
+            text.push_back(digits[bytes[i] >> 4]);
+            text.push_back(digits[bytes[i] & 0xf]);
+        }
+        return text;
+    }
+
+    friend bool operator==(const uuid &, const uuid &) = default;
+
+private:
+    static constexpr int hex_value(char c) {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+        return -1;
+    }
+};
+
+template <class BasicJsonType> void to_json(BasicJsonType &j, const uuid &id) {
+    j = id.to_string();
+}
+
+template <class BasicJsonType> void from_json(const BasicJsonType &j, uuid &id) {
+    auto parsed = uuid::parse(j.template get<std::string>());
+    if (!parsed)
+        throw std::invalid_argument("not a valid uuid");
+    id = *parsed;
+}
+
+} // namespace scymnus
@@ -1,88 +1,366 @@
 #pragma once
 
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "core/exception.hpp"
 #include "named_tuple.hpp"
+#include "properties/constraints.hpp"
 
 namespace scymnus {
 
-class validation_exception : public std::exception {
+/// the constraint violations of a document, "field: reason" each
+class validation_exception : public sc_exception {
 public:
-    validation_exception(std::string msg) : msg_(std::move(msg)) {}
+    validation_exception(std::string msg) : sc_exception{msg}, errors_{std::move(msg)} {}
 
-    ~validation_exception() noexcept {}
+    validation_exception(std::vector<std::string> errors)
+        : sc_exception{join(errors)}, errors_{std::move(errors)} {}
 
-    const char *what() const noexcept { return msg_.c_str(); }
+    const std::vector<std::string> &errors() const { return errors_; }
 
 private:
-    std::string msg_;
+    static std::string join(const std::vector<std::string> &errors) {
+        std::string message;
+        for (auto &e : errors) {
+            if (!message.empty())
+                message += "; ";
+            message += e;
+        }
+        return message;
+    }
+
+    std::vector<std::string> errors_;
 };
 
+/// whether the constraints of a body are checked up to the first violation or
+/// all of them are reported
+enum class validation_mode { first_error, all_errors };
+
+// The check of a constraint on a value of type T: valid() is called for every
+// value and does not allocate, message() only for a violation. Properties that
+// are not constraints, or do not apply to T, are always valid. The values of
+// optional fields are checked when they are present.
 template <class T, class Constraint, typename Enable = void>
-struct validation_visitor;
+struct validation_visitor {
+    static constexpr bool is_constraint = false;
+
+    static constexpr bool valid(const T &, const Constraint &) { return true; }
+
+    static std::string message(const Constraint &) { return {}; }
+};
+
+namespace detail {
 
-// template<class T, class U>
-// struct validation_visitor<T, constraints::min<U>>
-//{
-//    static_assert(false, "type of field and field of min<> are different");
-//};
+template <class T, class U> constexpr bool less(const T &a, const U &b) {
+    if constexpr (std::is_integral_v<T> && std::is_integral_v<U> &&
+                  !std::is_same_v<T, bool> && !std::is_same_v<U, bool>)
+        return std::cmp_less(a, b);
+    else
+        return a < b;
+}
 
-// template<class T, class U>
-// struct validation_visitor<T, constraints::max<U>>
-//{
+template <class T> std::string to_string(const T &v) {
+    if constexpr (std::is_arithmetic_v<T>) {
+        char buffer[32];
+        return {buffer, std::to_chars(buffer, buffer + sizeof(buffer), v).ptr};
+    } else
+        return std::string{v};
+}
 
-//    static_assert(false, "type of field and field of max<> are different");
-//};
+// whether from_chars reads all of text as a T: an optional '-' and digits for
+// integers, in the range of T, and for floating point numbers also a fraction
+// and an exponent. The range of floating point numbers is checked when they
+// are read. bool takes true and false
+template <class T> constexpr bool is_number_of(std::string_view text) {
+    if constexpr (std::is_same_v<T, bool>)
+        return text == "true" || text == "false";
+    else {
+        bool negative = !text.empty() && text.front() == '-';
+        if (negative)
+            text.remove_prefix(1);
 
+        auto digits = [&] {
+            std::size_t count = 0;
+            while (count < text.size() && text[count] >= '0' && text[count] <= '9')
+                ++count;
+            return count;
+        };
+
+        if constexpr (std::is_integral_v<T>) {
+            auto count = digits();
+            if (count == 0 || count != text.size())
+                return false;
+            uint64_t magnitude = 0;
+            for (auto c : text) {
+                uint64_t d = static_cast<uint64_t>(c - '0');
+                if (magnitude > (std::numeric_limits<uint64_t>::max() - d) / 10)
+                    return false;
+                magnitude = magnitude * 10 + d;
+            }
+            if (!negative)
+                return std::in_range<T>(magnitude);
+            if constexpr (std::is_unsigned_v<T>)
+                return magnitude == 0;
+            else
+                return magnitude <= static_cast<uint64_t>(std::numeric_limits<T>::max()) + 1;
+        } else {
+            auto whole = digits();
+            text.remove_prefix(whole);
+            std::size_t fraction = 0;
+            if (!text.empty() && text.front() == '.') {
+                text.remove_prefix(1);
+                fraction = digits();
+                text.remove_prefix(fraction);
+            }
+            if (whole + fraction == 0)
+                return false;
+            if (!text.empty() && (text.front() == 'e' || text.front() == 'E')) {
+                text.remove_prefix(1);
+                if (!text.empty() && (text.front() == '-' || text.front() == '+'))
+                    text.remove_prefix(1);
+                auto exponent = digits();
+                if (exponent == 0)
+                    return false;
+                text.remove_prefix(exponent);
+            }
+            return text.empty();
+        }
+    }
+}
+
+// text read as an integer or a bool, text is_number_of<T>
+template <class T> constexpr T parse_number(std::string_view text) {
+    if constexpr (std::is_same_v<T, bool>)
+        return text == "true";
+    else {
+        bool negative = text.front() == '-';
+        if (negative)
+            text.remove_prefix(1);
+        uint64_t magnitude = 0;
+        for (auto c : text)
+            magnitude = magnitude * 10 + static_cast<uint64_t>(c - '0');
+        if (!negative || magnitude == 0)
+            return static_cast<T>(magnitude);
+        return static_cast<T>(-static_cast<int64_t>(magnitude - 1) - 1);
+    }
+}
+
+// strings and vectors
 template <class T>
-struct validation_visitor<T, constraints::min<T>,
-                          std::enable_if_t<std::is_integral_v<T>>> {
-    static bool validate(T value, constraints::min<T> constraint) {
+concept sized = requires(const T &v) { v.size(); };
 
-        if (value < constraint.value())
-            throw validation_exception("min value constraint violation");
-        return true;
+template <class T>
+concept string_like_value = std::is_convertible_v<const T &, std::string_view>;
+
+} // namespace detail
+
+template <class T, class U>
+struct validation_visitor<T, constraints::min<U>, std::enable_if_t<std::is_arithmetic_v<T>>> {
+    static constexpr bool is_constraint = true;
+
+    static constexpr bool valid(const T &value, const constraints::min<U> &constraint) {
+        return !detail::less(value, constraint.value);
+    }
+
+    static std::string message(const constraints::min<U> &constraint) {
+        return "value is less than the minimum " + detail::to_string(constraint.value);
     }
 };
 
-template <class T>
-struct validation_visitor<T, constraints::max<T>,
-                          std::enable_if_t<std::is_integral_v<T>>> {
+template <class T, class U>
+struct validation_visitor<T, constraints::max<U>, std::enable_if_t<std::is_arithmetic_v<T>>> {
+    static constexpr bool is_constraint = true;
 
-    static bool validate(T value, constraints::max<T> constraint) {
+    static constexpr bool valid(const T &value, const constraints::max<U> &constraint) {
+        return !detail::less(constraint.value, value);
+    }
 
-        if (value < constraint.value())
+    static std::string message(const constraints::max<U> &constraint) {
+        return "value is greater than the maximum " + detail::to_string(constraint.value);
+    }
+};
 
-            throw validation_exception("max value constraint violation");
-        return true;
+template <detail::sized T> struct validation_visitor<T, constraints::min_length> {
+    static constexpr bool is_constraint = true;
+
+    static constexpr bool valid(const T &value, const constraints::min_length &constraint) {
+        return value.size() >= constraint.value;
+    }
+
+    static std::string message(const constraints::min_length &constraint) {
+        return "length is less than " + std::to_string(constraint.value);
+    }
+};
+
+template <detail::sized T> struct validation_visitor<T, constraints::max_length> {
+    static constexpr bool is_constraint = true;
+
+    static constexpr bool valid(const T &value, const constraints::max_length &constraint) {
+        return value.size() <= constraint.value;
+    }
+
+    static std::string message(const constraints::max_length &constraint) {
+        return "length is greater than " + std::to_string(constraint.value);
+    }
+};
+
+template <detail::string_like_value T, meta::ct_string Pattern>
+struct validation_visitor<T, constraints::pattern<Pattern>> {
+    static constexpr bool is_constraint = true;
+
+    static bool valid(const T &value, const constraints::pattern<Pattern> &) {
+        return constraints::pattern<Pattern>::dfa().match(value);
+    }
+
+    static std::string message(const constraints::pattern<Pattern> &) {
+        return "value does not match the pattern " +
+               std::string{constraints::pattern<Pattern>::value};
     }
 };
 
-template <> struct validation_visitor<int, constraints::validation<bool>> {
-    static bool validate(int value, constraints::validation<bool> constraint) {
+template <class T, meta::ct_string... Values>
+struct validation_visitor<T, constraints::one_of<Values...>,
+                          std::enable_if_t<std::is_arithmetic_v<T> ||
+                                           std::is_convertible_v<const T &, std::string_view>>> {
+    using constraint = constraints::one_of<Values...>;
+    static constexpr bool is_constraint = true;
+
+    static bool valid(const T &value, const constraint &) {
+        if constexpr (std::is_arithmetic_v<T>) {
+            for (auto &n : numbers)
+                if (n == value)
+                    return true;
+        } else {
+            std::string_view v = value;
+            for (auto allowed : constraint::values)
+                if (allowed == v)
+                    return true;
+        }
+        return false;
+    }
+
+    static std::string message(const constraint &) {
+        std::string message = "value is not one of";
+        for (auto allowed : constraint::values) {
+            message += ' ';
+            message += allowed;
+        }
+        return message;
+    }
+
+private:
+    static constexpr bool numeric = [] {
+        if constexpr (std::is_arithmetic_v<T>) {
+            for (auto v : constraint::values)
+                if (!detail::is_number_of<T>(v))
+                    return false;
+        }
         return true;
+    }();
+
+    static_assert(numeric, "one_of: a value is not a number of the type of the field");
+
+    // the values of arithmetic fields, integers and bools are read at compile
+    // time and floating point numbers, whose range from_chars checks, when the
+    // program starts
+    static std::array<T, sizeof...(Values)> read() {
+        std::array<T, sizeof...(Values)> numbers{};
+        for (std::size_t i = 0; i < numbers.size(); ++i) {
+            auto v = constraint::values[i];
+            auto [ptr, ec] = std::from_chars(v.data(), v.data() + v.size(), numbers[i]);
+            if (ec != std::errc{} || ptr != v.data() + v.size())
+                throw std::invalid_argument("one_of: " + std::string{v} +
+                                            " is out of the range of the field");
+        }
+        return numbers;
+    }
+
+    static constexpr auto parse() {
+        std::array<T, sizeof...(Values)> numbers{};
+        for (std::size_t i = 0; i < numbers.size(); ++i)
+            numbers[i] = detail::parse_number<T>(constraint::values[i]);
+        return numbers;
     }
+
+    static inline const std::array<T, sizeof...(Values)> numbers = [] {
+        if constexpr (std::is_floating_point_v<T>)
+            return read();
+        else if constexpr (std::is_arithmetic_v<T>)
+            return parse();
+        else
+            return std::array<T, sizeof...(Values)>{};
+    }();
 };
 
+namespace detail {
+
+template <class T, class Constraint>
+bool check_constraint(const T &value, const Constraint &c, std::vector<std::string> *errors) {
+    using visitor = validation_visitor<T, Constraint>;
+    if constexpr (!visitor::is_constraint)
+        return true;
+    else {
+        if (visitor::valid(value, c))
+            return true;
+        if (errors)
+            errors->push_back(visitor::message(c));
+        return false;
+    }
+}
+
+} // namespace detail
+
+/// checks value against the constraints of a field, returns whether all of
+/// them hold. The messages of the violations are appended to errors if given
+template <class Properties, class T>
+bool check_constraints(const Properties &properties, const T &value,
+                       std::vector<std::string> *errors = nullptr) {
+    return std::apply(
+        [&](const auto &...constraint) {
+            bool valid = true;
+            ((valid = detail::check_constraint(value, constraint, errors) && valid), ...);
+            return valid;
+        },
+        properties);
+}
+
+template <class Properties>
+constexpr bool is_required_v =
+    has_type<constraints::required, std::remove_cvref_t<Properties>>::value;
+
 class validator {
 
 public:
     validator(){};
 
-    // it gets a field type from a model object
+    /// validates the value of a field of a model (see for_each), throws
+    /// validation_exception with the first violation
     template <class T, class V> void validate(T &&field, V &&value) {
-
-        // TODO: static assert for non field types
-
         using properties = std::remove_cvref_t<decltype(field.properties)>;
-        using field_type = std::remove_cvref_t<decltype(field)>;
-
-        for_each(field.properties, [&value](auto &&constraint) {
-            using constraint_type = std::remove_cvref_t<decltype(constraint)>;
+        using type = std::remove_cvref_t<V>;
 
-            validation_visitor<typename field_type::type, constraint_type> val{};
-            val.validate(value, constraint);
-        });
+        std::vector<std::string> errors;
+        if constexpr (is_optional_v<type>) {
+            if (!value) {
+                if constexpr (is_required_v<properties>)
+                    throw validation_exception(std::string{field.name} +
+                                               ": missing required field");
+                return;
+            }
+            if (!check_constraints(field.properties, *value, &errors))
+                throw validation_exception(std::string{field.name} + ": " + errors.front());
+        } else if (!check_constraints(field.properties, value, &errors))
+            throw validation_exception(std::string{field.name} + ": " + errors.front());
     }
-
-    // iterate on properties
 };
 } // namespace scymnus
@@ -0,0 +1,651 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "core/exception.hpp"
+#include "core/model_reader.hpp"
+#include "external/json.hpp"
+#include "utilities/simd.hpp"
+
+namespace scymnus {
+
+// A binary format derived at compile time from the fields of a model, for
+// services that share the model types. A model is encoded as a table, little
+// endian:
+//
+//   0   u32  size of the table in bytes
+//   4   u32  schema hash of the fields of the writer
+//   8   u16  number of fields of the writer
+//   10  u8   version of the format
+//   11  u8   reserved
+//   12  u32  size of the slots
+//   16       one slot per field, in declaration order
+//            presence bitmap, one bit per field
+//            u32 schema hash of the first 1..n fields, aligned to 4
+//            strings, vectors and nested tables
+//
+// The slot of a number, a bool or an enumeration of numbers holds the value
+// at an offset fixed by the fields before it. The slot of a string, a vector
+// or a model holds the offset of its data from the start of the table and its
+// size: bytes of a string or a table, elements of a vector. The elements of a
+// vector are slots themselves. Other types are stored as their JSON text.
+//
+// wire_view reads fields in place, without materializing the model: strings
+// are string_views into the buffer, vectors and nested models are views.
+// wire_reader materializes a model and checks its constraints.
+//
+// Compatibility: fields are only appended to a model and appended fields are
+// optional. A table written with fewer fields is read with the missing ones
+// absent (their init<> value when materialized), a table written with more
+// fields is read without the extra ones. The schema hash covers names and
+// types, a table whose fields do not match a prefix of the model (or whose
+// first fields do not match the model) is rejected.
+
+namespace wire_detail {
+
+inline constexpr uint8_t version = 1;
+inline constexpr std::size_t header_size = 16;
+
+constexpr std::size_t align_up(std::size_t n, std::size_t a) { return (n + a - 1) / a * a; }
+
+template <class T> void store(char *p, T v) {
+    if constexpr (std::endian::native == std::endian::big && sizeof(T) > 1) {
+        using bits = std::conditional_t<
+            sizeof(T) == 8, uint64_t,
+            std::conditional_t<sizeof(T) == 4, uint32_t, uint16_t>>;
+        auto b = std::bit_cast<bits>(v);
+        for (std::size_t i = 0; i < sizeof(T); ++i)
+            p[i] = static_cast<char>(b >> (8 * i));
+    } else
+        std::memcpy(p, &v, sizeof(T));
+}
+
+template <class T> T load(const char *p) {
+    if constexpr (std::endian::native == std::endian::big && sizeof(T) > 1) {
+        using bits = std::conditional_t<
+            sizeof(T) == 8, uint64_t,
+            std::conditional_t<sizeof(T) == 4, uint32_t, uint16_t>>;
+        bits b = 0;
+        for (std::size_t i = 0; i < sizeof(T); ++i)
+            b |= static_cast<bits>(static_cast<unsigned char>(p[i])) << (8 * i);
+        return std::bit_cast<T>(b);
+    } else {
+        T v;
+        std::memcpy(&v, p, sizeof(T));
+        return v;
+    }
+}
+
+// the type a field is stored as: optionals and enumerations are stored as
+// their values
+template <class T> struct stored {
+    using type = T;
+};
+
+template <class T> struct stored<std::optional<T>> : stored<T> {};
+
+template <class T, class... sl> struct stored<enumeration<T, sl...>> : stored<T> {};
+
+template <class T> using stored_t = typename stored<T>::type;
+
+template <class T> constexpr bool is_scalar_v = std::is_arithmetic_v<stored_t<T>>;
+
+template <class T>
+constexpr std::size_t slot_size = is_scalar_v<T> ? sizeof(stored_t<T>) : 2 * sizeof(uint32_t);
+
+template <class T>
+constexpr std::size_t slot_align = is_scalar_v<T> ? alignof(stored_t<T>) : alignof(uint32_t);
+
+constexpr uint32_t mix(uint32_t h, uint32_t v) {
+    for (int i = 0; i < 4; ++i) {
+        h ^= (v >> (8 * i)) & 0xFF;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+template <class Model> struct layout;
+
+// a code of the type of a field, part of the schema hash
+template <class T> constexpr uint32_t type_code() {
+    if constexpr (is_optional_v<T>)
+        return mix(1, type_code<typename T::value_type>());
+    else if constexpr (model_detail::is_enumeration<T>::value)
+        return type_code<stored_t<T>>();
+    else if constexpr (std::is_same_v<T, bool>)
+        return 2;
+    else if constexpr (std::is_integral_v<T>)
+        return 16 + 2 * sizeof(T) + std::is_signed_v<T>;
+    else if constexpr (std::is_floating_point_v<T>)
+        return 48 + sizeof(T);
+    else if constexpr (is_string_v<T>)
+        return 3;
+    else if constexpr (is_vector_v<T>)
+        return mix(4, type_code<typename T::value_type>());
+    else if constexpr (is_model_v<T>)
+        return mix(5, layout<T>::hash);
+    else
+        return 6;
+}
+
+template <class Model, std::size_t I>
+using field_t = std::remove_cvref_t<decltype(std::get<I>(std::declval<const Model &>()))>;
+
+// the offsets of the slots of a model and the hashes of the prefixes of its
+// fields
+template <class Model> struct layout {
+    static constexpr std::size_t size = Model::object_size;
+
+    template <std::size_t... I>
+    static constexpr auto sizes(std::index_sequence<I...>) {
+        return std::array<std::size_t, sizeof...(I)>{slot_size<field_t<Model, I>>...};
+    }
+
+    template <std::size_t... I>
+    static constexpr auto alignments(std::index_sequence<I...>) {
+        return std::array<std::size_t, sizeof...(I)>{slot_align<field_t<Model, I>>...};
+    }
+
+    template <std::size_t... I>
+    static constexpr auto codes(std::index_sequence<I...>) {
+        return std::array<uint32_t, sizeof...(I)>{type_code<field_t<Model, I>>()...};
+    }
+
+    // offsets[i] is the slot of field i, offsets[size] the end of the slots
+    static constexpr auto offsets = [] {
+        constexpr auto s = sizes(std::make_index_sequence<size>{});
+        constexpr auto a = alignments(std::make_index_sequence<size>{});
+        std::array<std::size_t, size + 1> offsets{};
+        std::size_t position = 0;
+        for (std::size_t i = 0; i < size; ++i) {
+            // slots are aligned from the start of the table, which is aligned
+            // to 8
+            position = align_up(header_size + position, a[i]) - header_size;
+            offsets[i] = position;
+            position += s[i];
+        }
+        offsets[size] = position;
+        return offsets;
+    }();
+
+    /// size of the slots written by a model with the first n fields
+    static constexpr std::size_t slots_size(std::size_t n) { return align_up(offsets[n], 8); }
+
+    /// hashes[n] is the schema hash of a model with the first n fields
+    static constexpr auto hashes = [] {
+        constexpr auto c = codes(std::make_index_sequence<size>{});
+        std::array<uint32_t, size + 1> hashes{};
+        uint32_t h = 2166136261u;
+        hashes[0] = h;
+        for (std::size_t i = 0; i < size; ++i) {
+            h = model_detail::hash(Model::names[i], h);
+            h = mix(h, c[i]);
+            hashes[i + 1] = h;
+        }
+        return hashes;
+    }();
+
+    static constexpr uint32_t hash = hashes[size];
+
+    static constexpr std::size_t bitmap_size(std::size_t n) { return (n + 7) / 8; }
+
+    /// offset of the prefix hashes in a table of n fields with slots of the
+    /// given size
+    static constexpr std::size_t hashes_offset(std::size_t n, std::size_t slots) {
+        return align_up(header_size + slots + bitmap_size(n), 4);
+    }
+
+    /// header, slots, bitmap and prefix hashes
+    static constexpr std::size_t fixed_size =
+        align_up(hashes_offset(size, slots_size(size)) + 4 * size, 8);
+};
+
+} // namespace wire_detail
+
+template <class Model> class wire_view;
+template <class T> class wire_array;
+
+namespace wire_detail {
+
+// what a view returns for a stored value of type T
+template <class T> struct view_type {
+    // other types, their JSON text
+    using type = std::string_view;
+};
+
+template <class T>
+    requires std::is_arithmetic_v<T>
+struct view_type<T> {
+    using type = T;
+};
+
+template <class T> struct view_type<std::optional<T>> {
+    using type = std::optional<typename view_type<T>::type>;
+};
+
+template <class T, class... sl>
+struct view_type<enumeration<T, sl...>> : view_type<T> {};
+
+template <class T, class A> struct view_type<std::vector<T, A>> {
+    using type = wire_array<T>;
+};
+
+template <class T>
+    requires is_model_v<T>
+struct view_type<T> {
+    using type = wire_view<T>;
+};
+
+template <class T> using view_t = typename view_type<T>::type;
+
+[[noreturn]] inline void error(const char *what) {
+    throw sc_exception{"wire: " + std::string{what}};
+}
+
+// the data referred to by a slot, checked to be in the table
+inline std::string_view reference(std::string_view table, const char *slot,
+                                  std::size_t element_size) {
+    auto offset = load<uint32_t>(slot);
+    auto count = load<uint32_t>(slot + sizeof(uint32_t));
+    auto bytes = uint64_t{count} * element_size;
+    if (offset > table.size() || bytes > table.size() - offset)
+        error("reference out of the table");
+    return {table.data() + offset, static_cast<std::size_t>(count)};
+}
+
+// the value of type T (not optional) in a slot of a table
+template <class T> view_t<T> decode(std::string_view table, const char *slot) {
+    using type = stored_t<T>;
+    if constexpr (std::is_same_v<type, bool>)
+        return load<uint8_t>(slot) != 0;
+    else if constexpr (std::is_arithmetic_v<type>)
+        return load<type>(slot);
+    else if constexpr (is_vector_v<type>) {
+        using element = typename type::value_type;
+        auto data = reference(table, slot, slot_size<element>);
+        return wire_array<element>{table, data.data(), data.size()};
+    } else if constexpr (is_model_v<type>)
+        return wire_view<type>{reference(table, slot, 1)};
+    else
+        return reference(table, slot, 1);
+}
+
+} // namespace wire_detail
+
+/// the elements of a vector field, read in place
+template <class T> class wire_array {
+public:
+    using value_type = wire_detail::view_t<T>;
+
+    wire_array() = default;
+
+    wire_array(std::string_view table, const char *slots, std::size_t size)
+        : table_{table}, slots_{slots}, size_{size} {}
+
+    std::size_t size() const { return size_; }
+
+    bool empty() const { return size_ == 0; }
+
+    value_type operator[](std::size_t i) const {
+        return wire_detail::decode<T>(table_, slots_ + i * wire_detail::slot_size<T>);
+    }
+
+    class iterator {
+    public:
+        using value_type = wire_array::value_type;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() = default;
+        iterator(const wire_array *array, std::size_t i) : array_{array}, i_{i} {}
+
+        value_type operator*() const { return (*array_)[i_]; }
+
+        iterator &operator++() {
+            ++i_;
+            return *this;
+        }
+
+        iterator operator++(int) {
+            auto it = *this;
+            ++i_;
+            return it;
+        }
+
+        bool operator==(const iterator &other) const { return i_ == other.i_; }
+
+    private:
+        const wire_array *array_{nullptr};
+        std::size_t i_{0};
+    };
+
+    iterator begin() const { return {this, 0}; }
+
+    iterator end() const { return {this, size_}; }
+
+private:
+    std::string_view table_;
+    const char *slots_{nullptr};
+    std::size_t size_{0};
+};
+
+/// the fields of a model encoded in the wire format, read in place from the
+/// buffer, which must outlive the view. Throws sc_exception if the table is
+/// malformed or was written by an incompatible schema
+template <class Model> class wire_view {
+    using layout = wire_detail::layout<Model>;
+
+public:
+    wire_view() = default;
+
+    explicit wire_view(std::string_view buffer) {
+        using namespace wire_detail;
+        if (buffer.size() < header_size)
+            error("table shorter than its header");
+        auto size = load<uint32_t>(buffer.data());
+        if (size < header_size || size > buffer.size())
+            error("invalid table size");
+        table_ = buffer.substr(0, size);
+
+        if (static_cast<uint8_t>(table_[10]) != version)
+            error("unsupported version");
+        count_ = load<uint16_t>(table_.data() + 8);
+        auto hash = load<uint32_t>(table_.data() + 4);
+        slots_size_ = load<uint32_t>(table_.data() + 12);
+
+        auto hashes = layout::hashes_offset(count_, slots_size_);
+        if (hashes + 4 * uint64_t{count_} > table_.size())
+            error("table shorter than its slots");
+
+        if (count_ <= layout::size) {
+            if (hash != layout::hashes[count_] || slots_size_ != layout::slots_size(count_))
+                error("incompatible schema");
+        } else if (layout::size > 0 &&
+                   (load<uint32_t>(table_.data() + hashes + 4 * (layout::size - 1)) !=
+                        layout::hash ||
+                    slots_size_ < layout::slots_size(layout::size)))
+            error("incompatible schema");
+
+        check_required(std::make_index_sequence<layout::size>{});
+    }
+
+    /// the value of field I, optional fields are empty when absent
+    template <std::size_t I> wire_detail::view_t<wire_detail::field_t<Model, I>> get() const {
+        using type = wire_detail::field_t<Model, I>;
+        if constexpr (is_optional_v<type>) {
+            if (!has<I>())
+                return {};
+            return wire_detail::decode<typename type::value_type>(table_, slot<I>());
+        } else
+            return wire_detail::decode<type>(table_, slot<I>());
+    }
+
+    template <meta::ct_string Name> auto get() const {
+        constexpr int idx = Model::index(Name.str());
+        static_assert(idx >= 0, "wire_view: get<>() called with a non existing field name");
+        return get<idx>();
+    }
+
+    /// whether field I was written
+    template <std::size_t I> bool has() const {
+        if (I >= count_)
+            return false;
+        auto bitmap = table_.data() + wire_detail::header_size + slots_size_;
+        return (static_cast<unsigned char>(bitmap[I / 8]) >> (I % 8)) & 1;
+    }
+
+    /// number of fields of the writer
+    std::size_t fields() const { return count_; }
+
+    /// the bytes of the table
+    std::string_view data() const { return table_; }
+
+private:
+    template <std::size_t I> const char *slot() const {
+        return table_.data() + wire_detail::header_size + layout::offsets[I];
+    }
+
+    // fields appended to the model after the table was written must be
+    // optional
+    template <std::size_t... I> void check_required(std::index_sequence<I...>) const {
+        auto check = [this](std::size_t i, bool optional) {
+            if (i >= count_ && !optional)
+                wire_detail::error("missing field");
+        };
+        (check(I, is_optional_v<wire_detail::field_t<Model, I>>), ...);
+    }
+
+    std::string_view table_;
+    std::size_t count_{0};
+    std::size_t slots_size_{0};
+};
+
+class wire_writer {
+public:
+    /// appends the table of a model to out
+    template <class String, class Model> static void write(String &out, const Model &m) {
+        static_assert(is_model_v<Model>, "the wire format encodes models");
+        table(out, m);
+    }
+
+    /// types written by write
+    template <class T> static constexpr bool streamed = is_model_v<std::remove_cvref_t<T>>;
+
+private:
+    template <class String, class Model> static void table(String &out, const Model &m) {
+        using layout = wire_detail::layout<Model>;
+        auto base = out.size();
+        out.append(layout::fixed_size, '\0');
+
+        fields(out, base, m, std::make_index_sequence<layout::size>{});
+        pad(out, base, 8);
+
+        auto header = out.data() + base;
+        wire_detail::store(header, static_cast<uint32_t>(out.size() - base));
+        wire_detail::store(header + 4, layout::hash);
+        wire_detail::store(header + 8, static_cast<uint16_t>(layout::size));
+        header[10] = static_cast<char>(wire_detail::version);
+        wire_detail::store(header + 12, static_cast<uint32_t>(layout::slots_size(layout::size)));
+        auto hashes = header + layout::hashes_offset(layout::size, layout::slots_size(layout::size));
+        for (std::size_t i = 0; i < layout::size; ++i)
+            wire_detail::store(hashes + 4 * i, layout::hashes[i + 1]);
+    }
+
+    template <class String, class Model, std::size_t... I>
+    static void fields(String &out, std::size_t base, const Model &m, std::index_sequence<I...>) {
+        (field<I>(out, base, m), ...);
+    }
+
+    template <std::size_t I, class String, class Model>
+    static void field(String &out, std::size_t base, const Model &m) {
+        using layout = wire_detail::layout<Model>;
+        const auto &v = std::get<I>(m);
+        auto slot = base + wire_detail::header_size + layout::offsets[I];
+
+        if constexpr (is_optional_v<std::remove_cvref_t<decltype(v)>>) {
+            if (!v)
+                return;
+            value(out, base, slot, *v);
+        } else
+            value(out, base, slot, v);
+
+        auto bitmap = base + wire_detail::header_size + layout::slots_size(layout::size);
+        out[bitmap + I / 8] = static_cast<char>(out[bitmap + I / 8] | (1 << (I % 8)));
+    }
+
+    // the value of a slot at position slot of out, its data is appended
+    template <class String, class T>
+    static void value(String &out, std::size_t base, std::size_t slot, const T &v) {
+        if constexpr (model_detail::is_enumeration<T>::value)
+            value(out, base, slot, v.value());
+        else if constexpr (std::is_arithmetic_v<T>)
+            wire_detail::store(out.data() + slot, v);
+        else if constexpr (is_string_v<T>) {
+            reference(out, base, slot, out.size(), v.size());
+            out.append(v.data(), v.size());
+        } else if constexpr (is_vector_v<T>) {
+            using element = typename T::value_type;
+            static_assert(!is_optional_v<element>, "the wire format has no null elements");
+            constexpr auto size = wire_detail::slot_size<element>;
+            pad(out, base, wire_detail::slot_align<element>);
+            auto start = out.size();
+            reference(out, base, slot, start, v.size());
+            out.append(v.size() * size, '\0');
+            std::size_t i = 0;
+            for (const auto &item : v)
+                value(out, base, start + size * i++, static_cast<const element &>(item));
+        } else if constexpr (is_model_v<T>) {
+            pad(out, base, 8);
+            auto start = out.size();
+            table(out, v);
+            reference(out, base, slot, start, out.size() - start);
+        } else {
+            auto text = serializing_json<T>(v).dump();
+            reference(out, base, slot, out.size(), text.size());
+            out.append(text.data(), text.size());
+        }
+    }
+
+    template <class String>
+    static void reference(String &out, std::size_t base, std::size_t slot, std::size_t position,
+                          std::size_t count) {
+        wire_detail::store(out.data() + slot, static_cast<uint32_t>(position - base));
+        wire_detail::store(out.data() + slot + 4, static_cast<uint32_t>(count));
+    }
+
+    // aligns the end of out from the start of the table
+    template <class String> static void pad(String &out, std::size_t base, std::size_t a) {
+        out.append(wire_detail::align_up(out.size() - base, a) - (out.size() - base), '\0');
+    }
+};
+
+class wire_reader : constraint_report {
+public:
+    /// materializes the model encoded in document, throws sc_exception if
+    /// the document is malformed or incompatible and validation_exception if
+    /// constraints are violated
+    template <class Model>
+    static Model read(std::string_view document,
+                      const read_options &options = body_read_options()) {
+        if (options.max_size && document.size() > options.max_size)
+            wire_detail::error("document exceeds the maximum size");
+
+        wire_view<Model> view{document};
+        if (view.data().size() != document.size())
+            wire_detail::error("unexpected data after the document");
+
+        wire_reader reader{options};
+        auto m = make_request_value<Model>();
+        reader.object(view, m);
+        if (!reader.errors_.empty())
+            reader.throw_violations();
+        return m;
+    }
+
+private:
+    explicit wire_reader(const read_options &options) : constraint_report{options} {}
+
+    template <class Model> void object(const wire_view<Model> &view, Model &m) {
+        if (++depth_ > options_.max_depth && options_.max_depth)
+            wire_detail::error("maximum depth exceeded");
+        fields(view, m, std::make_index_sequence<Model::object_size>{});
+        --depth_;
+    }
+
+    template <class Model, std::size_t... I>
+    void fields(const wire_view<Model> &view, Model &m, std::index_sequence<I...>) {
+        (field<I>(view, m), ...);
+    }
+
+    template <std::size_t I, class Model> void field(const wire_view<Model> &view, Model &m) {
+        if (stop_)
+            return;
+
+        using type = wire_detail::field_t<Model, I>;
+        using properties = std::remove_cvref_t<decltype(std::get<I>(Model::properties))>;
+        const auto &p = std::get<I>(Model::properties);
+        auto &v = std::get<I>(m);
+        auto first = errors_.size();
+
+        if constexpr (is_optional_v<type>) {
+            if (I < view.fields()) {
+                if (auto value = view.template get<I>())
+                    v = materialize<typename type::value_type>(*value);
+            } else if constexpr (has_init<properties>::value) {
+                // appended to the model after the table was written
+                constexpr int idx = tl::index_if<is_init, properties>::value;
+                assign_request_value(v, std::get<idx>(p).value());
+            }
+        } else
+            v = materialize<type>(view.template get<I>());
+
+        if (!stop_)
+            check(p, v);
+
+        if (errors_.size() != first)
+            prefix(first, Model::names[I], false);
+    }
+
+    template <class T> T materialize(const wire_detail::view_t<T> &v) {
+        if constexpr (model_detail::is_enumeration<T>::value)
+            return T{materialize<wire_detail::stored_t<T>>(v)};
+        else if constexpr (std::is_arithmetic_v<T>)
+            return v;
+        else if constexpr (is_string_v<T>) {
+            if (!utils::simd::valid_utf8(v))
+                wire_detail::error("invalid UTF-8 in string");
+            auto s = make_request_value<T>();
+            s.assign(v.data(), v.size());
+            return s;
+        } else if constexpr (is_vector_v<T>) {
+            using element = typename T::value_type;
+            auto result = make_request_value<T>();
+            result.reserve(v.size());
+            for (std::size_t i = 0; i < v.size() && !stop_; ++i) {
+                auto first = errors_.size();
+                result.push_back(materialize<element>(v[i]));
+                if (errors_.size() != first)
+                    prefix(first, std::to_string(i), true);
+            }
+            return result;
+        } else if constexpr (is_model_v<T>) {
+            auto m = make_request_value<T>();
+            object(v, m);
+            return m;
+        } else
+            return deserializing_json<T>::parse(v).template get<T>();
+    }
+
+    std::size_t depth_{0};
+};
+
+/// whether a body_param<Name, Model> also accepts bodies in the wire format,
+/// besides JSON, MessagePack and CBOR. A wire_view body always does. Off
+/// unless specialized:
+///     template <> struct wire_body<PointModel> : std::true_type {};
+template <class Model> struct wire_body : std::false_type {};
+
+/// the codec of a model for clients and servers built from the same model
+/// types
+template <class Model> struct wire_codec {
+    static std::string encode(const Model &m) {
+        std::string out;
+        wire_writer::write(out, m);
+        return out;
+    }
+
+    static Model decode(std::string_view buffer) { return wire_reader::read<Model>(buffer); }
+
+    static wire_view<Model> view(std::string_view buffer) { return wire_view<Model>{buffer}; }
+};
+
+} // namespace scymnus
@@ -40,6 +40,9 @@ std::map<int, PointModel> points{};
 ///
 ///In point model we define that the minimum value of all fields must be 0.
 ///We will write an aspect for checking the minimum alue of the incoming data.
+///(The constraints of a model are already checked while the body is read, and
+///a violation is answered with a 400 before any aspect runs. The aspect is
+///kept as an example of walking the fields of a model)
 
 
 
@@ -215,12 +218,18 @@ int main(){
            },
            log_request_aspect{},
            check_operator_aspect{},
+           rate_limit::per_address(10, 20),
            log_response_aspect{})
 
         .summary("get a point")
         .description("retrieve a point by id")
         .tag("points");
 
+    /// rate_limit is a built-in aspect. Each client address may call the endpoint
+    /// 10 times per second, with bursts of up to 20 requests. Requests over the
+    /// limit get a 429 response with a Retry-After header.
+    /// rate_limit::per_header("X-Api-Key", ...) limits per API key instead.
+    ///
     /// For our get endpoint we are using a path_param<> argument.
     /// the name of the path param: "id" must be present in the endpoint of the response_for return type:
     /// response_for<http_method::GET, "/points/{id}">
@@ -72,6 +72,7 @@ int main(){
                p.get<"id">() = points.size(); //code is not thread safe
 
                points[points.size()] = p;
+               response_cache::instance().invalidate("/points");
                return ctx.write(status<200>, p);
               })
         .summary("Create a point")
@@ -134,6 +135,7 @@ int main(){
                   -> response_for<http_method::DELETE, "/points/{id}">
               {
                   auto count = points.erase(id.get());
+                  response_cache::instance().invalidate_prefix("/points");
 
                   if (count)
                       return ctx.write(status<204>);
@@ -147,6 +149,9 @@ int main(){
 
     ///The last endpoint for this endpoint will return all the points in our map
     ///
+    ///Its responses are cached for 5 seconds: the handler is not called again
+    ///for the same url until the ttl expires or the handlers that modify the map
+    ///invalidate the cached responses
     app.route([](context& ctx)
                   -> response_for<http_method::GET, "/points">
               {
@@ -160,7 +165,8 @@ int main(){
               })
         .summary("get all points")
         .description("get a list of avaliable points")
-        .tag("points");
+        .tag("points")
+        .cache(std::chrono::seconds{5});
 
 
 
@@ -0,0 +1,36 @@
+#include "server/app.hpp"
+
+using namespace scymnus;
+
+/// A gateway in front of legacy services.
+/// Requests under /legacy are forwarded to two local upstreams, the
+/// least loaded one is selected for each request. Request and response bodies
+/// are relayed without being copied into user space.
+///
+/// Start two upstreams before running the example, e.g.:
+///     python3 -m http.server 9001
+///     python3 -m http.server 9002
+///
+/// and then:
+///     curl -i http://127.0.0.1:8080/legacy/
+///     curl -i http://127.0.0.1:8080/health
+
+int main() {
+    settings<core>()[CT_("enable_swagger")] = false;
+
+    auto &app = scymnus::app::instance();
+
+    app.proxy("/legacy", {{"127.0.0.1", 9001}, {"127.0.0.1", 9002}},
+              balance_policy::least_connections)
+        .strip_prefix()
+        .set_header("X-Gateway", "scymnus")
+        .remove_header("Cookie");
+
+    /// routes that are not proxied are served as usual
+    app.route([](context &ctx) -> response_for<http_method::GET, "/health"> {
+        return ctx.write_as<http_content_type::PLAIN_TEXT>(status<200>, "OK");
+    });
+
+    app.listen();
+    app.run();
+}
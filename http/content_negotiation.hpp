@@ -0,0 +1,127 @@
+#pragma once
+
+#include <array>
+#include <string_view>
+
+#include "http/http_common.hpp"
+#include "utilities/simd.hpp"
+
+namespace scymnus {
+
+// The formats of the bodies of models: JSON, MessagePack and CBOR. The format
+// of a request body is given by its Content-Type, the format of a response is
+// negotiated from the Accept header of the request. The wire format
+// (core/wire.hpp) is only used when a route asks for it, it is not negotiated.
+
+namespace negotiation_detail {
+
+inline std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+        s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t'))
+        s.remove_suffix(1);
+    return s;
+}
+
+// the quality of a media range, 1 when not given, in thousandths
+inline int quality(std::string_view parameters) {
+    while (!parameters.empty()) {
+        auto end = parameters.find(';');
+        auto parameter = trim(parameters.substr(0, end));
+        parameters = end == std::string_view::npos ? std::string_view{}
+                                                   : parameters.substr(end + 1);
+
+        if (parameter.size() < 2 || (parameter[0] != 'q' && parameter[0] != 'Q') ||
+            parameter[1] != '=')
+            continue;
+
+        auto value = parameter.substr(2);
+        if (value.empty())
+            return 0;
+        int q = value[0] == '1' ? 1000 : 0;
+        if (value[0] != '0' && value[0] != '1')
+            return 0;
+        if (value.size() > 2 && value[1] == '.') {
+            int scale = 100;
+            for (auto c : value.substr(2, 3)) {
+                if (c < '0' || c > '9')
+                    break;
+                q += (c - '0') * scale;
+                scale /= 10;
+            }
+        }
+        return q > 1000 ? 1000 : q;
+    }
+    return 1000;
+}
+
+} // namespace negotiation_detail
+
+/// the format of a media type, parameters ignored, NONE when it is not the
+/// type of one of the formats of models
+inline http_content_type body_format(std::string_view media_type) {
+    media_type = negotiation_detail::trim(media_type.substr(0, media_type.find(';')));
+
+    auto is = [&](std::string_view type) { return utils::simd::iequals(media_type, type); };
+    if (is("application/json"))
+        return http_content_type::JSON;
+    if (is("application/msgpack") || is("application/x-msgpack"))
+        return http_content_type::MSGPACK;
+    if (is("application/cbor"))
+        return http_content_type::CBOR;
+    if (is("application/vnd.scymnus.wire"))
+        return http_content_type::WIRE;
+    return http_content_type::NONE;
+}
+
+/// the format of a response preferred by an Accept header: the one with the
+/// highest quality, given by the most specific media range that matches it.
+/// JSON is preferred on ties and chosen when none of the formats is accepted
+inline http_content_type negotiate_format(std::string_view accept) {
+    constexpr std::array formats = {http_content_type::JSON, http_content_type::MSGPACK,
+                                    http_content_type::CBOR};
+    // -1 when no media range matches
+    std::array<int, formats.size()> qualities{-1, -1, -1};
+    std::array<int, formats.size()> specificities{-1, -1, -1};
+
+    while (!accept.empty()) {
+        auto end = accept.find(',');
+        auto range = accept.substr(0, end);
+        accept = end == std::string_view::npos ? std::string_view{} : accept.substr(end + 1);
+
+        auto parameters = range.find(';');
+        auto type = negotiation_detail::trim(range.substr(0, parameters));
+        if (type.empty())
+            continue;
+
+        int specificity;
+        auto format = body_format(type);
+        if (format != http_content_type::NONE)
+            specificity = 2;
+        else if (type == "*/*")
+            specificity = 0;
+        else if (utils::simd::iequals(type, "application/*"))
+            specificity = 1;
+        else
+            continue;
+
+        auto q = parameters == std::string_view::npos
+                     ? 1000
+                     : negotiation_detail::quality(range.substr(parameters + 1));
+
+        for (std::size_t i = 0; i < formats.size(); ++i)
+            if ((specificity < 2 || formats[i] == format) && specificity > specificities[i]) {
+                specificities[i] = specificity;
+                qualities[i] = q;
+            }
+    }
+
+    std::size_t best = 0;
+    for (std::size_t i = 1; i < formats.size(); ++i)
+        if (qualities[i] > qualities[best] ||
+            (qualities[i] == qualities[best] && specificities[i] > specificities[best]))
+            best = i;
+    return qualities[best] > 0 ? formats[best] : http_content_type::JSON;
+}
+
+} // namespace scymnus
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "core/ct_map.hpp"
+#include <array>
 #include <string_view>
 
 namespace scymnus {
@@ -56,7 +57,7 @@ enum class http_method : uint16_t {
 };
 
 //   ctx.res.add_header("Content-Type", "text/plain; charset=UTF-8");
-enum class http_content_type : uint8_t { NONE, JSON, PLAIN_TEXT };
+enum class http_content_type : uint8_t { NONE, JSON, PLAIN_TEXT, MSGPACK, CBOR, WIRE };
 
 constexpr std::string_view describe(http_content_type ct) {
     switch (ct) {
@@ -65,6 +66,12 @@ constexpr std::string_view describe(http_content_type ct) {
         return "application/json";
     case http_content_type::PLAIN_TEXT:
         return "text/plain; charset=utf-8";
+    case http_content_type::MSGPACK:
+        return "application/msgpack";
+    case http_content_type::CBOR:
+        return "application/cbor";
+    case http_content_type::WIRE:
+        return "application/vnd.scymnus.wire";
     case http_content_type::NONE:
     default:
         return {};
@@ -78,6 +85,12 @@ constexpr std::string_view to_string_view(http_content_type ct) {
         return "Content-Type:application/json\r\n";
     case http_content_type::PLAIN_TEXT:
         return "Content-Type:text/plain; charset=UTF-8\r\n";
+    case http_content_type::MSGPACK:
+        return "Content-Type:application/msgpack\r\n";
+    case http_content_type::CBOR:
+        return "Content-Type:application/cbor\r\n";
+    case http_content_type::WIRE:
+        return "Content-Type:application/vnd.scymnus.wire\r\n";
     case http_content_type::NONE:
     default:
         return {};
@@ -277,7 +290,7 @@ constexpr const char *http_reason_phrase(int c) {
 // static constexpr std::string_view header_seperator = ": ";
 // static std::string crlf = "\r\n";
 
-static constexpr auto status_codes = scymnus::ct_map<int, std::string_view, 61>{
+static constexpr auto status_lines = scymnus::ct_map<int, std::string_view, 61>{
     {{{100, "HTTP/1.1 100 Continue\r\n"},
       {101, "HTTP/1.1 101 Switching Protocols\r\n"},
       {102, "HTTP/1.1 102 Processing\r\n"},
@@ -340,4 +353,28 @@ static constexpr auto status_codes = scymnus::ct_map<int, std::string_view, 61>{
       {598, "HTTP/1.1 598 Network read timeout error\r\n"},
       {599, "HTTP/1.1 599 Network connect timeout error\r\n"}}}};
 
+// status lines indexed directly by the status code, unknown codes map to 500
+struct status_table {
+    static constexpr int size = 600;
+
+    constexpr status_table() {
+        for (auto &v : status_lines.data)
+            lines[v.first] = v.second;
+    }
+
+    constexpr std::string_view at(int code) const {
+        return code >= 0 && code < size && !lines[code].empty() ? lines[code]
+                                                                 : lines[500];
+    }
+
+    constexpr std::string_view at(int code, int default_code) const {
+        return code >= 0 && code < size && !lines[code].empty() ? lines[code]
+                                                                 : at(default_code);
+    }
+
+    std::array<std::string_view, size> lines{};
+};
+
+static constexpr status_table status_codes{};
+
 } // namespace scymnus
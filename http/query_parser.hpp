@@ -1,80 +1,128 @@
 #pragma once
 
-#include <map>
+#include <cstddef>
+#include <memory_resource>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "utilities/simd.hpp"
 
 namespace scymnus {
 
+// the parameters of a query string, indexed once per request in order of
+// appearance. Keys and values point into the url; a value containing '%' or
+// '+' is decoded on first access into memory of the request, released by
+// clear()
 class query_string {
 public:
-    /// get single value
-    std::optional<std::string_view> get(std::string_view key) const {
-        auto v = parameters_.find(key);
+    explicit query_string(
+        std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+        : entries_{resource}, decoded_{resource} {}
+
+    query_string(const query_string &) = delete;
+    query_string &operator=(const query_string &) = delete;
 
-        if (v != parameters_.end())
-            return (*v).second;
+    /// the first value of key, a key without '=' has an empty value
+    std::optional<std::string_view> get(std::string_view key) const {
+        for (auto &e : entries_)
+            if (e.key == key)
+                return value(e);
         return {};
     }
 
-    std::optional<std::string_view> get_list(std::string_view key) const {
-        auto v = parameters_.find(key);
+    /// the number of values of key
+    std::size_t count(std::string_view key) const {
+        std::size_t n = 0;
+        for (auto &e : entries_)
+            n += e.key == key;
+        return n;
+    }
 
-        if (v != parameters_.end())
-            return (*v).second;
-        return {};
+    /// calls f with each value of key
+    template <class F> void for_each(std::string_view key, F &&f) const {
+        for (auto &e : entries_)
+            if (e.key == key)
+                f(value(e));
     }
 
-private:
-    void parse(std::string_view query) {
+    bool empty() const { return entries_.empty(); }
 
-        const char *begin = query.begin();
-        const char *it = query.begin();
+    void parse(std::string_view query) {
+        while (!query.empty()) {
+            auto end = utils::simd::find(query, '&');
+            auto pair = query.substr(0, end);
+            query.remove_prefix(end == std::string_view::npos ? query.size() : end + 1);
+            if (pair.empty())
+                continue;
+
+            entry e;
+            auto eq = utils::simd::find(pair, '=');
+            e.key = pair.substr(0, eq);
+            if (eq != std::string_view::npos)
+                e.value = pair.substr(eq + 1);
+            // keys are compared often, so they are decoded at once
+            if (encoded(e.key))
+                e.key = decode(e.key);
+            e.encoded = encoded(e.value);
+            entries_.push_back(e);
+        }
+    }
 
-        const char *end = query.end();
+    void clear() {
+        entries_.clear();
+        decoded_.release();
+    }
 
+private:
+    struct entry {
         std::string_view key;
-        std::optional<std::string_view> value;
-
-        while (it != query.end()) {
-            switch (*it) {
-            case '=':
-                key = std::string_view{
-                    begin, static_cast<std::string_view::size_type>(it - begin)};
-                it++;
-                begin = it;
-                break;
-
-            case '&':
-                if (key.size())
-                    value = std::string_view{
-                        begin, static_cast<std::string_view::size_type>(it - begin)};
-                else
-                    key = std::string_view{
-                        begin, static_cast<std::string_view::size_type>(it - begin)};
-
-                it++;
-                begin = it;
-
-                // store values;
-                parameters_.emplace(key, value);
-                break;
-            default:
-                it++;
-            }
+        mutable std::string_view value;
+        mutable bool encoded{false};
+    };
+
+    static bool encoded(std::string_view s) {
+        return utils::simd::find_first_of(s, "%+") != std::string_view::npos;
+    }
+
+    static int hex(char c) {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+        return -1;
+    }
+
+    std::string_view value(const entry &e) const {
+        if (e.encoded) {
+            e.value = decode(e.value);
+            e.encoded = false;
+        }
+        return e.value;
+    }
+
+    // '+' is a space, an invalid escape is kept as it is
+    std::string_view decode(std::string_view s) const {
+        auto out = static_cast<char *>(decoded_.allocate(s.size(), 1));
+        std::size_t n = 0;
+        for (std::size_t i = 0; i < s.size(); ++i) {
+            int h, l;
+            if (s[i] == '+')
+                out[n++] = ' ';
+            else if (s[i] == '%' && i + 2 < s.size() && (h = hex(s[i + 1])) >= 0 &&
+                     (l = hex(s[i + 2])) >= 0) {
+                out[n++] = static_cast<char>(h * 16 + l);
+                i += 2;
+            } else
+                out[n++] = s[i];
         }
-        //            //last parameter
-        if (key.size())
-            value = std::string_view{
-                begin, static_cast<std::string_view::size_type>(it - begin)};
-        else
-            key = std::string_view{
-                begin, static_cast<std::string_view::size_type>(it - begin)};
-
-        parameters_.emplace(std::piecewise_construct, std::forward_as_tuple(key),
-                            std::forward_as_tuple(value));
+        return {out, n};
     }
 
-    std::multimap<std::string_view, std::optional<std::string_view>> parameters_;
-    friend class context;
+    std::pmr::vector<entry> entries_;
+    mutable std::pmr::monotonic_buffer_resource decoded_;
 };
 
 } // namespace scymnus
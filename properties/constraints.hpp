@@ -1,6 +1,10 @@
 #pragma once
 
+#include <cstddef>
+#include <string_view>
+
 #include "meta/ct_string.hpp"
+#include "utilities/regex_dfa.hpp"
 
 namespace constraints {
 
@@ -43,7 +47,51 @@ template <class T> class max {
 public:
     T value;
 
-    constexpr max(T v) : value{} {}
+    constexpr max(T v) : value{v} {}
+};
+
+/// minimum number of characters of a string or of elements of a vector
+class min_length {
+
+public:
+    std::size_t value;
+    constexpr min_length(std::size_t v) : value{v} {}
+};
+
+/// maximum number of characters of a string or of elements of a vector
+class max_length {
+
+public:
+    std::size_t value;
+    constexpr max_length(std::size_t v) : value{v} {}
 };
 
+/// regular expression a string has to match as a whole, e.g.
+/// pattern<"[A-Z]{3}-\\d+">{}. See utils::regex_dfa for the syntax
+template <scymnus::meta::ct_string Pattern> class pattern {
+
+public:
+    static constexpr std::string_view value{Pattern.str(), Pattern.size()};
+
+    /// the automaton of the pattern, compiled on first use
+    static const scymnus::utils::regex_dfa &dfa() {
+        static const scymnus::utils::regex_dfa compiled{value};
+        return compiled;
+    }
+};
+
+/// the allowed values of a field, e.g. one_of<"red", "green">{}. As for
+/// enumeration, the values of numeric fields are given as strings
+template <scymnus::meta::ct_string... Values> class one_of {
+    static_assert(sizeof...(Values) > 0, "one_of must have at least one value");
+
+public:
+    static constexpr std::string_view values[] = {
+        std::string_view{Values.str(), Values.size()}...};
+};
+
+/// an optional field that must be present and not null. The type stays
+/// optional so that the field can be left out of responses
+class required {};
+
 } // namespace constraints
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <mutex>
 #include <set>
 #include <typeindex>
 #include <unordered_map>
@@ -155,9 +156,25 @@ public:
         settings<core>()[CT_("swagger")][CT_("swagger_directory")] = std::move(path);
     }
 
-    inline std::string describe() { return swagger_description_; }
+    inline std::string describe() {
+        std::lock_guard lock{mutex_};
+        return swagger_description_;
+    }
+
+    /// held while routes are documented, they can be added while the server
+    /// is running
+    std::recursive_mutex &mutex() { return mutex_; }
+
+    /// prepares the description again when routes are added after it has
+    /// been prepared
+    void refresh_description() {
+        std::lock_guard lock{mutex_};
+        if (!swagger_description_.empty())
+            prepare_description();
+    }
 
     void prepare_description() {
+        std::lock_guard lock{mutex_};
         swagger_["swagger"] = "2.0";
         if (host_.empty()) {
             std::string ip = settings<core>()[CT_("ip")] == "0.0.0.0"
@@ -206,6 +223,7 @@ public:
 
         swagger_["schemes"] = schemes_;
 
+        swagger_.erase("tags");
         for (const auto &tag : tags_) {
             json v;
             v["name"] = tag;
@@ -222,11 +240,14 @@ public:
     json aspect_responses_;
     json endpoint_responses_;
     json endpoint_produce_types_;
+    // endpoints whose model responses can be projected with ?fields=
+    json endpoint_fields_;
     json swagger_;
 
 private:
     friend class app;
     std::string swagger_description_;
+    std::recursive_mutex mutex_;
 
     api_manager(const api_manager &) = delete;
     api_manager(api_manager &&) = delete;
@@ -2,9 +2,12 @@
 
 #include "api_manager.hpp"
 #include "controllers/swagger_controller.hpp"
+#include "proxy.hpp"
+#include "rate_limit.hpp"
 #include "router.hpp"
 #include "server.hpp"
 #include "server/settings.hpp"
+#include "static_router.hpp"
 
 namespace scymnus {
 
@@ -25,6 +28,7 @@ public:
             route_internal(scymnus::swagger_controller_files{});
         }
 
+        router_.seal();
         server_.run();
     }
 
@@ -43,6 +47,22 @@ public:
         return router_.route_internal(f, t...);
     }
 
+    /// routes whose handlers are known at compile time, dispatched without
+    /// type erasure and matched before the routes added with route(). Aspects
+    /// are not supported
+    template <class... F> void static_routes(F &&...f) {
+        router_.static_routes(
+            std::make_shared<static_router<std::decay_t<F>...>>(std::forward<F>(f)...));
+    }
+
+    /// forwards every request under prefix to one of the upstream servers
+    proxy_route &proxy(std::string prefix,
+                       std::vector<std::pair<std::string, uint16_t>> upstreams,
+                       balance_policy policy = balance_policy::round_robin) {
+        return proxy_table::instance().add(std::move(prefix), std::move(upstreams),
+                                           policy);
+    }
+
     template <class Callable> void set_excpetion_handler(Callable &&callable) {
         router_.exception_handler_.reset(std::forward<Callable>(callable));
     }
@@ -59,11 +79,60 @@ public:
 
     uint16_t max_url_size() const { return server_.max_headers_size_; }
 
-    void max_body_size(uint32_t size) {
-        server_.max_body_size_ = size < 128 ? 128 : size;
+    /// larger request bodies are answered with 413, 0 disables the limit.
+    /// Applies to the connections accepted afterwards
+    void max_body_size(uint32_t value) { settings<core>()[CT_("max_body_size")] = value; }
+
+    uint32_t max_body_size() const { return settings<core>()[CT_("max_body_size")]; }
+
+    /// nesting of objects and arrays accepted in JSON, MessagePack and CBOR
+    /// bodies, 0 disables the limit
+    void max_json_depth(std::size_t value) { body_read_options().max_depth = value; }
+
+    std::size_t max_json_depth() const { return body_read_options().max_depth; }
+
+    /// size in bytes of JSON, MessagePack and CBOR bodies, 0 disables the
+    /// limit
+    void max_json_size(std::size_t value) { body_read_options().max_size = value; }
+
+    std::size_t max_json_size() const { return body_read_options().max_size; }
+
+    /// whether the constraints of the fields of a body are checked up to the
+    /// first violation or all of them are reported
+    void validation(validation_mode mode) { body_read_options().validation = mode; }
+
+    validation_mode validation() const { return body_read_options().validation; }
+
+    /// 0 disables the limit, takes effect on listen()
+    void max_connections(uint32_t value) {
+        settings<core>()[CT_("max_connections")] = value;
+    }
+
+    uint32_t max_connections() const { return settings<core>()[CT_("max_connections")]; }
+
+    /// 0 disables the limit, takes effect on listen()
+    void max_connections_per_worker(uint32_t value) {
+        settings<core>()[CT_("max_connections_per_worker")] = value;
+    }
+
+    uint32_t max_connections_per_worker() const {
+        return settings<core>()[CT_("max_connections_per_worker")];
     }
 
-    uint32_t max_body_size() const { return server_.max_headers_size_; }
+    /// origin allowed to make cross-origin requests, "*" for any. Its
+    /// requests get Access-Control-Allow-Origin and its preflights the
+    /// allowed methods and headers
+    void cors_origin(std::string origin) {
+        settings<core>().get<"cors_origin">() = std::move(origin);
+    }
+
+    std::optional<std::string> cors_origin() const {
+        return settings<core>().get<"cors_origin">();
+    }
+
+    connection_stats_model connection_stats() const {
+        return connection_limits::instance().stats();
+    }
 
 private:
     app(const app &) = delete;
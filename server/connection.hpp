@@ -7,10 +7,12 @@
 
 #include "boost/asio/write.hpp"
 #include "ct_settings.hpp"
+#include "connection_limits.hpp"
 #include "date_manager.hpp"
 #include "external/decimal_from.hpp"
 #include "external/http_parser/llhttp.h"
 #include "server/memory_resource_manager.hpp"
+#include "server/proxy_session.hpp"
 #include "server/router.hpp"
 
 namespace scymnus {
@@ -48,10 +50,15 @@ public:
 
     ~connection() {
         cancel_timer();
+        if (slot_)
+            connection_limits::instance().closed(*slot_);
         std::cout << "connection destructed in thread:"
                   << std::this_thread::get_id() << std::endl;
     }
 
+    // larger request bodies are answered with 413, 0 for no limit
+    void max_body_size_setup(uint32_t size) { max_body_size_ = size; }
+
     // called on first use
     void idle_timeout_setup(uint32_t seconds) {
         if constexpr (idle_time_tracking == false)
@@ -63,8 +70,22 @@ public:
         }
     }
 
+    // counts the connection against the limits of its worker until destructed
+    void track(connection_limits::worker_slot &slot) {
+        slot_ = &slot;
+        connection_limits::instance().opened(slot);
+    }
+
     boost::asio::ip::tcp::socket &socket() { return socket_; }
 
+    // called once the socket is connected
+    void remote_address_setup() {
+        boost::system::error_code ec;
+        auto endpoint = socket_.remote_endpoint(ec);
+        if (!ec)
+            ctx_.remote_address_ = endpoint.address().to_string();
+    }
+
     void read() {
 
         socket_.async_read_some(
@@ -76,21 +97,7 @@ public:
                         last_activity_tp_ = std::chrono::steady_clock::now();
                     }
 
-                    llhttp_errno_t err = process(buffer_.data(), bytes_transferred);
-
-                    if (err == HPE_OK) {
-                        if (response_.empty()) {
-                            read();
-                            return;
-                        }
-                        do_write(should_keep_alive());
-                    }
-
-                    else {
-
-                        ctx_.write(status<400>);
-                        complete_request(ctx_, false);
-                    }
+                    consume(buffer_.data(), bytes_transferred);
                 } else {
                     std::cout << "error in async_read_some(): " << ec.message()
                               << std::endl;
@@ -98,9 +105,64 @@ public:
             });
     }
 
-    llhttp_errno exec() {
+    // parses received bytes, then either writes the responses, keeps reading or
+    // hands the connection over to a proxy route
+    void consume(const char *data, std::size_t size) {
+        llhttp_errno_t err = process(data, size);
+
+        if (err == HPE_PAUSED && proxy_route_) {
+            const char *body = llhttp_get_error_pos(&parser_);
+            proxy_session<connection>::start(*this, *proxy_route_, body,
+                                             data + size - body);
+            return;
+        }
+
+        if (err == HPE_OK) {
+            if (response_.empty()) {
+                read();
+                return;
+            }
+            do_write(keep_alive_);
+        }
 
-        router_.exec(ctx_);
+        else {
+            // responses of the requests parsed before the error are kept
+            ctx_.reset();
+            if (error_status_ == 413)
+                response_.append(canned_response<413>::get());
+            else
+                response_.append(canned_response<400>::get());
+            keep_alive_ = false;
+            do_write(false);
+        }
+    }
+
+    // called by a proxy session when the forwarded exchange is over
+    void proxy_complete(bool keep_alive, const char *leftover, std::size_t size) {
+        proxy_route_ = nullptr;
+        proxy_relay_ = false;
+        ctx_.reset();
+        llhttp_reset(&parser_);
+        parser_state_ = parser_state::Init;
+
+        if (!keep_alive) {
+            close();
+            return;
+        }
+
+        if (size)
+            consume(leftover, size);
+        else
+            read();
+    }
+
+    llhttp_errno exec() {
+        {
+            // request_json values and the bodies read into std::pmr models
+            // come from the arena of the context, released by reset()
+            request_resource_scope scope{ctx_.arena()};
+            router_.exec(ctx_);
+        }
         ctx_.reset();
         return HPE_OK;
     }
@@ -146,6 +208,8 @@ public:
     }
 
 private:
+    template <class> friend class proxy_session;
+
     //        std::array<char, 4096> buffer{};
     //        std::pmr::monotonic_buffer_resource mbr{&buffer, 4096,
     //        memory_resource_manager::instance().pool()};
@@ -169,11 +233,20 @@ private:
     static int on_message_complete(llhttp_t *llhttp) {
         auto *self = static_cast<connection *>(llhttp->data);
 
+        // end of a chunked body relayed to an upstream
+        if (self->proxy_relay_)
+            return HPE_PAUSED;
+
         // TODO: check if method is not supprted
         // route and call handler
 
         self->parser_state_ = parser_state::MessageComplete;
 
+        // the parser is reset once the message is complete, so keep-alive is
+        // recorded here. Any pipelined request asking to close wins
+        if (!llhttp_should_keep_alive(llhttp))
+            self->keep_alive_ = false;
+
         return self->exec();
     }
 
@@ -191,6 +264,13 @@ private:
     static int on_body(llhttp_t *llhttp, const unsigned char *at, size_t length) {
 
         auto *self = static_cast<connection *>(llhttp->data);
+        if (self->proxy_relay_)
+            return HPE_OK;
+        if (self->max_body_size_ &&
+            self->ctx_.req_.body_.size() + length > self->max_body_size_) {
+            self->error_status_ = 413;
+            return HPE_USER;
+        }
         self->ctx_.req_.body_.insert(self->ctx_.req_.body_.end(), at, at + length);
         return HPE_OK;
     }
@@ -241,6 +321,19 @@ private:
         self->header_value_.clear();
         self->ctx_.method_ = static_cast<http_method>(llhttp->method);
 
+        // proxied requests leave the parser here, their body is relayed as is
+        if (!proxy_table::instance().empty()) {
+            self->proxy_route_ = proxy_table::instance().match(self->ctx_.raw_url());
+            if (self->proxy_route_)
+                return HPE_PAUSED;
+        }
+
+        if (self->max_body_size_ && (llhttp->flags & F_CONTENT_LENGTH) &&
+            llhttp->content_length > self->max_body_size_) {
+            self->error_status_ = 413;
+            return -1;
+        }
+
         return HPE_OK;
     }
     static constexpr llhttp_settings_t settings_{
@@ -327,6 +420,15 @@ private:
     llhttp_t parser_{};
 
     bool is_closed_{false};
+    bool keep_alive_{true};
+    // status of the response to a request that failed to parse, 400 if not set
+    uint16_t error_status_{0};
+    uint32_t max_body_size_{0};
+
+    connection_limits::worker_slot *slot_{nullptr};
+
+    proxy_route *proxy_route_{nullptr};
+    bool proxy_relay_{false};
 
     std::size_t ref_count_{0};
 
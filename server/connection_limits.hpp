@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "core/named_tuple.hpp"
+
+namespace scymnus {
+
+using connection_stats_model = model<
+    field<"accepted", uint64_t, description("Connections accepted since start")>,
+    field<"rejected", uint64_t, description("Connections answered with 503 and closed while out of file descriptors")>,
+    field<"paused", uint64_t, description("Number of times accepting was paused because of the connection limits")>,
+    field<"active", uint64_t, description("Connections currently open")>,
+    properties<name("ConnectionStats"), description("Connection counters of the server")>
+    >;
+
+/// Global and per worker limits of concurrently open connections.
+/// Accepting is paused by the server while the limits are reached and
+/// resumed when a connection closes.
+class connection_limits {
+public:
+    struct worker_slot {
+        std::atomic<uint32_t> active{0};
+    };
+
+    static connection_limits &instance() {
+        static connection_limits instance;
+        return instance;
+    }
+
+    // called before the server starts accepting, resume re-arms the acceptor
+    void configure(std::size_t workers, uint32_t max_connections,
+                   uint32_t max_per_worker, std::function<void()> resume) {
+        workers_ = workers ? workers : 1;
+        slots_ = std::make_unique<worker_slot[]>(workers_);
+        max_connections_ = max_connections;
+        max_per_worker_ = max_per_worker;
+        resume_ = std::move(resume);
+    }
+
+    /// index of a worker that can take a new connection, starting the search at
+    /// hint, or -1 when the limits are reached
+    std::ptrdiff_t select_worker(std::size_t hint) const {
+        if (max_connections_ &&
+            active_.load(std::memory_order_acquire) >= max_connections_)
+            return -1;
+
+        if (!max_per_worker_)
+            return hint % workers_;
+
+        for (std::size_t i = 0; i < workers_; ++i) {
+            std::size_t idx = (hint + i) % workers_;
+            if (slots_[idx].active.load(std::memory_order_acquire) < max_per_worker_)
+                return idx;
+        }
+        return -1;
+    }
+
+    worker_slot &slot(std::size_t idx) { return slots_[idx]; }
+
+    void opened(worker_slot &slot) {
+        slot.active.fetch_add(1, std::memory_order_acq_rel);
+        active_.fetch_add(1, std::memory_order_acq_rel);
+        accepted_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void closed(worker_slot &slot) {
+        slot.active.fetch_sub(1, std::memory_order_acq_rel);
+        active_.fetch_sub(1, std::memory_order_acq_rel);
+
+        if (paused_.load(std::memory_order_acquire))
+            try_resume();
+    }
+
+    void rejected() { rejected_.fetch_add(1, std::memory_order_relaxed); }
+
+    /// stops accepting until a connection closes and there is room again
+    void pause() {
+        paused_count_.fetch_add(1, std::memory_order_relaxed);
+        paused_.store(true, std::memory_order_release);
+
+        // a connection may have closed before the flag was visible
+        try_resume();
+    }
+
+    bool is_paused() const { return paused_.load(std::memory_order_acquire); }
+
+    connection_stats_model stats() const {
+        return connection_stats_model{accepted_.load(std::memory_order_relaxed),
+                                      rejected_.load(std::memory_order_relaxed),
+                                      paused_count_.load(std::memory_order_relaxed),
+                                      active_.load(std::memory_order_relaxed)};
+    }
+
+private:
+    void try_resume() {
+        if (select_worker(0) < 0)
+            return;
+
+        bool expected = true;
+        if (paused_.compare_exchange_strong(expected, false,
+                                            std::memory_order_acq_rel))
+            resume_();
+    }
+
+    connection_limits() = default;
+    connection_limits(const connection_limits &) = delete;
+    connection_limits &operator=(const connection_limits &) = delete;
+
+    std::size_t workers_{1};
+    std::unique_ptr<worker_slot[]> slots_{std::make_unique<worker_slot[]>(1)};
+    uint32_t max_connections_{0};
+    uint32_t max_per_worker_{0};
+
+    std::atomic<uint32_t> active_{0};
+    std::atomic<uint64_t> accepted_{0};
+    std::atomic<uint64_t> rejected_{0};
+    std::atomic<uint64_t> paused_count_{0};
+
+    std::atomic<bool> paused_{false};
+    std::function<void()> resume_;
+};
+
+} // namespace scymnus
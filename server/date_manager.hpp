@@ -1,8 +1,12 @@
 #pragma once
 
 #include "service_pool_manager.hpp"
+#include <array>
 #include <chrono>
+#include <cstring>
+#include <memory_resource>
 #include <string>
+#include <string_view>
 
 #include "server/service_pool_manager.hpp"
 
@@ -10,6 +14,9 @@ namespace scymnus {
 
 class date_manager {
 public:
+    // "Date:" + "Sun, 06 Nov 1994 08:49:37" + " GMT\r\n\r\n"
+    static constexpr std::size_t entry_size = 38;
+
     static date_manager &instance() {
         static thread_local date_manager instance;
         return instance;
@@ -18,60 +25,53 @@ public:
     date_manager(date_manager const &) = delete;
     date_manager &operator=(date_manager const &) = delete;
 
-    const std::string &get_http_time() { return entry_; }
+    // the Date header, followed by the empty line that ends the head
+    std::string_view get_http_time() const { return {entry_.data(), entry_size}; }
+
+    // the entry has a fixed size, appending it is a single memcpy
+    void append_http_time(std::pmr::string &response) const {
+        response.append(entry_.data(), entry_size);
+    }
 
-    void append_http_time(std::pmr::string &response) { response.append(entry_); }
+    // changes whenever the entry is updated
+    uint64_t version() const { return version_; }
 
-    const std::string &calculate_http_time() {
+    std::string_view calculate_http_time() {
 
         using namespace std::chrono_literals;
         auto now = std::chrono::system_clock::now();
 
-        if (now - last_update_ > 1s) {
-            entry_.clear();
-            char buff[32];
+        if (now - last_update_ > 1s)
+            prepare_date(now);
 
-            std::time_t time = std::chrono::system_clock::to_time_t(now);
-            tm tm = *gmtime(&time);
-            std::strftime(buff, sizeof(buff), "%a, %d %b %Y %T", &tm);
-            last_update_ = now;
-            date_ = buff;
-
-            entry_.append("Date:");
-            entry_.append(date_);
-            entry_.append(" GMT\r\n\r\n");
-        }
-
-        return entry_;
+        return get_http_time();
     }
 
 private:
     date_manager() : timer_{io_info().get(), std::chrono::seconds(1)} {
-        prepare_date();
+        prepare_date(std::chrono::system_clock::now());
         tick();
     }
 
-    void prepare_date() {
-
-        using namespace std::chrono_literals;
-        auto now = std::chrono::system_clock::now();
-
-        entry_.clear();
+    void prepare_date(std::chrono::system_clock::time_point now) {
         char buff[32];
 
         std::time_t time = std::chrono::system_clock::to_time_t(now);
-        tm tm = *gmtime(&time);
-        std::strftime(buff, sizeof(buff), "%a, %d %b %Y %T", &tm);
-        last_update_ = now;
-        date_ = buff;
+        tm tm;
+        gmtime_r(&time, &tm);
+        auto size = std::strftime(buff, sizeof(buff), "%a, %d %b %Y %T", &tm);
+        if (size + 13 != entry_size)
+            return;
 
-        entry_.append("Date:");
-        entry_.append(date_);
-        entry_.append(" GMT\r\n\r\n");
+        last_update_ = now;
+        std::memcpy(entry_.data(), "Date:", 5);
+        std::memcpy(entry_.data() + 5, buff, size);
+        std::memcpy(entry_.data() + 5 + size, " GMT\r\n\r\n", 8);
+        ++version_;
     }
 
     void tick() {
-        prepare_date();
+        prepare_date(std::chrono::system_clock::now());
         timer_.expires_at(timer_.expires_at() + std::chrono::seconds(1));
         timer_.async_wait(
             [this](const boost::system::error_code & /*ec*/) { this->tick(); });
@@ -81,8 +81,8 @@ private:
 
     boost::asio::steady_timer timer_;
 
-    std::string date_{29, '\0'};
-    std::string entry_;
+    std::array<char, entry_size> entry_{};
+    uint64_t version_{0};
 };
 
 } // namespace scymnus
@@ -6,9 +6,13 @@
 #include <unordered_map>
 #include <vector>
 
+#include "core/compact_model.hpp"
 #include "core/enumeration.hpp"
+#include "core/matching.hpp"
 #include "core/named_tuple.hpp"
 #include "core/traits.hpp"
+#include "core/uuid.hpp"
+#include "core/validator.hpp"
 #include "doc_common.hpp"
 #include "external/json.hpp"
 #include "server/http_context.hpp"
@@ -80,6 +84,8 @@ SCYMNUS_SPECIALIZE_COMMON_TYPES_TRAIT(uint64_t, integer, uint64)
 SCYMNUS_SPECIALIZE_COMMON_TYPES_TRAIT(float, number, float)
 SCYMNUS_SPECIALIZE_COMMON_TYPES_TRAIT(double, integer, double)
 
+SCYMNUS_SPECIALIZE_COMMON_TYPES_TRAIT(uuid, string, uuid)
+
 // TODO: take care of date and datetime types
 // TODO: take care of decimal type
 
@@ -91,10 +97,18 @@ template <string_like T> struct traits<T> {
     static json describe() { return {{"type", "string"}}; }
 };
 
+template <meta::ct_string Pattern> struct traits<matching<Pattern>> {
+    static json describe() {
+        return {{"type", "string"}, {"pattern", std::string(matching<Pattern>::pattern)}};
+    }
+};
+
 template <> struct traits<json> {
     static json describe() { return {{"type", "string"}, {"format", "json"}}; }
 };
 
+template <> struct traits<raw_json> : traits<json> {};
+
 template <class T> struct traits<std::optional<T>> {
     static json describe() {
         json v;
@@ -107,7 +121,7 @@ template <class T> struct traits<std::optional<T>> {
     }
 };
 
-template <class T> struct traits<std::vector<T>> {
+template <class T, class A> struct traits<std::vector<T, A>> {
     static json describe() {
         json v;
         v["type"] = "array";
@@ -120,6 +134,48 @@ template <class T> struct traits<std::vector<T>> {
     }
 };
 
+// the constraints of a field with values of type T, in the schema of the field
+template <class T, class P> void describe_constraint(json &, const P &) {}
+
+template <class T, class U>
+void describe_constraint(json &schema, const constraints::min<U> &c) {
+    schema["minimum"] = c.value;
+}
+
+template <class T, class U>
+void describe_constraint(json &schema, const constraints::max<U> &c) {
+    schema["maximum"] = c.value;
+}
+
+template <class T> void describe_constraint(json &schema, const constraints::min_length &c) {
+    schema[is_vector_v<T> ? "minItems" : "minLength"] = c.value;
+}
+
+template <class T> void describe_constraint(json &schema, const constraints::max_length &c) {
+    schema[is_vector_v<T> ? "maxItems" : "maxLength"] = c.value;
+}
+
+template <class T, meta::ct_string Pattern>
+void describe_constraint(json &schema, const constraints::pattern<Pattern> &) {
+    schema["pattern"] = std::string{constraints::pattern<Pattern>::value};
+}
+
+template <class T, meta::ct_string... Values>
+void describe_constraint(json &schema, const constraints::one_of<Values...> &) {
+    for (auto value : constraints::one_of<Values...>::values) {
+        if constexpr (std::is_arithmetic_v<T>)
+            schema["enum"].push_back(json::parse(value));
+        else
+            schema["enum"].push_back(value);
+    }
+}
+
+template <class T, class Properties>
+void describe_constraints(json &schema, const Properties &properties) {
+    std::apply([&](const auto &...p) { (describe_constraint<T>(schema, p), ...); },
+               properties);
+}
+
 template <typename... T> struct traits<model<T...>> {
     static json describe() {
         json v;
@@ -136,7 +192,8 @@ template <typename... T> struct traits<model<T...>> {
                 // TODO: handle recursive
                 // TODO: handle hidden
 
-                if (!(is_optional<std::decay_t<decltype(value)>>::value))
+                if (!(is_optional<std::decay_t<decltype(value)>>::value) ||
+                    is_required_v<properties>)
                     v["required"].push_back(f.name);
 
                 auto ref = doc_types::get_type<type>();
@@ -150,13 +207,8 @@ template <typename... T> struct traits<model<T...>> {
 
                         if constexpr (is_optional_v<type>) {
                             using nested_type = type::value_type;
-
-                            // TODO: check min vs max
-                            if constexpr (scymnus::has_type<constraints::min<nested_type>,
-                                                            properties>::value)
-                                v["properties"][f.name]["minimum"] =
-                                    std::get<constraints::min<nested_type>>(f.properties)
-                                        .value;
+                            describe_constraints<nested_type>(v["properties"][f.name],
+                                                              f.properties);
 
                             // check for init<> in  properties
 
@@ -165,25 +217,10 @@ template <typename... T> struct traits<model<T...>> {
                                 v["properties"][f.name]["default"] =
                                     std::get<idx>(f.properties).value();
                             }
-
-                            if constexpr (scymnus::has_type<constraints::max<nested_type>,
-                                                            properties>::value)
-                                v["properties"][f.name]["maximum"] =
-                                    std::get<constraints::max<nested_type>>(f.properties)
-                                        .value;
                         }
 
                         else {
-                            // TODO: check min vs max
-                            if constexpr (scymnus::has_type<constraints::min<type>,
-                                                            properties>::value)
-                                v["properties"][f.name]["minimum"] =
-                                    std::get<constraints::min<type>>(f.properties).value;
-
-                            if constexpr (scymnus::has_type<constraints::max<type>,
-                                                            properties>::value)
-                                v["properties"][f.name]["maximum"] =
-                                    std::get<constraints::max<type>>(f.properties).value;
+                            describe_constraints<type>(v["properties"][f.name], f.properties);
                         }
 
                         // TODO: clean code below
@@ -217,8 +254,8 @@ template <class T, class... sl> struct traits<enumeration<T, sl...>> {
     }
 };
 
-template <int Status, class T, http_content_type ContentType>
-struct traits<meta_info<Status, T, ContentType>> {
+template <int Status, class T, http_content_type ContentType, bool Negotiated>
+struct traits<meta_info<Status, T, ContentType, Negotiated>> {
 
     static json describe() {
         json v;
@@ -237,6 +274,11 @@ struct traits<meta_info<Status, T, ContentType>> {
     }
 };
 
+// a body read in place is documented as its model
+template <class Model> struct traits<wire_view<Model>> : traits<Model> {};
+
+template <class... T> struct traits<compact_model<T...>> : traits<model<T...>> {};
+
 template <class T> struct traits<std::map<std::string, T>> {
     static json describe() {
         json v;
@@ -8,10 +8,12 @@
 #include <string_view>
 #include <unordered_map>
 
+#include "utilities/simd.hpp"
+
 namespace scymnus {
 
 // only ascii
-char to_lower(char c) {
+inline char to_lower(char c) {
     if (c <= 'Z' && c >= 'A')
         return c - ('Z' - 'z');
     return c;
@@ -33,8 +35,7 @@ inline char toupper(char c) { return ('a' <= c && c <= 'z') ? c ^ 0x20 : c; }
 struct icomp {
 
     bool operator()(const std::pmr::string &l, const std::pmr::string &r) const {
-        return std::lexicographical_compare(std::cbegin(l), std::cend(l),
-                                            std::cbegin(r), std::cend(r), iless);
+        return utils::simd::icompare(l, r) < 0;
     }
 };
 
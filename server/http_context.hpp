@@ -1,20 +1,31 @@
 #pragma once
 #include <filesystem>
 #include <fstream>
+#include <array>
 #include <charconv>
-
+#include <memory_resource>
+
+#include "core/cbor.hpp"
+#include "core/exception.hpp"
+#include "core/field_projection.hpp"
+#include "core/json_reader.hpp"
+#include "core/json_writer.hpp"
+#include "core/msgpack.hpp"
 #include "core/named_tuple.hpp"
+#include "core/request_json.hpp"
 #include "core/traits.hpp"
+#include "core/wire.hpp"
 #include "date_manager.hpp"
 #include "external/json.hpp"
+#include "http/content_negotiation.hpp"
 #include "http/http_common.hpp"
 #include "http/query_parser.hpp"
 #include "http_request.hpp"
 #include "http_response.hpp"
 #include "mime/mime.hpp"
 #include "server/memory_resource_manager.hpp"
-//#include "url/url.hpp"
-#include "external/decimal_from.hpp"
+#include "server/response_prelude.hpp"
+#include "url/url.hpp"
 
 namespace scymnus {
 
@@ -28,11 +39,49 @@ constexpr content_t<ContentType> content_type;
 
 struct no_content {};
 
+// Negotiated responses are written in the format asked by the Accept header,
+// JSON being the default
 template <int Status, class T,
-         http_content_type ContentType = http_content_type::NONE>
+         http_content_type ContentType = http_content_type::NONE, bool Negotiated = false>
 struct meta_info {
+    using body_type = T;
     static constexpr int status = Status;
     static constexpr http_content_type content_type = ContentType;
+    static constexpr bool negotiated = Negotiated;
+};
+
+// the writer of the bodies of a content type
+template <http_content_type ContentType>
+using writer_for = std::conditional_t<
+    ContentType == http_content_type::MSGPACK, msgpack_writer,
+    std::conditional_t<
+        ContentType == http_content_type::CBOR, cbor_writer,
+        std::conditional_t<ContentType == http_content_type::WIRE, wire_writer, json_writer>>>;
+
+// the output of the JSON, MessagePack and CBOR writers when only its size is
+// needed
+struct length_counter {
+    std::size_t size{0};
+
+    void push_back(char) { ++size; }
+    void append(const char *, std::size_t n) { size += n; }
+    void append(const char *first, const char *last) { size += last - first; }
+};
+
+template <http_content_type ContentType>
+constexpr bool is_binary_v =
+    ContentType == http_content_type::MSGPACK || ContentType == http_content_type::CBOR;
+
+// the path segments captured for the parameters of the matched route, in the
+// order of the route segments. They point into the request url
+struct path_captures {
+    static constexpr std::size_t capacity = 16;
+
+    std::array<std::string_view, capacity> values{};
+    std::size_t size{0};
+
+    void push(std::string_view segment) { values[size++] = segment; }
+    void clear() { size = 0; }
 };
 
 struct context {
@@ -43,17 +92,61 @@ struct context {
     explicit context(std::pmr::string *output_buffer,
                      allocator_type allocator = {})
         : output_buffer_{output_buffer}, raw_url_{allocator}, req_{allocator},
-        res_{allocator} {}
+        res_{allocator}, query_{allocator.resource()}, remote_address_{allocator},
+        path_buffer_{allocator}, arena_{allocator.resource()} {}
 
     const std::pmr::string &raw_url() const { return raw_url_; }
 
+    /// the path of the request target, percent-decoded and normalized (see
+    /// request_target). Empty when the target is not valid
+    std::string_view path() const {
+        parse_target();
+        return target_.path;
+    }
+
+    /// the query of the request target, without '?' and not decoded
+    std::string_view query() const {
+        parse_target();
+        return target_.query;
+    }
+
     http_method method() const { return method_; }
 
+    // segment captured for the path parameter at index, filled by the router
+    std::string_view path_param(std::size_t index) const {
+        return path_params_.values[index];
+    }
+
+    path_captures &path_params() { return path_params_; }
+
+    // address of the client, set once per connection
+    std::string_view remote_address() const { return remote_address_; }
+
     // request related methods
     const http_request &request() const { return req_; }
 
     const std::pmr::string &request_body() const { return req_.body_; }
 
+    /// the format of the request body given by Content-Type, JSON unless it
+    /// is MessagePack or CBOR
+    http_content_type request_format() const {
+        static const std::pmr::string field{"Content-Type"};
+        auto it = req_.headers_.find(field);
+        if (it == req_.headers_.end())
+            return http_content_type::JSON;
+        auto format = body_format(it->second);
+        return format == http_content_type::NONE ? http_content_type::JSON : format;
+    }
+
+    /// the format of the models written by write(), negotiated from Accept
+    http_content_type accepted_format() const {
+        static const std::pmr::string field{"Accept"};
+        auto it = req_.headers_.find(field);
+        if (it == req_.headers_.end())
+            return http_content_type::JSON;
+        return negotiate_format(it->second);
+    }
+
     void add_request_header(const std::pmr::string &field,
                             const std::pmr::string &value) {
         req_.headers_.emplace(field, value);
@@ -85,40 +178,22 @@ struct context {
         using json = nlohmann::json;
         static_assert(ContentType != http_content_type::NONE,
                       "a content type, different from NONE, must be selected");
+        static_assert(ContentType != http_content_type::WIRE,
+                      "the wire format encodes models");
 
         content_type = ContentType;
         res_.status_code_ = st;
 
-        output_buffer_->append(status_codes.at(Status));
-        output_buffer_->append(to_string_view(ContentType));
-
-        for (auto &v : res_.headers_) {
-            output_buffer_->append(v.first);
-            output_buffer_->append(":");
-            output_buffer_->append(v.second);
-            output_buffer_->append("\r\n");
-        }
-
-        output_buffer_->append("Content-Length:");
-        char buff[24];
-
         if constexpr (ContentType == http_content_type::JSON) {
-            json v = body;
+            request_json v = body;
             auto payload = v.dump();
-            auto size = payload.size();
-            output_buffer_->append(decimal_from(size, buff));
-           //output_buffer_->append(fmt::format_int(size).c_str());
-            output_buffer_->append("\r\nServer:scymnus\r\n");
-            date_manager::instance().append_http_time(*output_buffer_);
-            output_buffer_->append(payload);
-            res_.body_ = {output_buffer_->end() - size, output_buffer_->end()};
+            write_head<Status, ContentType>(payload.size());
+            append_body(payload);
+        } else if constexpr (is_binary_v<ContentType>) {
+            write_encoded<Status, ContentType>(std::string{body, N - 1});
         } else {
-            output_buffer_->append(decimal_from(N-1, buff));
-            //output_buffer_->append(fmt::format_int(N - 1).c_str());
-            output_buffer_->append("\r\nServer:scymnus\r\n");
-            date_manager::instance().append_http_time(*output_buffer_);
-            output_buffer_->append(body);
-            res_.body_ = {output_buffer_->end() - N - 1, output_buffer_->end()};
+            write_head<Status, ContentType>(N - 1);
+            append_body({body, N - 1});
         }
         return meta_info<Status, const char *, ContentType>{};
     }
@@ -131,43 +206,68 @@ struct context {
         using json = nlohmann::json;
         content_type = ContentType;
 
-        if constexpr (is_string_like_v<T>) {
+        if constexpr (ContentType == http_content_type::WIRE) {
+            static_assert(wire_writer::streamed<T>, "the wire format encodes models");
+
+            res_.status_code_ = st;
+            write_encoded<Status, ContentType>(body);
+            return meta_info<Status, std::remove_cvref_t<T>, ContentType>{};
+        }
+
+        else if constexpr (std::is_same_v<std::remove_cvref_t<T>, raw_json>) {
+            static_assert(ContentType == http_content_type::JSON, "raw_json is JSON text");
+
+            res_.status_code_ = st;
+            write_head<Status, http_content_type::JSON>(body.text.size());
+            append_body(body.text);
+            return meta_info<Status, raw_json, http_content_type::JSON>{};
+        }
+
+        else if constexpr (is_string_like_v<T>) {
             res_.status_code_ = st;
 
             if constexpr (ContentType == http_content_type::JSON) {
-                if (json::accept(body)) {
-                    write_response_headers(body.size());
-                    output_buffer_->append(body);
-                    res_.body_ = {output_buffer_->end() - body.size(),
-                                  output_buffer_->end()};
-                } else {
-                    auto payload = json(std::forward<T>(body)).dump();
-                    write_response_headers(payload.size());
-                    output_buffer_->append(payload);
-                    res_.body_ = {output_buffer_->end() - payload.size(),
-                                  output_buffer_->end()};
-                }
+                // JSON text is written as is, other text as a JSON string
+                std::string_view text{body};
+                if (json_reader::accept(text)) {
+                    write_head<Status, http_content_type::JSON>(text.size());
+                    append_body(text);
+                } else
+                    write_encoded<Status, http_content_type::JSON>(text);
                 return meta_info<sizeof(T)?Status:0, T, http_content_type::JSON>{};
 
+            } else if constexpr (is_binary_v<ContentType>) {
+                write_encoded<Status, ContentType>(std::string{body});
+                return meta_info<sizeof(T)?Status:0, T, ContentType>{};
+
             } else { // plain text
-                write_response_headers(body.size());
-                output_buffer_->append(body);
-                res_.body_ = {output_buffer_->end() - body.size(),
-                              output_buffer_->end()};
+                write_head<Status, http_content_type::PLAIN_TEXT>(body.size());
+                append_body(body);
                 return meta_info<sizeof(T)?Status:0, T, http_content_type::PLAIN_TEXT>{};
             }
         }
 
+        else if constexpr (json_writer::streamed<T> ||
+                           (is_binary_v<ContentType> &&
+                            std::is_constructible_v<json, std::remove_cv_t<T>>)) {
+            static_assert(sizeof(T) && (ContentType == http_content_type::JSON ||
+                                        is_binary_v<ContentType>),
+                          "content type must be JSON, MSGPACK or CBOR");
+
+            auto fields = requested_fields<T>();
+            res_.status_code_ = st;
+            write_encoded<Status, ContentType>(body, fields.root());
+            return meta_info<sizeof(T)?Status:0, T, ContentType>{};
+        }
+
         else if constexpr (std::is_constructible_v<json, std::remove_cv_t<T>>) {
             static_assert(sizeof(T) && ContentType == http_content_type::JSON,
                           "content type must be JSON");
 
-            auto payload = json(std::forward<T>(body)).dump();
+            auto payload = serializing_json<T>(std::forward<T>(body)).dump();
             res_.status_code_ = st;
-            write_response_headers(payload.size());
-            output_buffer_->append(payload);
-            res_.body_ = {output_buffer_->end() - payload.size(),
-                          output_buffer_->end()};
+            write_head<Status, ContentType>(payload.size());
+            append_body(payload);
 
             return meta_info<sizeof(T)?Status:0, T, ContentType>{};
         }
@@ -183,25 +283,8 @@ struct context {
         content_type = http_content_type::PLAIN_TEXT;
         res_.status_code_ = st;
 
-        output_buffer_->append(status_codes.at(Status));
-        output_buffer_->append(to_string_view(http_content_type::PLAIN_TEXT));
-
-        for (auto &v : res_.headers_) {
-            output_buffer_->append(v.first);
-            output_buffer_->append(":");
-            output_buffer_->append(v.second);
-            output_buffer_->append("\r\n");
-        }
-
-        output_buffer_->append("Content-Length:");
-        char buff[24];
-        output_buffer_->append(decimal_from(N-1, buff));
-
-        //output_buffer_->append(fmt::format_int(N - 1).c_str());
-        output_buffer_->append("\r\nServer:scymnus\r\n");
-        date_manager::instance().append_http_time(*output_buffer_);
-        output_buffer_->append(body);
-        res_.body_ = {output_buffer_->end() - N - 1, output_buffer_->end()};
+        write_head<Status, http_content_type::PLAIN_TEXT>(N - 1);
+        append_body({body, N - 1});
         return meta_info<Status, const char *, http_content_type::PLAIN_TEXT>{};
     }
 
@@ -212,21 +295,29 @@ struct context {
         if constexpr (std::is_same_v<std::remove_cv_t<T>, std::string>) {
             content_type = http_content_type::PLAIN_TEXT;
             res_.status_code_ = st;
-            write_response_headers(body.size());
-            output_buffer_->append(body);
-            res_.body_ = {output_buffer_->end() - body.size(), output_buffer_->end()};
+            write_head<Status, http_content_type::PLAIN_TEXT>(body.size());
+            append_body(body);
             return meta_info<Status, T, http_content_type::PLAIN_TEXT>{};
+        } else if constexpr (std::is_same_v<std::remove_cvref_t<T>, raw_json>) {
+            content_type = http_content_type::JSON;
+            res_.status_code_ = st;
+            write_head<Status, http_content_type::JSON>(body.text.size());
+            append_body(body.text);
+            return meta_info<Status, raw_json, http_content_type::JSON>{};
+        } else if constexpr (json_writer::streamed<T>) {
+            auto fields = requested_fields<T>();
+            res_.status_code_ = st;
+            write_negotiated<Status>(body, fields.root());
+            return meta_info<Status, T, http_content_type::JSON, true>{};
         } else if constexpr (std::is_constructible_v<json, std::remove_cv_t<T>>) {
-            json v = std::forward<T>(body);
+            serializing_json<T> v = std::forward<T>(body);
             auto payload = v.dump();
 
             content_type = http_content_type::JSON;
             res_.status_code_ = st;
 
-            write_response_headers(payload.size());
-            output_buffer_->append(payload);
-            res_.body_ = {output_buffer_->end() - payload.size(),
-                          output_buffer_->end()};
+            write_head<Status, http_content_type::JSON>(payload.size());
+            append_body(payload);
 
             return meta_info<Status, T, http_content_type::JSON>{};
         }
@@ -268,40 +359,127 @@ struct context {
             add_response_header("Content-Type", std::move(value));
         }
 
+        content_type = http_content_type::NONE;
         res_.status_code_ = 200;
         write_response_headers(body.size());
-        output_buffer_->append(body);
-        res_.body_ = {output_buffer_->end() - body.size(), output_buffer_->end()};
+        append_body(body);
     }
 
     void write_response_headers(std::size_t size) {
+        output_buffer_->append(status_codes.at(res_.status_code_.value_or(500), 500));
+        output_buffer_->append(to_string_view(content_type));
+        output_buffer_->append(server_field);
+        append_headers();
+        append_content_length(size);
+    }
 
-        if (res_.status_code_.value() == 200)
-            output_buffer_->append("HTTP/1.1 200 OK\r\n");
+    // head of a response whose status and content type are known at compile
+    // time
+    template <int Status, http_content_type ContentType>
+    void write_head(std::size_t size) {
+        append_prelude<Status, ContentType>();
+        append_value(size);
+    }
 
-        else {
-            auto status = status_codes.at(res_.status_code_.value_or(500), 500);
-            output_buffer_->append(status);
+    // a response whose body is serialized straight into the output buffer.
+    // The Content-Length value is left blank and written once the size of the
+    // body is known, right aligned: the spaces before it are optional
+    // whitespace of the field. Models are written with the fields of selection
+    template <int Status, http_content_type ContentType, bool Vary = false, class T>
+    void write_encoded(const T &body, field_selection selection = {}) {
+        content_type = ContentType;
+        append_prelude<Status, ContentType, Vary>();
+        auto length = output_buffer_->size();
+        output_buffer_->append(content_length_width, ' ');
+        output_buffer_->append("\r\n", 2);
+        date_manager::instance().append_http_time(*output_buffer_);
+
+        auto start = output_buffer_->size();
+
+        // a HEAD response only needs the length of the body. The wire format
+        // patches offsets in the bytes it wrote, so its body is still
+        // written, then dropped
+        if constexpr (ContentType != http_content_type::WIRE) {
+            if (method_ == http_method::HEAD) {
+                length_counter counter;
+                encode<ContentType>(counter, body, selection);
+                write_content_length(length, counter.size);
+                res_.body_ = {};
+                return;
+            }
         }
 
-        if (content_type != http_content_type::NONE)
-            output_buffer_->append(to_string_view(content_type));
+        encode<ContentType>(*output_buffer_, body, selection);
+        auto size = output_buffer_->size() - start;
+        write_content_length(length, size);
 
-        for (auto &v : res_.headers_) {
-            output_buffer_->append(v.first);
-            output_buffer_->append(":");
-            output_buffer_->append(v.second);
-            output_buffer_->append("\r\n");
+        if (method_ == http_method::HEAD) {
+            output_buffer_->resize(start);
+            res_.body_ = {};
+            return;
         }
+        res_.body_ = {output_buffer_->data() + start, size};
+    }
 
-        output_buffer_->append("Content-Length:");
+    template <http_content_type ContentType, class String, class T>
+    static void encode(String &out, const T &body, field_selection selection) {
+        if constexpr (ContentType != http_content_type::WIRE && is_projectable_v<T>) {
+            if (selection)
+                writer_for<ContentType>::write(out, body, selection);
+            else
+                writer_for<ContentType>::write(out, body);
+        } else
+            writer_for<ContentType>::write(out, body);
+    }
 
-        char buff[24];
-        output_buffer_->append(decimal_from(size, buff));
+    // a model in the format accepted by the client, Vary tells caches
+    template <int Status, class T>
+    void write_negotiated(const T &body, field_selection selection = {}) {
+        switch (accepted_format()) {
+        case http_content_type::MSGPACK:
+            write_encoded<Status, http_content_type::MSGPACK, true>(body, selection);
+            break;
+        case http_content_type::CBOR:
+            write_encoded<Status, http_content_type::CBOR, true>(body, selection);
+            break;
+        default:
+            write_encoded<Status, http_content_type::JSON, true>(body, selection);
+        }
+    }
 
-        //output_buffer_->append(fmt::format_int(size).c_str());
-        output_buffer_->append("\r\nServer:scymnus\r\n");
-        date_manager::instance().append_http_time(*output_buffer_);
+    /// the fields of a model response to a GET or HEAD selected by ?fields=,
+    /// compiled in the arena of the request. Every field is selected when the
+    /// query has none, or when the route reads the fields parameter itself
+    template <class T> field_projection requested_fields() {
+        if constexpr (is_projectable_v<T>) {
+            if (project_fields_ &&
+                (method_ == http_method::GET || method_ == http_method::HEAD))
+                if (auto list = get_query_string().get("fields"); list && !list->empty())
+                    return field_projection::compile<projected_model_t<T>>(*list, arena());
+        }
+        return field_projection{arena()};
+    }
+
+    /// set by the router for the routes with a fields query parameter
+    void project_fields(bool enabled) { project_fields_ = enabled; }
+
+    // the response written by the handler, from the status line to the end
+    // of the body
+    std::string_view serialized_response() const {
+        if (start_buffer_position_ > output_buffer_->size())
+            return {};
+        return std::string_view{*output_buffer_}.substr(start_buffer_position_);
+    }
+
+    // writes a response that is already serialized, returns its offset in
+    // the output buffer
+    std::size_t write_serialized(std::string_view response, std::size_t body_offset,
+                                 int status_code) {
+        start_buffer_position_ = output_buffer_->size();
+        res_.status_code_ = status_code;
+        output_buffer_->append(response.substr(0, body_offset));
+        append_body(response.substr(body_offset));
+        return start_buffer_position_;
     }
 
     // in case of an exception clear is called to clean up
@@ -317,59 +495,142 @@ struct context {
     }
 
     void reset() {
-        query_.reset();
+        query_.clear();
+        query_parsed_ = false;
+        target_ = {};
+        target_parsed_ = false;
         raw_url_.clear();
+        path_params_.clear();
+        project_fields_ = true;
 
         req_.reset();
         res_.reset();
+        arena_.release();
         start_buffer_position_ = std::numeric_limits<size_t>::max();
     }
 
+    /// the arena of the request (see request_resource.hpp), released by
+    /// reset()
+    std::pmr::memory_resource *arena() { return &arena_; }
+
     bool is_response_written() {
         return start_buffer_position_ != std::numeric_limits<size_t>::max();
     }
 
     // write support
-    query_string get_query_string() {
-        if (query_)
-            return query_.value();
-        query_ = query_string();
-
-        auto query_start = raw_url_.find('?');
-        if (query_start != std::string::npos && query_start != raw_url_.size()) {
-            query_.value().parse(
-                {raw_url_.data() + query_start + 1, raw_url_.size()});
-        }
-        return query_.value();
+    // indexed on first use, kept until the next request
+    const query_string &get_query_string() {
+        if (query_parsed_)
+            return query_;
+        query_parsed_ = true;
+        query_.parse(query());
+        return query_;
     }
 
     http_content_type content_type{http_content_type::NONE};
 
 private:
     friend class connection;
+
+    // the target is parsed once, the path may point into path_buffer_
+    void parse_target() const {
+        if (target_parsed_)
+            return;
+        target_parsed_ = true;
+        target_ = parse_request_target(raw_url_, path_buffer_).value_or(request_target{});
+    }
+
+    // the head up to "Content-Length:"
+    template <int Status, http_content_type ContentType, bool Vary = false>
+    void append_prelude() {
+        using p = prelude<Status, ContentType, Vary>;
+        if (res_.headers_.empty())
+            output_buffer_->append(p::value);
+        else {
+            output_buffer_->append(p::head);
+            append_headers();
+            output_buffer_->append(content_length_field);
+        }
+    }
+
+    // digits reserved for a Content-Length written after the body, enough
+    // for any body below 10 GB
+    static constexpr std::size_t content_length_width = 10;
+
+    // writes size in the digits reserved at offset of the output buffer.
+    // Larger bodies would overwrite the field name, they are errors
+    void write_content_length(std::size_t offset, uint64_t size) {
+        constexpr uint64_t limit = [] {
+            uint64_t limit = 1;
+            for (std::size_t i = 0; i < content_length_width; ++i)
+                limit *= 10;
+            return limit;
+        }();
+        if (size >= limit)
+            throw sc_exception{"response body too large for its Content-Length"};
+        detail::write_decimal(size, output_buffer_->data() + offset + content_length_width);
+    }
+
     template <int Status> void write_no_content() {
         start_buffer_position_ = output_buffer_->size();
         res_.status_code_ = Status;
-        output_buffer_->append(status_codes.at(Status));
 
+        if (res_.headers_.empty())
+            output_buffer_->append(canned_response<Status>::get());
+        else
+            write_head<Status, http_content_type::NONE>(0);
+    }
+
+    // the body is left out of the response to a HEAD request, the
+    // Content-Length header still gives its size
+    void append_body(std::string_view body) {
+        if (method_ == http_method::HEAD) {
+            res_.body_ = {};
+            return;
+        }
+        output_buffer_->append(body);
+        res_.body_ = {output_buffer_->end() - body.size(), output_buffer_->end()};
+    }
+
+    void append_headers() {
         for (auto &v : res_.headers_) {
             output_buffer_->append(v.first);
-            output_buffer_->append(":");
+            output_buffer_->push_back(':');
             output_buffer_->append(v.second);
-            output_buffer_->append("\r\n");
+            output_buffer_->append("\r\n", 2);
         }
+    }
+
+    void append_content_length(std::size_t size) {
+        output_buffer_->append(content_length_field);
+        append_value(size);
+    }
 
-        output_buffer_->append("Content-Length:0");
-        output_buffer_->append("\r\nServer:scymnus\r\n");
+    // the Content-Length value and the Date header
+    void append_value(std::size_t size) {
+        char buffer[24];
+        auto end = buffer + sizeof(buffer);
+        *--end = '\n';
+        *--end = '\r';
+        auto first = detail::write_decimal(size, end);
+        output_buffer_->append(first, buffer + sizeof(buffer));
         date_manager::instance().append_http_time(*output_buffer_);
     }
 
     http_request req_;
     http_response res_;
-    std::optional<query_string> query_;
+    query_string query_;
+    bool query_parsed_{false};
 
     http_method method_;
     std::pmr::string raw_url_;
+    std::pmr::string remote_address_;
+    mutable std::pmr::string path_buffer_;
+    mutable request_target target_{};
+    mutable bool target_parsed_{false};
+    path_captures path_params_;
+    bool project_fields_{true};
+    std::pmr::monotonic_buffer_resource arena_;
 
     std::size_t start_buffer_position_{std::numeric_limits<size_t>::max()};
 };
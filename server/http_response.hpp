@@ -30,6 +30,7 @@ public:
 
 private:
     friend class context;
+    friend class response_cache;
 
 
     void reset() {
@@ -0,0 +1,408 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <boost/asio/connect.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/intrusive_ptr.hpp>
+
+#include "external/http_parser/llhttp.h"
+#include "server/headers_container.hpp"
+
+namespace scymnus {
+
+// REF: https://man7.org/linux/man-pages/man2/splice.2.html
+// Reverse proxy routes. A route forwards every request whose path starts with
+// its prefix to one of the servers of an upstream pool. The request head is
+// rewritten and re-serialised, bodies are relayed in both directions without
+// being buffered: a Content-Length body moves between the two sockets with
+// splice(2) through a pipe, chunked or close-delimited bodies are streamed
+// through a single read buffer.
+
+enum class balance_policy : uint8_t { round_robin, least_connections };
+
+class upstream {
+public:
+    using endpoints_type = boost::asio::ip::tcp::resolver::results_type;
+
+    upstream(std::string host, uint16_t port) : host_{std::move(host)}, port_{port} {}
+
+    const std::string &host() const { return host_; }
+    uint16_t port() const { return port_; }
+
+    // number of exchanges in flight on all workers
+    uint32_t active() const { return active_.load(std::memory_order_relaxed); }
+
+    // calls handler(ec, endpoints) with the addresses of the server. They are
+    // resolved on the first connection, without blocking the worker, and kept
+    // afterwards; workers that connect at the same time may resolve them twice
+    template <class Executor, class Handler> void resolve(Executor executor, Handler handler) {
+        endpoints_type endpoints;
+        {
+            std::lock_guard lock{mutex_};
+            endpoints = endpoints_;
+        }
+        if (!endpoints.empty()) {
+            handler(boost::system::error_code{}, std::move(endpoints));
+            return;
+        }
+
+        auto resolver = std::make_shared<boost::asio::ip::tcp::resolver>(executor);
+        resolver->async_resolve(
+            host_, std::to_string(port_),
+            [this, resolver, handler = std::move(handler)](
+                const boost::system::error_code &ec, endpoints_type endpoints) mutable {
+                if (!ec && !endpoints.empty()) {
+                    std::lock_guard lock{mutex_};
+                    endpoints_ = endpoints;
+                }
+                handler(ec, std::move(endpoints));
+            });
+    }
+
+private:
+    template <class> friend class proxy_session;
+    friend class upstream_pool;
+
+    std::string host_;
+    uint16_t port_;
+    std::mutex mutex_;
+    endpoints_type endpoints_;
+    std::atomic<uint32_t> active_{0};
+};
+
+class upstream_pool {
+public:
+    using socket_ptr = std::unique_ptr<boost::asio::ip::tcp::socket>;
+
+    upstream_pool(std::vector<std::pair<std::string, uint16_t>> servers,
+                  balance_policy policy)
+        : policy_{policy} {
+        if (servers.empty())
+            throw std::invalid_argument("upstream pool must not be empty");
+
+        for (auto &[host, port] : servers)
+            upstreams_.push_back(std::make_unique<upstream>(std::move(host), port));
+    }
+
+    upstream &select() {
+        if (upstreams_.size() == 1 || policy_ == balance_policy::round_robin)
+            return *upstreams_[next_.fetch_add(1, std::memory_order_relaxed) %
+                                upstreams_.size()];
+
+        // least connections, ties are broken by rotating the starting point
+        std::size_t start = next_.fetch_add(1, std::memory_order_relaxed);
+        upstream *selected = nullptr;
+        for (std::size_t i = 0; i < upstreams_.size(); ++i) {
+            auto &u = *upstreams_[(start + i) % upstreams_.size()];
+            if (!selected || u.active() < selected->active())
+                selected = &u;
+        }
+        return *selected;
+    }
+
+    // keep-alive connections are kept per worker thread, sockets are bound to
+    // the io_context of the worker that opened them
+    socket_ptr take_idle(const upstream &u) {
+        auto &idle = idle_connections()[&u];
+        while (!idle.empty()) {
+            auto socket = std::move(idle.back());
+            idle.pop_back();
+
+            // a closed or misbehaving connection becomes readable while idle
+            char c;
+            auto r = ::recv(socket->native_handle(), &c, 1, MSG_PEEK | MSG_DONTWAIT);
+            if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                return socket;
+        }
+        return {};
+    }
+
+    void put_idle(const upstream &u, socket_ptr socket) {
+        auto &idle = idle_connections()[&u];
+        if (idle.size() < max_idle_)
+            idle.push_back(std::move(socket));
+    }
+
+    void max_idle(std::size_t value) { max_idle_ = value; }
+
+    std::size_t size() const { return upstreams_.size(); }
+
+    upstream &operator[](std::size_t i) { return *upstreams_[i]; }
+
+private:
+    using idle_map = std::unordered_map<const upstream *, std::vector<socket_ptr>>;
+
+    static idle_map &idle_connections() {
+        thread_local idle_map connections;
+        return connections;
+    }
+
+    std::vector<std::unique_ptr<upstream>> upstreams_;
+    balance_policy policy_;
+    std::atomic<std::size_t> next_{0};
+    std::size_t max_idle_{32};
+};
+
+class proxy_route {
+public:
+    proxy_route(std::string prefix,
+                std::vector<std::pair<std::string, uint16_t>> servers,
+                balance_policy policy)
+        : prefix_{std::move(prefix)}, pool_{std::move(servers), policy} {
+        if (prefix_.empty() || prefix_.front() != '/')
+            throw std::invalid_argument("proxy prefix must start with '/'");
+        if (prefix_.size() > 1 && prefix_.back() == '/')
+            prefix_.pop_back();
+    }
+
+    /// remove the prefix from the forwarded target
+    proxy_route &strip_prefix(bool value = true) {
+        strip_prefix_ = value;
+        return *this;
+    }
+
+    /// forward the Host header of the client instead of the upstream's one
+    proxy_route &preserve_host(bool value = true) {
+        preserve_host_ = value;
+        return *this;
+    }
+
+    /// relay Content-Length bodies with splice(2), enabled by default
+    proxy_route &zero_copy(bool value) {
+        zero_copy_ = value;
+        return *this;
+    }
+
+    /// set (or replace) a header on every forwarded request
+    proxy_route &set_header(std::string field, std::string value) {
+        set_headers_.emplace_back(std::move(field), std::move(value));
+        return *this;
+    }
+
+    /// drop a header from every forwarded request
+    proxy_route &remove_header(std::string field) {
+        removed_headers_.push_back(std::move(field));
+        return *this;
+    }
+
+    /// maximum number of idle keep-alive connections per upstream and worker
+    proxy_route &max_idle(std::size_t value) {
+        pool_.max_idle(value);
+        return *this;
+    }
+
+    const std::string &prefix() const { return prefix_; }
+
+    upstream_pool &pool() { return pool_; }
+
+    bool matches(std::string_view url) const {
+        if (prefix_.size() == 1)
+            return true;
+        if (!url.starts_with(prefix_))
+            return false;
+        return url.size() == prefix_.size() || url[prefix_.size()] == '/' ||
+               url[prefix_.size()] == '?';
+    }
+
+    // the request head sent to the upstream
+    std::string request_head(std::string_view method, std::string_view url,
+                             const headers_t &headers, const upstream &u,
+                             std::string_view client_address) const {
+        std::string head;
+        head.reserve(512);
+        head.append(method);
+        head.push_back(' ');
+
+        if (strip_prefix_ && prefix_.size() > 1) {
+            url.remove_prefix(prefix_.size());
+            if (url.empty() || url.front() != '/')
+                head.push_back('/');
+        }
+        head.append(url);
+        head.append(" HTTP/1.1\r\n");
+
+        std::string_view forwarded_for;
+        std::string_view host;
+
+        for (auto &[field, value] : headers) {
+            if (is_hop_by_hop(field) || is_removed(field) || is_set(field))
+                continue;
+
+            if (iequals(field, "host")) {
+                host = value;
+                if (!preserve_host_)
+                    continue;
+            }
+
+            if (iequals(field, "x-forwarded-for")) {
+                forwarded_for = value;
+                continue;
+            }
+            append_header(head, field, value);
+        }
+
+        if (!preserve_host_) {
+            head.append("Host:");
+            head.append(u.host());
+            head.push_back(':');
+            head.append(std::to_string(u.port()));
+            head.append("\r\n");
+        }
+
+        head.append("X-Forwarded-For:");
+        if (!forwarded_for.empty()) {
+            head.append(forwarded_for);
+            head.append(", ");
+        }
+        head.append(client_address);
+        head.append("\r\nX-Forwarded-Proto:http\r\n");
+        if (!host.empty())
+            append_header(head, "X-Forwarded-Host", host);
+
+        for (auto &[field, value] : set_headers_)
+            append_header(head, field, value);
+
+        head.append("\r\n");
+        return head;
+    }
+
+    // Expect is end to end: the upstream decides whether to take the body
+    // and its 100 Continue is relayed to the client
+    static bool is_hop_by_hop(std::string_view field) {
+        return iequals(field, "connection") || iequals(field, "keep-alive") ||
+               iequals(field, "proxy-connection") || iequals(field, "te") ||
+               iequals(field, "trailer") || iequals(field, "upgrade");
+    }
+
+    static bool iequals(std::string_view lhs, std::string_view rhs) {
+        return utils::simd::iequals(lhs, rhs);
+    }
+
+private:
+    template <class> friend class proxy_session;
+
+    static void append_header(std::string &head, std::string_view field,
+                              std::string_view value) {
+        head.append(field);
+        head.push_back(':');
+        head.append(value);
+        head.append("\r\n");
+    }
+
+    bool is_removed(std::string_view field) const {
+        return std::any_of(removed_headers_.begin(), removed_headers_.end(),
+                           [&](auto &f) { return iequals(f, field); });
+    }
+
+    bool is_set(std::string_view field) const {
+        return std::any_of(set_headers_.begin(), set_headers_.end(),
+                           [&](auto &f) { return iequals(f.first, field); });
+    }
+
+    std::string prefix_;
+    upstream_pool pool_;
+    bool strip_prefix_{false};
+    bool preserve_host_{false};
+    bool zero_copy_{true};
+    std::vector<std::pair<std::string, std::string>> set_headers_;
+    std::vector<std::string> removed_headers_;
+};
+
+/// proxy routes are registered before app::run() and never change afterwards
+class proxy_table {
+public:
+    static proxy_table &instance() {
+        static proxy_table instance;
+        return instance;
+    }
+
+    proxy_route &add(std::string prefix,
+                     std::vector<std::pair<std::string, uint16_t>> servers,
+                     balance_policy policy) {
+        auto &route = *routes_.emplace_back(std::make_unique<proxy_route>(
+            std::move(prefix), std::move(servers), policy));
+        // longest prefix first
+        std::stable_sort(routes_.begin(), routes_.end(), [](auto &l, auto &r) {
+            return l->prefix().size() > r->prefix().size();
+        });
+        return route;
+    }
+
+    bool empty() const { return routes_.empty(); }
+
+    proxy_route *match(std::string_view url) const {
+        for (auto &route : routes_)
+            if (route->matches(url))
+                return route.get();
+        return nullptr;
+    }
+
+private:
+    proxy_table() = default;
+    proxy_table(const proxy_table &) = delete;
+    proxy_table &operator=(const proxy_table &) = delete;
+
+    std::vector<std::unique_ptr<proxy_route>> routes_;
+};
+
+namespace detail {
+
+// pipes used by splice(2), cached per worker thread
+struct splice_pipe {
+    int read_fd{-1};
+    int write_fd{-1};
+    std::size_t pending{0};
+
+    static splice_pipe acquire() {
+        auto &cache = pipes();
+        if (!cache.empty()) {
+            auto p = cache.back();
+            cache.pop_back();
+            return p;
+        }
+        int fds[2];
+        if (::pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0)
+            return {};
+        return {fds[0], fds[1], 0};
+    }
+
+    static void release(splice_pipe &p) {
+        if (p.read_fd < 0)
+            return;
+        // a pipe that still holds data cannot be reused
+        if (p.pending == 0 && pipes().size() < 64)
+            pipes().push_back(p);
+        else {
+            ::close(p.read_fd);
+            ::close(p.write_fd);
+        }
+        p = {};
+    }
+
+    explicit operator bool() const { return read_fd >= 0; }
+
+private:
+    static std::vector<splice_pipe> &pipes() {
+        thread_local std::vector<splice_pipe> cache;
+        return cache;
+    }
+};
+
+} // namespace detail
+
+} // namespace scymnus
@@ -0,0 +1,683 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <array>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <boost/asio/connect.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/intrusive_ptr.hpp>
+
+#include "external/http_parser/llhttp.h"
+#include "server/proxy.hpp"
+
+namespace scymnus {
+
+// One forwarded exchange: the request of a client connection, paused by the
+// parser right after its head, and the response of the selected upstream.
+template <class Connection> class proxy_session {
+    using tcp = boost::asio::ip::tcp;
+
+public:
+    static void start(Connection &connection, proxy_route &route,
+                      const char *data, std::size_t size) {
+        boost::intrusive_ptr<proxy_session> session{
+            new proxy_session{connection, route}};
+        session->run(data, size);
+    }
+
+    ~proxy_session() {
+        detail::splice_pipe::release(pipe_);
+        if (upstream_)
+            upstream_->active_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    inline friend void intrusive_ptr_add_ref(proxy_session *s) noexcept {
+        ++s->ref_count_;
+    }
+
+    inline friend void intrusive_ptr_release(proxy_session *s) noexcept {
+        if (--s->ref_count_ == 0)
+            delete s;
+    }
+
+private:
+    enum class framing : uint8_t { none, length, stream };
+
+    proxy_session(Connection &connection, proxy_route &route)
+        : connection_{&connection}, route_{route},
+          continue_timer_{connection.socket().get_executor()} {
+        llhttp_init(&parser_, HTTP_RESPONSE, &settings_);
+        parser_.data = this;
+    }
+
+    void run(const char *data, std::size_t size) {
+        auto &request_parser = connection_->parser_;
+        client_keep_alive_ = llhttp_should_keep_alive(&request_parser);
+        head_request_ = request_parser.method == HTTP_HEAD;
+        // HTTP/1.0 clients do not expect informational responses
+        relay_interim_ = request_parser.http_major > 1 ||
+                         (request_parser.http_major == 1 && request_parser.http_minor > 0);
+
+        // body framing of the request
+        if (request_parser.flags & F_CHUNKED) {
+            request_framing_ = framing::stream;
+        } else if ((request_parser.flags & F_CONTENT_LENGTH) &&
+                   request_parser.content_length) {
+            request_framing_ = framing::length;
+            request_remaining_ = request_parser.content_length;
+        }
+
+        upstream_ = &route_.pool().select();
+        upstream_->active_.fetch_add(1, std::memory_order_relaxed);
+
+        head_ = route_.request_head(
+            llhttp_method_name(static_cast<llhttp_method_t>(request_parser.method)),
+            connection_->ctx_.raw_url(), connection_->ctx_.request().headers(),
+            *upstream_, connection_->ctx_.remote_address());
+        auto head_size = head_.size();
+
+        // the part of the body that arrived along with the head
+        if (request_framing_ == framing::length) {
+            std::size_t n = std::min<std::size_t>(size, request_remaining_);
+            head_.append(data, n);
+            request_remaining_ -= n;
+            data += n;
+            size -= n;
+        } else if (request_framing_ == framing::stream) {
+            llhttp_resume(&request_parser);
+            connection_->proxy_relay_ = true;
+            auto forwarded = relay_chunk(data, size);
+            head_.append(data, forwarded);
+            data += forwarded;
+            size -= forwarded;
+        }
+
+        // a client that sent Expect: 100-continue and none of the body waits
+        // for the 100 Continue of the upstream
+        if (request_framing_ != framing::none && head_.size() == head_size) {
+            for (auto &[field, value] : connection_->ctx_.request().headers())
+                if (proxy_route::iequals(field, "expect") &&
+                    proxy_route::iequals(value, "100-continue"))
+                    body_pending_ = true;
+        }
+
+        // whatever follows the request belongs to a pipelined request
+        leftover_ = data;
+        leftover_size_ = size;
+
+        upstream_socket_ = route_.pool().take_idle(*upstream_);
+        if (upstream_socket_) {
+            send_head();
+            return;
+        }
+
+        upstream_socket_ =
+            std::make_unique<tcp::socket>(connection_->socket().get_executor());
+        upstream_->resolve(
+            connection_->socket().get_executor(),
+            [self = boost::intrusive_ptr(this)](const boost::system::error_code &ec,
+                                                upstream::endpoints_type endpoints) {
+                if (ec) {
+                    self->bad_gateway();
+                    return;
+                }
+                boost::asio::async_connect(
+                    *self->upstream_socket_, endpoints,
+                    [self](const boost::system::error_code &ec, const tcp::endpoint &) {
+                        if (ec) {
+                            self->bad_gateway();
+                            return;
+                        }
+                        self->upstream_socket_->set_option(tcp::no_delay(true));
+                        self->send_head();
+                    });
+            });
+    }
+
+    // feeds the client parser with a part of a chunked body and returns how many
+    // bytes belong to the current request
+    std::size_t relay_chunk(const char *data, std::size_t size) {
+        auto &request_parser = connection_->parser_;
+        auto err = llhttp_execute(&request_parser, data, size);
+        if (err == HPE_PAUSED) {
+            request_framing_ = framing::none;
+            connection_->proxy_relay_ = false;
+            return llhttp_get_error_pos(&request_parser) - data;
+        }
+        if (err != HPE_OK) {
+            request_error_ = true;
+            return 0;
+        }
+        return size;
+    }
+
+    void send_head() {
+        if (request_error_) {
+            bad_gateway();
+            return;
+        }
+        boost::asio::async_write(
+            *upstream_socket_, boost::asio::buffer(head_),
+            [self = boost::intrusive_ptr(this)](const boost::system::error_code &ec,
+                                                std::size_t) {
+                if (ec) {
+                    self->bad_gateway();
+                    return;
+                }
+                if (self->body_pending_)
+                    self->await_continue();
+                else
+                    self->send_body();
+            });
+    }
+
+    // reads the answer to Expect: 100-continue. An upstream that ignores it
+    // gets the body after a second, as clients do
+    void await_continue() {
+        continue_timer_.expires_after(std::chrono::seconds{1});
+        continue_timer_.async_wait(
+            [self = boost::intrusive_ptr(this)](const boost::system::error_code &ec) {
+                if (ec || !self->body_pending_)
+                    return;
+                self->continue_timeout_ = true;
+                self->upstream_socket_->cancel();
+            });
+        read_response();
+    }
+
+    // the body waits no longer once a 100 Continue is relayed or the wait
+    // ends, the client is then told to continue by the proxy
+    void release_body() {
+        if (!body_pending_ || !(continued_ || continue_timeout_)) {
+            read_response();
+            return;
+        }
+        body_pending_ = false;
+        continue_timer_.cancel();
+        if (continued_ || !relay_interim_) {
+            send_body();
+            return;
+        }
+        head_.assign("HTTP/1.1 100 Continue\r\n\r\n");
+        write_to_client([](proxy_session &s) { s.send_body(); });
+    }
+
+    void send_body() {
+        if (request_framing_ == framing::length && request_remaining_) {
+            relay(connection_->socket(), *upstream_socket_, request_remaining_,
+                  [self = boost::intrusive_ptr(this)](bool ok) {
+                      if (!ok) {
+                          self->abort();
+                          return;
+                      }
+                      self->read_response();
+                  });
+            return;
+        }
+
+        if (request_framing_ == framing::stream) {
+            auto &buffer = connection_->buffer_;
+            connection_->socket().async_read_some(
+                boost::asio::buffer(buffer),
+                [self = boost::intrusive_ptr(this)](const boost::system::error_code &ec,
+                                                    std::size_t n) {
+                    if (ec) {
+                        self->abort();
+                        return;
+                    }
+                    const char *data = self->connection_->buffer_.data();
+                    auto forwarded = self->relay_chunk(data, n);
+                    if (self->request_error_) {
+                        self->abort();
+                        return;
+                    }
+                    self->leftover_ = data + forwarded;
+                    self->leftover_size_ = n - forwarded;
+                    boost::asio::async_write(
+                        *self->upstream_socket_, boost::asio::buffer(data, forwarded),
+                        [self](const boost::system::error_code &ec, std::size_t) {
+                            if (ec) {
+                                self->abort();
+                                return;
+                            }
+                            self->send_body();
+                        });
+                });
+            return;
+        }
+
+        read_response();
+    }
+
+    void read_response() {
+        upstream_socket_->async_read_some(
+            boost::asio::buffer(buffer_),
+            [self = boost::intrusive_ptr(this)](const boost::system::error_code &ec,
+                                                std::size_t n) {
+                if (ec == boost::asio::error::operation_aborted &&
+                    self->continue_timeout_ && self->body_pending_) {
+                    self->release_body();
+                    return;
+                }
+                if (ec) {
+                    // the upstream closed a connection without framing
+                    if (ec == boost::asio::error::eof &&
+                        self->response_started_ &&
+                        llhttp_finish(&self->parser_) == HPE_OK) {
+                        self->upstream_reusable_ = false;
+                        self->client_keep_alive_ = false;
+                        self->finish();
+                        return;
+                    }
+                    self->response_started_ ? self->abort() : self->bad_gateway();
+                    return;
+                }
+                self->on_response_data(n);
+            });
+    }
+
+    void on_response_data(std::size_t n) {
+        const char *data = buffer_.data();
+        auto err = llhttp_execute(&parser_, data, n);
+
+        if (!response_started_) {
+            if (err == HPE_OK) { // head is not complete yet
+                if (interim_.empty()) {
+                    release_body();
+                    return;
+                }
+                // informational responses go to the client before the body
+                // is sent or the final response is read
+                head_ = std::move(interim_);
+                interim_.clear();
+                write_to_client([](proxy_session &s) { s.release_body(); });
+                return;
+            }
+            if (err != HPE_PAUSED) {
+                bad_gateway();
+                return;
+            }
+
+            const char *pos = llhttp_get_error_pos(&parser_);
+            response_started_ = true;
+            build_response_head();
+
+            if (message_complete_) {
+                upstream_reusable_ &= pos - data == static_cast<std::ptrdiff_t>(n);
+                write_to_client([](proxy_session &s) { s.finish(); });
+                return;
+            }
+
+            if ((parser_.flags & F_CONTENT_LENGTH) && !(parser_.flags & F_CHUNKED)) {
+                std::size_t available = n - (pos - data);
+                std::size_t body = std::min<std::size_t>(available, parser_.content_length);
+                response_remaining_ = parser_.content_length - body;
+                upstream_reusable_ &= available == body;
+                head_.append(pos, body);
+                write_to_client([](proxy_session &s) {
+                    if (!s.response_remaining_) {
+                        s.finish();
+                        return;
+                    }
+                    s.relay(*s.upstream_socket_, s.connection_->socket(),
+                            s.response_remaining_,
+                            [self = boost::intrusive_ptr(&s)](bool ok) {
+                                ok ? self->finish() : self->abort();
+                            });
+                });
+                return;
+            }
+
+            // chunked or close-delimited body, stream it through the parser
+            llhttp_resume(&parser_);
+            std::size_t consumed = pos - data;
+            std::size_t remaining = n - consumed;
+            auto e = llhttp_execute(&parser_, pos, remaining);
+            std::size_t forwarded = remaining;
+            if (e == HPE_PAUSED) {
+                forwarded = llhttp_get_error_pos(&parser_) - pos;
+                upstream_reusable_ &= forwarded == remaining;
+            } else if (e != HPE_OK) {
+                abort();
+                return;
+            }
+            head_.append(pos, forwarded);
+            write_to_client([](proxy_session &s) { s.continue_stream(); });
+            return;
+        }
+
+        // streamed body
+        std::size_t forwarded = n;
+        if (err == HPE_PAUSED) {
+            forwarded = llhttp_get_error_pos(&parser_) - data;
+            upstream_reusable_ &= forwarded == n;
+        } else if (err != HPE_OK) {
+            abort();
+            return;
+        }
+        head_.assign(data, forwarded);
+        write_to_client([](proxy_session &s) { s.continue_stream(); });
+    }
+
+    void continue_stream() { message_complete_ ? finish() : read_response(); }
+
+    // writes the pending responses of the client connection followed by head_
+    template <class Next> void write_to_client(Next next) {
+        auto &pending = connection_->response_;
+        std::array<boost::asio::const_buffer, 2> buffers{
+            boost::asio::buffer(pending), boost::asio::buffer(head_)};
+        boost::asio::async_write(
+            connection_->socket(), buffers,
+            [self = boost::intrusive_ptr(this), next](const boost::system::error_code &ec,
+                                                      std::size_t) {
+                if (ec) {
+                    self->abort();
+                    return;
+                }
+                self->connection_->response_.clear();
+                next(*self);
+            });
+    }
+
+    // the status line and the end to end headers of the response parsed
+    void append_response_head(std::string &out) {
+        out.append("HTTP/1.1 ");
+        out.append(std::to_string(parser_.status_code));
+        out.push_back(' ');
+        out.append(reason_);
+        out.append("\r\n");
+
+        for (auto &[field, value] : headers_) {
+            if (proxy_route::is_hop_by_hop(field))
+                continue;
+            out.append(field);
+            out.push_back(':');
+            out.append(value);
+            out.append("\r\n");
+        }
+    }
+
+    // the final response, after the informational ones not relayed yet
+    void build_response_head() {
+        head_ = std::move(interim_);
+        interim_.clear();
+        append_response_head(head_);
+
+        upstream_reusable_ = llhttp_should_keep_alive(&parser_);
+
+        // the upstream answered without the body of Expect: 100-continue,
+        // which is never sent: both connections are closed after the response
+        if (body_pending_) {
+            body_pending_ = false;
+            continue_timer_.cancel();
+            upstream_reusable_ = false;
+            client_keep_alive_ = false;
+        }
+
+        // a body delimited by the end of the connection can only be relayed to
+        // the client in the same way
+        if (!message_complete_ && llhttp_message_needs_eof(&parser_))
+            client_keep_alive_ = false;
+
+        if (!client_keep_alive_)
+            head_.append("Connection:close\r\n");
+        head_.append("\r\n");
+    }
+
+    // moves exactly `size` bytes from one socket to the other through a pipe
+    template <class Handler>
+    void relay(tcp::socket &from, tcp::socket &to, std::size_t size,
+               Handler handler) {
+        if (!pipe_ && route_.zero_copy_)
+            pipe_ = detail::splice_pipe::acquire();
+
+        if (!pipe_) {
+            copy(from, to, size, std::move(handler));
+            return;
+        }
+
+        from.non_blocking(true);
+        to.non_blocking(true);
+        splice_step(from, to, size, std::move(handler));
+    }
+
+    template <class Handler>
+    void splice_step(tcp::socket &from, tcp::socket &to, std::size_t remaining,
+                     Handler handler) {
+        constexpr std::size_t max_chunk = 64 * 1024;
+
+        while (remaining || pipe_.pending) {
+            if (remaining) {
+                auto n = ::splice(from.native_handle(), nullptr, pipe_.write_fd,
+                                  nullptr, std::min(remaining, max_chunk),
+                                  SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+                if (n > 0) {
+                    remaining -= n;
+                    pipe_.pending += n;
+                } else if (n == 0) {
+                    handler(false);
+                    return;
+                } else if (errno == EINVAL && !pipe_.pending) {
+                    // splice is not supported for these descriptors
+                    detail::splice_pipe::release(pipe_);
+                    copy(from, to, remaining, std::move(handler));
+                    return;
+                } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    handler(false);
+                    return;
+                } else if (!pipe_.pending) {
+                    from.async_wait(
+                        tcp::socket::wait_read,
+                        [self = boost::intrusive_ptr(this), &from, &to, remaining,
+                         handler](const boost::system::error_code &ec) mutable {
+                            if (ec) {
+                                handler(false);
+                                return;
+                            }
+                            self->splice_step(from, to, remaining, std::move(handler));
+                        });
+                    return;
+                }
+            }
+
+            if (pipe_.pending) {
+                auto n = ::splice(pipe_.read_fd, nullptr, to.native_handle(), nullptr,
+                                  pipe_.pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+                if (n > 0) {
+                    pipe_.pending -= n;
+                } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    to.async_wait(
+                        tcp::socket::wait_write,
+                        [self = boost::intrusive_ptr(this), &from, &to, remaining,
+                         handler](const boost::system::error_code &ec) mutable {
+                            if (ec) {
+                                handler(false);
+                                return;
+                            }
+                            self->splice_step(from, to, remaining, std::move(handler));
+                        });
+                    return;
+                } else {
+                    handler(false);
+                    return;
+                }
+            }
+        }
+        handler(true);
+    }
+
+    // fallback when splice(2) cannot be used
+    template <class Handler>
+    void copy(tcp::socket &from, tcp::socket &to, std::size_t remaining,
+              Handler handler) {
+        if (!remaining) {
+            handler(true);
+            return;
+        }
+        from.async_read_some(
+            boost::asio::buffer(buffer_.data(), std::min(remaining, buffer_.size())),
+            [self = boost::intrusive_ptr(this), &from, &to, remaining,
+             handler](const boost::system::error_code &ec, std::size_t n) mutable {
+                if (ec) {
+                    handler(false);
+                    return;
+                }
+                boost::asio::async_write(
+                    to, boost::asio::buffer(self->buffer_.data(), n),
+                    [self, &from, &to, remaining, n,
+                     handler](const boost::system::error_code &ec, std::size_t) mutable {
+                        if (ec) {
+                            handler(false);
+                            return;
+                        }
+                        self->copy(from, to, remaining - n, std::move(handler));
+                    });
+            });
+    }
+
+    void finish() {
+        continue_timer_.cancel();
+        if (upstream_reusable_ && upstream_socket_->is_open())
+            route_.pool().put_idle(*upstream_, std::move(upstream_socket_));
+        connection_->proxy_complete(client_keep_alive_, leftover_, leftover_size_);
+    }
+
+    // the upstream could not be reached or answered with garbage
+    void bad_gateway() {
+        head_.clear();
+        head_.append("HTTP/1.1 502 Bad Gateway\r\nContent-Length:0\r\n"
+                     "Connection:close\r\n\r\n");
+        write_to_client([](proxy_session &s) { s.abort(); });
+    }
+
+    void abort() {
+        continue_timer_.cancel();
+        upstream_reusable_ = false;
+        connection_->proxy_complete(false, nullptr, 0);
+    }
+
+    // response parser callbacks
+
+    static int on_status(llhttp_t *p, const unsigned char *at, std::size_t length) {
+        static_cast<proxy_session *>(p->data)->reason_.append(
+            reinterpret_cast<const char *>(at), length);
+        return HPE_OK;
+    }
+
+    static int on_header_field(llhttp_t *p, const unsigned char *at,
+                               std::size_t length) {
+        auto *self = static_cast<proxy_session *>(p->data);
+        if (!self->in_field_) {
+            self->headers_.emplace_back();
+            self->in_field_ = true;
+        }
+        self->headers_.back().first.append(reinterpret_cast<const char *>(at),
+                                           length);
+        return HPE_OK;
+    }
+
+    static int on_header_value(llhttp_t *p, const unsigned char *at,
+                               std::size_t length) {
+        auto *self = static_cast<proxy_session *>(p->data);
+        self->in_field_ = false;
+        self->headers_.back().second.append(reinterpret_cast<const char *>(at),
+                                            length);
+        return HPE_OK;
+    }
+
+    static int on_headers_complete(llhttp_t *p) {
+        auto *self = static_cast<proxy_session *>(p->data);
+
+        // informational responses have no body, parsing goes on with the
+        // next response
+        if (p->status_code / 100 == 1 && p->status_code != 101) {
+            self->continued_ |= p->status_code == 100;
+            if (self->relay_interim_) {
+                self->append_response_head(self->interim_);
+                self->interim_.append("\r\n");
+            }
+            self->reason_.clear();
+            self->headers_.clear();
+            self->in_field_ = false;
+            self->interim_message_ = true;
+            return HPE_OK;
+        }
+
+        // a response to HEAD has no body whatever its headers say
+        if (self->head_request_)
+            return 1;
+        return HPE_PAUSED;
+    }
+
+    static int on_message_complete(llhttp_t *p) {
+        auto *self = static_cast<proxy_session *>(p->data);
+        if (self->interim_message_) {
+            self->interim_message_ = false;
+            return HPE_OK;
+        }
+        self->message_complete_ = true;
+        return HPE_PAUSED;
+    }
+
+    static constexpr llhttp_settings_t settings_{
+        nullptr, // on_message_begin
+        nullptr, // on_url
+        on_status,       on_header_field, on_header_value, on_headers_complete,
+        nullptr, // on_body
+        on_message_complete,
+        nullptr, // on_chunk_header
+        nullptr, // on_chunk_complete
+        nullptr, // on_url_complete
+        nullptr, // on_status_complete
+        nullptr, // on_header_field_complete
+        nullptr, // on_header_value_complete
+    };
+
+    boost::intrusive_ptr<Connection> connection_;
+    proxy_route &route_;
+    upstream *upstream_{nullptr};
+    upstream_pool::socket_ptr upstream_socket_;
+    detail::splice_pipe pipe_{};
+
+    llhttp_t parser_{};
+    std::string reason_;
+    std::vector<std::pair<std::string, std::string>> headers_;
+    bool in_field_{false};
+
+    std::string head_;
+    std::string interim_;
+    const char *leftover_{nullptr};
+    std::size_t leftover_size_{0};
+
+    framing request_framing_{framing::none};
+    std::size_t request_remaining_{0};
+    std::size_t response_remaining_{0};
+
+    bool client_keep_alive_{true};
+    bool head_request_{false};
+    bool request_error_{false};
+    bool response_started_{false};
+    bool message_complete_{false};
+    bool upstream_reusable_{false};
+
+    // Expect: 100-continue
+    boost::asio::steady_timer continue_timer_;
+    bool body_pending_{false};
+    bool continued_{false};
+    bool continue_timeout_{false};
+    bool relay_interim_{true};
+    bool interim_message_{false};
+
+    std::size_t ref_count_{0};
+    std::array<char, 16 * 1024> buffer_;
+};
+
+} // namespace scymnus
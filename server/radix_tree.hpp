@@ -0,0 +1,582 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "core/uuid.hpp"
+#include "server/http_context.hpp"
+#include "utilities/regex_dfa.hpp"
+#include "utilities/utils.hpp"
+
+namespace scymnus {
+
+// Routes of all methods are kept in a single radix tree. Static text is
+// compressed character by character (a node label may span several segments or
+// end in the middle of one) and typed segments (:I, :L, :U, :D, :G, :E(...),
+// :S, :R(...), :*) are children of the node ending with the preceding '/'. The
+// segments matched by typed children are captured for the path parameters.
+// Routes are added to a builder and the tree is compiled by seal() into a
+// route_table, a flat array: the children of a node are contiguous, the static
+// ones sorted by their first byte followed by the typed ones in matching
+// priority, and all labels share a single string. A static child is selected by
+// searching its first byte among the first bytes of the node's static children.
+// The pattern of a :R(...) segment is compiled into a DFA when the route is
+// added. A node ending a route refers to a route entry holding a bitmap of the
+// methods with a handler, the handlers in method order and the value of the
+// Allow header.
+
+using callable_t = std::function<void(context &)>;
+
+enum class FragmentType : uint8_t {
+    Simple,       // just a path segment
+    Integer,      //:I
+    Double,       //:D
+    String,       //:S
+    Regexp,       //:R
+    PathWildCard, // denoted as *
+    Int64,        //:L
+    Unsigned,     //:U
+    Uuid,         //:G
+    Enumeration   //:E(first|second|...)
+};
+
+inline std::string to_string(FragmentType name) {
+    if (name == FragmentType::Simple)
+        return "Simple";
+    else if (name == FragmentType::Double)
+        return "double";
+    else if (name == FragmentType::Regexp)
+        return "Regexp";
+    else if (name == FragmentType::String)
+        return "String";
+    else if (name == FragmentType::Integer)
+        return "Integer";
+    else if (name == FragmentType::PathWildCard)
+        return "PathWildCard";
+    else if (name == FragmentType::Int64)
+        return "Int64";
+    else if (name == FragmentType::Unsigned)
+        return "Unsigned";
+    else if (name == FragmentType::Uuid)
+        return "Uuid";
+    else if (name == FragmentType::Enumeration)
+        return "Enumeration";
+    else
+        return "Unknown";
+}
+
+// typed children are tried from the most to the least specific type
+constexpr int match_priority(FragmentType type) {
+    switch (type) {
+    case FragmentType::Enumeration:
+        return 0;
+    case FragmentType::Uuid:
+        return 1;
+    case FragmentType::Unsigned:
+        return 2;
+    case FragmentType::Integer:
+        return 3;
+    case FragmentType::Int64:
+        return 4;
+    case FragmentType::Double:
+        return 5;
+    case FragmentType::Regexp:
+        return 6;
+    case FragmentType::String:
+        return 7;
+    default:
+        return 8;
+    }
+}
+
+// validates a non empty segment, pattern holds the values of an enumeration.
+// Regular expressions are matched by the automaton of their node
+inline bool valid_segment(FragmentType type, std::string_view segment,
+                          std::string_view pattern) {
+    switch (type) {
+    case FragmentType::Integer: {
+        int32_t v;
+        return utils::parse_number(segment, v);
+    }
+    case FragmentType::Int64: {
+        int64_t v;
+        return utils::parse_number(segment, v);
+    }
+    case FragmentType::Unsigned: {
+        uint64_t v;
+        return utils::parse_number(segment, v);
+    }
+    case FragmentType::Double: {
+        double v;
+        return utils::parse_number(segment, v);
+    }
+    case FragmentType::Uuid:
+        return uuid::valid(segment);
+    case FragmentType::Enumeration:
+        while (!pattern.empty()) {
+            auto end = pattern.find('|');
+            if (pattern.substr(0, end) == segment)
+                return true;
+            pattern = end == std::string_view::npos ? std::string_view{}
+                                                    : pattern.substr(end + 1);
+        }
+        return false;
+    default:
+        return true;
+    }
+}
+
+// the compiled routes, immutable once built by radix_tree::seal(). Tables
+// are shared by the threads serving requests, a table built after a change of
+// the routes replaces the previous one
+class route_table {
+public:
+    static constexpr std::size_t method_count =
+        static_cast<std::size_t>(http_method::ENUM_MEMBERS_COUNT);
+    static_assert(method_count <= 64, "the methods of a route are kept in a 64 bit mask");
+
+    struct route {
+        uint64_t methods{0};  // bit m is set when method m has a handler
+        uint32_t handlers{0}; // offset in table_ of the handler of the first method
+        std::string allow{};  // value of the Allow header
+    };
+
+    /// the route matching path with a handler for method (or GET for HEAD).
+    /// Static text is preferred to typed segments, which are tried from the
+    /// most specific type (:E, :G, :U, :I, :L, :D, :R, :S, :*). The segments
+    /// of the typed children are captured. When no route has a handler for
+    /// method the first route matching path is returned, without captures,
+    /// and when no route matches path a route without methods. path has to
+    /// be normalized, as context::path() is
+    const route &match(std::string_view path, http_method method,
+                       path_captures &captures) const {
+        uint64_t mask = bit(method);
+        if (method == http_method::HEAD)
+            mask |= bit(http_method::GET);
+
+        uint32_t first = 0;
+        captures.clear();
+        auto r = match(0, path, mask, captures, first);
+        if (!r)
+            captures.clear();
+        return routes_[r ? r : first];
+    }
+
+    /// the methods of every route matching path, for the Allow header of a
+    /// request that match() found no handler for
+    uint64_t methods(std::string_view path) const {
+        path_captures captures;
+        uint32_t first = 0;
+        uint64_t seen = 0;
+        match(0, path, 0, captures, first, &seen);
+        return seen;
+    }
+
+    /// the methods of all the routes, for OPTIONS *
+    uint64_t methods() const {
+        uint64_t all = 0;
+        for (auto &r : routes_)
+            all |= r.methods;
+        return all;
+    }
+
+    /// the handler of r for method, the one of GET when there is no handler
+    /// for HEAD. Null when there is none
+    const callable_t *handler(const route &r, http_method method) const {
+        auto b = bit(method);
+        if (!(r.methods & b)) {
+            if (method != http_method::HEAD || !(r.methods & bit(http_method::GET)))
+                return nullptr;
+            b = bit(http_method::GET);
+        }
+        return handlers_[table_[r.handlers + std::popcount(r.methods & (b - 1))]].get();
+    }
+
+    /// number of nodes of the tree
+    std::size_t size() const { return nodes_.size(); }
+
+    /// the value of the Allow header of a route with the handlers of
+    /// methods, HEAD being answered by GET and OPTIONS always
+    static std::string allow(uint64_t methods) {
+        auto with_head = methods | bit(http_method::OPTIONS);
+        if (methods & bit(http_method::GET))
+            with_head |= bit(http_method::HEAD);
+        std::string value;
+        for (std::size_t m = 0; m < method_count; ++m) {
+            if (!(with_head & (uint64_t{1} << m)))
+                continue;
+            if (!value.empty())
+                value.append(", ");
+            // method names are upper case on the wire
+            for (unsigned char c : to_string(static_cast<http_method>(m)))
+                value.push_back(static_cast<char>(std::toupper(c)));
+        }
+        return value;
+    }
+
+    static constexpr uint64_t bit(http_method method) {
+        return uint64_t{1} << static_cast<std::size_t>(method);
+    }
+
+private:
+    friend class radix_tree;
+
+    struct node {
+        uint32_t label{0};    // offset in labels_, of the pattern for typed nodes
+                              // and the index in regexes_ for :R(...) nodes
+        uint32_t children{0}; // first child in nodes_
+        uint32_t dispatch{0}; // offset of the first bytes of the static children
+        uint32_t route{0};    // index in routes_, 0 when the node is not a route
+        uint64_t methods{0};  // methods of the route, copied to avoid a lookup
+        uint16_t label_size{0};
+        uint16_t static_count{0};
+        uint8_t typed_count{0};
+        FragmentType type{FragmentType::Simple};
+    };
+
+    // the label of n has been matched, rest is what follows it. Returns the
+    // route having a method of mask, first is set to the first route
+    // matching the path and the methods of the routes tried are added to
+    // seen. With an empty mask every route matching the path is tried
+    uint32_t match(uint32_t n, std::string_view rest, uint64_t mask,
+                   path_captures &captures, uint32_t &first,
+                   uint64_t *seen = nullptr) const {
+        auto &current = nodes_[n];
+        if (rest.empty())
+            return accept(current, mask, first, seen);
+
+        if (current.static_count) {
+            auto bytes = dispatch_.data() + current.dispatch;
+            if (auto found = static_cast<const char *>(
+                    std::memchr(bytes, rest[0], current.static_count))) {
+                auto c = current.children + static_cast<uint32_t>(found - bytes);
+                auto &child = nodes_[c];
+                std::string_view label{labels_.data() + child.label, child.label_size};
+                if (rest.starts_with(label))
+                    if (auto r = match(c, rest.substr(label.size()), mask, captures, first,
+                                       seen))
+                        return r;
+            }
+        }
+
+        if (!current.typed_count)
+            return 0;
+
+        auto segment = rest.substr(0, utils::simd::find(rest, '/'));
+        auto end = current.children + current.static_count + current.typed_count;
+        for (auto c = current.children + current.static_count; c != end; ++c) {
+            auto &child = nodes_[c];
+            if (child.type == FragmentType::PathWildCard) {
+                if (!accept(child, mask, first, seen))
+                    continue;
+                captures.push(rest);
+                return child.route;
+            }
+
+            if (segment.empty())
+                continue;
+            if (child.type == FragmentType::Regexp) {
+                if (!regexes_[child.label].match(segment))
+                    continue;
+            } else {
+                std::string_view pattern{labels_.data() + child.label, child.label_size};
+                if (!valid_segment(child.type, segment, pattern))
+                    continue;
+            }
+
+            captures.push(segment);
+            if (auto r =
+                    match(c, rest.substr(segment.size()), mask, captures, first, seen))
+                return r;
+            --captures.size;
+        }
+        return 0;
+    }
+
+    static uint32_t accept(const node &n, uint64_t mask, uint32_t &first,
+                           uint64_t *seen) {
+        if (!n.route)
+            return 0;
+        if (!first)
+            first = n.route;
+        if (seen)
+            *seen |= n.methods;
+        return n.methods & mask ? n.route : 0;
+    }
+
+    std::vector<node> nodes_;
+    std::string labels_;
+    std::string dispatch_;
+    std::vector<route> routes_;
+    std::vector<uint32_t> table_; // indices in handlers_
+    std::vector<std::shared_ptr<const callable_t>> handlers_;
+    std::vector<utils::regex_dfa> regexes_;
+};
+
+// routes are added to the tree, which is compiled into a route_table by seal()
+class radix_tree {
+public:
+    using route = route_table::route;
+    static constexpr std::size_t method_count = route_table::method_count;
+
+    radix_tree() {
+        builder_.emplace_back();
+        route_builder_.emplace_back();
+    }
+
+    radix_tree(const radix_tree &) = delete;
+    radix_tree &operator=(const radix_tree &) = delete;
+
+    /// adds the handler of method for a route, e.g. "/points/:I". Empty
+    /// segments are ignored and a route that already has a handler for method
+    /// gets the new one. Routes are part of the tables compiled by seal()
+    void add(std::string_view url, http_method method, callable_t handler) {
+        uint32_t current = 0;
+        std::size_t parameters = 0;
+        std::string text{"/"};
+
+        auto flush = [&]() {
+            if (!text.empty())
+                current = insert_static(current, text);
+            text.clear();
+        };
+
+        std::size_t start = url.find_first_not_of('/');
+        while (start != std::string_view::npos) {
+            auto end = url.find('/', start);
+            auto part = url.substr(start, end == std::string_view::npos
+                                              ? std::string_view::npos
+                                              : end - start);
+            start = url.find_first_not_of('/', end);
+
+            FragmentType type = parse_type(part);
+            if (type == FragmentType::Simple) {
+                text.append(part);
+            } else {
+                flush();
+                if (++parameters > path_captures::capacity)
+                    throw std::invalid_argument("too many path parameters");
+                std::string pattern;
+                if (type == FragmentType::Regexp || type == FragmentType::Enumeration)
+                    pattern = std::string(part.substr(3, part.size() - 4));
+                current = insert_typed(current, type, std::move(pattern));
+
+                // PathWildCard is considered as being the last segment of the url
+                if (type == FragmentType::PathWildCard)
+                    break;
+            }
+
+            if (start != std::string_view::npos)
+                text.push_back('/');
+        }
+        flush();
+
+        auto &n = builder_[current];
+        if (!n.route) {
+            n.route = static_cast<uint32_t>(route_builder_.size());
+            route_builder_.emplace_back();
+        }
+        auto &slot = route_builder_[n.route][static_cast<std::size_t>(method)];
+        auto shared = std::make_shared<const callable_t>(std::move(handler));
+        if (slot)
+            handlers_[slot - 1] = std::move(shared);
+        else {
+            handlers_.push_back(std::move(shared));
+            slot = static_cast<uint32_t>(handlers_.size());
+        }
+    }
+
+    /// compiles the routes added so far. Handlers are shared with the
+    /// previous tables
+    std::shared_ptr<const route_table> seal() const {
+        auto t = std::make_shared<route_table>();
+        t->handlers_ = handlers_;
+        t->regexes_ = regexes_;
+        // route 0 is returned when nothing matches
+        t->routes_.emplace_back();
+
+        // breadth first, so that the children of each node are contiguous
+        std::deque<std::pair<uint32_t, uint32_t>> pending{{0, 0}};
+        t->nodes_.emplace_back();
+        while (!pending.empty()) {
+            auto [from, to] = pending.front();
+            pending.pop_front();
+
+            auto &b = builder_[from];
+            std::vector<uint32_t> children = b.children;
+            std::sort(children.begin(), children.end(), [this](auto l, auto r) {
+                return builder_[l].label[0] < builder_[r].label[0];
+            });
+
+            route_table::node n;
+            if (b.type == FragmentType::Regexp)
+                n.label = b.regex;
+            else {
+                // typed nodes have no label, the field holds their pattern
+                auto &label = b.type == FragmentType::Simple ? b.label : b.pattern;
+                n.label = static_cast<uint32_t>(t->labels_.size());
+                n.label_size = static_cast<uint16_t>(label.size());
+                t->labels_.append(label);
+            }
+            n.type = b.type;
+            if (b.route) {
+                n.route = compile_route(*t, route_builder_[b.route]);
+                n.methods = t->routes_[n.route].methods;
+            }
+            n.children = static_cast<uint32_t>(t->nodes_.size());
+            n.static_count = static_cast<uint16_t>(children.size());
+            n.dispatch = static_cast<uint32_t>(t->dispatch_.size());
+
+            for (auto c : children) {
+                t->dispatch_.push_back(builder_[c].label[0]);
+                pending.emplace_back(c, static_cast<uint32_t>(t->nodes_.size()));
+                t->nodes_.emplace_back();
+            }
+            for (auto c : b.typed) {
+                ++n.typed_count;
+                pending.emplace_back(c, static_cast<uint32_t>(t->nodes_.size()));
+                t->nodes_.emplace_back();
+            }
+            t->nodes_[to] = n;
+        }
+        return t;
+    }
+
+private:
+    struct build_node {
+        std::string label;
+        FragmentType type{FragmentType::Simple};
+        std::string pattern;
+        std::vector<uint32_t> children;
+        // typed children, sorted by match_priority
+        std::vector<uint32_t> typed;
+        uint32_t route{0}; // index in route_builder_, 0 when not a route
+        uint32_t regex{0}; // index in regexes_ of a :R(...) node
+    };
+
+    // index + 1 in handlers_ of the handler of each method
+    using method_handlers = std::array<uint32_t, method_count>;
+
+    static FragmentType parse_type(std::string_view part) {
+        if (part.starts_with(":*"))
+            return FragmentType::PathWildCard;
+        if (part.starts_with(":R(") && part.back() == ')')
+            return FragmentType::Regexp;
+        if (part.starts_with(":E(") && part.back() == ')')
+            return FragmentType::Enumeration;
+        if (part.starts_with(":L"))
+            return FragmentType::Int64;
+        if (part.starts_with(":U"))
+            return FragmentType::Unsigned;
+        if (part.starts_with(":G"))
+            return FragmentType::Uuid;
+        if (part.starts_with(":S"))
+            return FragmentType::String;
+        if (part.starts_with(":D"))
+            return FragmentType::Double;
+        if (part.starts_with(":I"))
+            return FragmentType::Integer;
+        return FragmentType::Simple;
+    }
+
+    uint32_t new_node(std::string label, FragmentType type = FragmentType::Simple) {
+        builder_.emplace_back();
+        builder_.back().label = std::move(label);
+        builder_.back().type = type;
+        return static_cast<uint32_t>(builder_.size() - 1);
+    }
+
+    uint32_t insert_static(uint32_t current, std::string_view text) {
+        while (!text.empty()) {
+            auto &children = builder_[current].children;
+            auto it = std::find_if(children.begin(), children.end(), [&](auto c) {
+                return builder_[c].label[0] == text[0];
+            });
+
+            if (it == children.end()) {
+                auto n = new_node(std::string(text));
+                builder_[current].children.push_back(n);
+                return n;
+            }
+
+            auto child = *it;
+            std::string_view label = builder_[child].label;
+            std::size_t common = 0;
+            while (common < label.size() && common < text.size() &&
+                   label[common] == text[common])
+                ++common;
+
+            if (common < label.size()) {
+                // split the child, its data stays with the lower part
+                auto mid = new_node(std::string(label.substr(0, common)));
+                builder_[child].label.erase(0, common);
+                builder_[mid].children.push_back(child);
+                *std::find(builder_[current].children.begin(),
+                           builder_[current].children.end(), child) = mid;
+                child = mid;
+            }
+
+            current = child;
+            text.remove_prefix(common);
+        }
+        return current;
+    }
+
+    uint32_t insert_typed(uint32_t current, FragmentType type, std::string pattern) {
+        for (auto c : builder_[current].typed)
+            if (builder_[c].type == type && builder_[c].pattern == pattern)
+                return c;
+
+        uint32_t regex = 0;
+        if (type == FragmentType::Regexp) {
+            regex = static_cast<uint32_t>(regexes_.size());
+            regexes_.emplace_back(pattern);
+        }
+
+        auto n = new_node({}, type);
+        builder_[n].pattern = std::move(pattern);
+        builder_[n].regex = regex;
+        auto &typed = builder_[current].typed;
+        typed.insert(std::upper_bound(typed.begin(), typed.end(), type,
+                                      [this](FragmentType t, uint32_t c) {
+                                          return match_priority(t) <
+                                                 match_priority(builder_[c].type);
+                                      }),
+                     n);
+        return n;
+    }
+
+    static uint32_t compile_route(route_table &t, const method_handlers &handlers) {
+        route r;
+        r.handlers = static_cast<uint32_t>(t.table_.size());
+        for (std::size_t m = 0; m < method_count; ++m) {
+            if (!handlers[m])
+                continue;
+            r.methods |= uint64_t{1} << m;
+            t.table_.push_back(handlers[m] - 1);
+        }
+
+        r.allow = route_table::allow(r.methods);
+        t.routes_.push_back(std::move(r));
+        return static_cast<uint32_t>(t.routes_.size() - 1);
+    }
+
+    std::vector<build_node> builder_;
+    std::vector<method_handlers> route_builder_;
+    std::vector<std::shared_ptr<const callable_t>> handlers_;
+    std::vector<utils::regex_dfa> regexes_;
+};
+
+} // namespace scymnus
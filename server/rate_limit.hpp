@@ -0,0 +1,251 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+
+#include "external/decimal_from.hpp"
+#include "server/http_context.hpp"
+#include "server/router.hpp"
+#include "server/settings.hpp"
+
+namespace scymnus {
+
+// REF: https://en.wikipedia.org/wiki/Generic_cell_rate_algorithm
+// Token buckets are implemented as GCRA: the state of a bucket is a single
+// "theoretical arrival time" (tat), the time the bucket will be full again.
+// Buckets live in fixed size open addressing tables, one per shard, and each
+// thread updates the buckets of the shard assigned to it. The debt of a key
+// (tat - now) is the sum of its debts on all shards. The other shards are read
+// without locks and their sum is cached for a short period, so the limit of a
+// key is exact while its requests are served by a single worker and
+// approximate when they are spread across workers.
+// Idle buckets expire after a ttl and their slots are reused.
+
+namespace detail {
+
+inline std::size_t thread_shard_index() {
+    static std::atomic<std::size_t> next{0};
+    thread_local std::size_t index = next.fetch_add(1, std::memory_order_relaxed);
+    return index;
+}
+
+} // namespace detail
+
+class rate_limiter {
+public:
+    using clock = std::chrono::steady_clock;
+
+    struct decision {
+        bool allowed;
+        // time until the next request of the key will be allowed
+        std::chrono::nanoseconds retry_after;
+    };
+
+    /// rate in requests per second, burst is the size of the bucket
+    rate_limiter(double rate, uint32_t burst, std::size_t shards,
+                 std::size_t capacity = 16384)
+        : interval_{static_cast<int64_t>(1e9 / rate)},
+          tolerance_{interval_ * (std::max<uint32_t>(burst, 1) - 1)},
+          shard_count_{std::max<std::size_t>(shards, 1)},
+          capacity_{std::bit_ceil(std::max<std::size_t>(capacity, max_probes))},
+          shards_{std::make_unique<shard[]>(shard_count_)} {
+        if (!(rate > 0))
+            throw std::invalid_argument("rate limit must be positive");
+
+        for (std::size_t i = 0; i < shard_count_; ++i)
+            shards_[i].buckets = std::make_unique<bucket[]>(capacity_);
+    }
+
+    void idle_ttl(std::chrono::nanoseconds ttl) { ttl_ = ttl.count(); }
+
+    decision consume(std::string_view key) {
+        return consume(hash(key), clock::now().time_since_epoch().count());
+    }
+
+    // now in nanoseconds of the steady clock
+    decision consume(uint64_t key, int64_t now) {
+        auto &b = find_or_insert(shards_[detail::thread_shard_index() % shard_count_],
+                                 key, now);
+        b.last_seen.store(now, std::memory_order_relaxed);
+
+        if (shard_count_ > 1 &&
+            now - b.remote_checked.load(std::memory_order_relaxed) > remote_refresh)
+            refresh_remote(b, key, now);
+
+        // debts decay on every shard, so with n shards in debt a request costs
+        // n intervals for the sum to decay at the configured rate
+        auto sharers = b.remote_sharers.load(std::memory_order_relaxed);
+        int64_t remote = std::max<int64_t>(
+            b.remote_debt.load(std::memory_order_relaxed) -
+                sharers * (now - b.remote_checked.load(std::memory_order_relaxed)),
+            0);
+        int64_t shares = sharers + 1;
+        int64_t tolerance = tolerance_ * shares;
+
+        int64_t tat = b.tat.load(std::memory_order_relaxed);
+        for (;;) {
+            int64_t debt = std::max<int64_t>(tat - now, 0) + remote;
+            if (debt > tolerance)
+                return {false, std::chrono::nanoseconds{(debt - tolerance) / shares}};
+            if (b.tat.compare_exchange_weak(tat, std::max(tat, now) + interval_ * shares,
+                                            std::memory_order_relaxed))
+                return {true, std::chrono::nanoseconds{0}};
+        }
+    }
+
+    static uint64_t hash(std::string_view key) {
+        auto h = std::hash<std::string_view>{}(key);
+        // 0 marks an empty slot
+        return h ? h : 1;
+    }
+
+private:
+    static constexpr std::size_t max_probes = 8;
+    // how often the debt of a key on the other shards is read
+    static constexpr int64_t remote_refresh = 1'000'000;
+
+    struct bucket {
+        std::atomic<uint64_t> key{0};
+        // theoretical arrival time
+        std::atomic<int64_t> tat{0};
+        std::atomic<int64_t> last_seen{0};
+        // debt on the other shards and the number of them in debt
+        std::atomic<int64_t> remote_debt{0};
+        std::atomic<uint32_t> remote_sharers{0};
+        std::atomic<int64_t> remote_checked{0};
+    };
+
+    struct shard {
+        std::unique_ptr<bucket[]> buckets;
+    };
+
+    bucket *find(shard &s, uint64_t key) const {
+        for (std::size_t i = 0; i < max_probes; ++i) {
+            auto &b = s.buckets[(key + i) & (capacity_ - 1)];
+            if (b.key.load(std::memory_order_acquire) == key)
+                return &b;
+        }
+        return nullptr;
+    }
+
+    bucket &find_or_insert(shard &s, uint64_t key, int64_t now) {
+        for (;;) {
+            bucket *free = nullptr;
+            bucket *oldest = nullptr;
+
+            for (std::size_t i = 0; i < max_probes; ++i) {
+                auto &b = s.buckets[(key + i) & (capacity_ - 1)];
+                auto k = b.key.load(std::memory_order_acquire);
+                if (k == key)
+                    return b;
+
+                auto last_seen = b.last_seen.load(std::memory_order_relaxed);
+                if (!free && (k == 0 || now - last_seen > ttl_))
+                    free = &b;
+                if (!oldest || last_seen < oldest->last_seen.load(std::memory_order_relaxed))
+                    oldest = &b;
+            }
+
+            // the neighbourhood is full of active keys, the least recently
+            // seen one is evicted
+            auto &b = free ? *free : *oldest;
+            auto k = b.key.load(std::memory_order_relaxed);
+            if (!b.key.compare_exchange_strong(k, key, std::memory_order_acq_rel))
+                continue;
+
+            b.tat.store(0, std::memory_order_relaxed);
+            b.last_seen.store(now, std::memory_order_relaxed);
+            b.remote_debt.store(0, std::memory_order_relaxed);
+            b.remote_sharers.store(0, std::memory_order_relaxed);
+            b.remote_checked.store(0, std::memory_order_relaxed);
+            return b;
+        }
+    }
+
+    void refresh_remote(bucket &local, uint64_t key, int64_t now) {
+        int64_t debt = 0;
+        uint32_t sharers = 0;
+        for (std::size_t i = 0; i < shard_count_; ++i) {
+            auto *b = find(shards_[i], key);
+            if (!b || b == &local)
+                continue;
+            auto d = b->tat.load(std::memory_order_relaxed) - now;
+            if (d > 0) {
+                debt += d;
+                ++sharers;
+            }
+        }
+        local.remote_debt.store(debt, std::memory_order_relaxed);
+        local.remote_sharers.store(sharers, std::memory_order_relaxed);
+        local.remote_checked.store(now, std::memory_order_relaxed);
+    }
+
+    int64_t interval_;
+    int64_t tolerance_;
+    int64_t ttl_{60'000'000'000};
+    std::size_t shard_count_;
+    std::size_t capacity_;
+    std::unique_ptr<shard[]> shards_;
+};
+
+/// Before aspect limiting the rate of requests per client address or per
+/// value of a header (e.g. an API key). Requests over the limit get a 429
+/// response with a Retry-After header.
+struct rate_limit : aspect_base<"rate_limit"> {
+
+    /// rate in requests per second, burst is the number of requests
+    /// allowed at once
+    static rate_limit per_address(double rate, uint32_t burst) {
+        return rate_limit{rate, burst, {}};
+    }
+
+    /// requests without the header are limited per client address
+    static rate_limit per_header(std::string field, double rate, uint32_t burst) {
+        return rate_limit{rate, burst, std::move(field)};
+    }
+
+    /// buckets idle for longer than ttl are evicted
+    rate_limit &idle_ttl(std::chrono::seconds ttl) {
+        limiter_->idle_ttl(ttl);
+        return *this;
+    }
+
+    sink<"rate_limit"> operator()(context &ctx) {
+        std::string_view key = ctx.remote_address();
+        if (!field_.empty()) {
+            auto it = ctx.request().headers().find(field_);
+            if (it != ctx.request().headers().end())
+                key = it->second;
+        }
+
+        auto decision = limiter_->consume(key);
+        if (decision.allowed)
+            return {};
+
+        auto seconds =
+            std::chrono::ceil<std::chrono::seconds>(decision.retry_after).count();
+        char buff[24];
+        ctx.add_response_header(std::pmr::string{"Retry-After"},
+                                std::pmr::string{decimal_from(std::max<int64_t>(seconds, 1), buff)});
+        return ctx.write_as<http_content_type::JSON>(status<429>,
+                                                     std::string{"Too many requests"});
+    }
+
+private:
+    rate_limit(double rate, uint32_t burst, std::string field)
+        : limiter_{std::make_shared<rate_limiter>(
+              rate, burst, settings<core>()[CT_("workers")])},
+          field_{field.begin(), field.end()} {}
+
+    std::shared_ptr<rate_limiter> limiter_;
+    std::pmr::string field_;
+};
+
+} // namespace scymnus
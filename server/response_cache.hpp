@@ -0,0 +1,420 @@
+#pragma once
+
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "server/date_manager.hpp"
+#include "server/headers_container.hpp"
+#include "server/http_context.hpp"
+
+namespace scymnus {
+
+// Cache of complete serialized responses (status line, headers and body) of
+// GET routes. Entries are kept in a per worker thread shard, looked up without
+// locks, and in a shared tier that is read when a worker misses its own shard
+// and written when a response is stored. A hit copies the bytes into the
+// output buffer and only patches the Date header.
+
+/// caching options of a route, set with router_parameters::cache()
+class response_cache_policy {
+public:
+    bool enabled() const { return ttl_.count() > 0; }
+
+    std::chrono::seconds ttl() const { return ttl_; }
+
+private:
+    friend struct router_parameters;
+    friend class response_cache;
+
+    std::chrono::seconds ttl_{0};
+    // only these query parameters are part of the key, the whole query string
+    // when empty
+    std::vector<std::string> query_;
+    // request headers that are part of the key
+    std::vector<std::pmr::string> vary_;
+};
+
+class response_cache {
+public:
+    using clock = std::chrono::steady_clock;
+
+    static response_cache &instance() {
+        static response_cache instance;
+        return instance;
+    }
+
+    /// writes the cached response of the request if there is one
+    bool serve(const response_cache_policy &policy, context &ctx) {
+        auto directives = request_directives(ctx);
+        if (directives.no_store || directives.no_cache)
+            return false;
+
+        auto &key = build_key(policy, ctx);
+        auto now = clock::now();
+
+        auto &local = shard();
+        auto it = local.find(key);
+        if (it != local.end() && !usable(*it->second, now)) {
+            local.erase(it);
+            it = local.end();
+        }
+
+        if (it == local.end()) {
+            std::shared_lock lock{mutex_};
+            auto shared = shared_.find(key);
+            if (shared == shared_.end() || !usable(*shared->second, now))
+                return false;
+            it = local.emplace(key, shared->second).first;
+        }
+
+        write(*it->second, ctx);
+        return true;
+    }
+
+    // generation of the cache, taken before a handler runs so that a response
+    // computed before an invalidation is not stored
+    uint64_t generation() const { return generation_.load(std::memory_order_acquire); }
+
+    /// stores the response written by the handler, if it is cacheable
+    void store(const response_cache_policy &policy, context &ctx, uint64_t generation) {
+        // the response to a HEAD request has no body
+        if (!ctx.is_response_written() || ctx.method() == http_method::HEAD ||
+            request_directives(ctx).no_store)
+            return;
+
+        int status = ctx.response().status_code_.value_or(200);
+        if (!cacheable_status(status))
+            return;
+
+        auto ttl = response_ttl(policy, ctx);
+        if (ttl.count() <= 0)
+            return;
+
+        auto bytes = ctx.serialized_response();
+        auto head_end = bytes.find("\r\n\r\n");
+        if (head_end == std::string_view::npos)
+            return;
+        head_end += 4;
+
+        auto entry = std::make_shared<cached_response>();
+        entry->bytes = bytes;
+        entry->body_offset = head_end;
+        entry->status = status;
+        entry->expires = clock::now() + ttl;
+        entry->path = ctx.path();
+
+        // the Date header is the last one
+        auto date = date_manager::instance().get_http_time();
+        if (head_end >= date.size() &&
+            bytes.compare(head_end - date.size(), 5, "Date:") == 0) {
+            entry->date_offset = head_end - date.size();
+            entry->date_size = date.size();
+        }
+
+        auto &key = build_key(policy, ctx);
+
+        {
+            std::unique_lock lock{mutex_};
+            if (generation != generation_.load(std::memory_order_relaxed))
+                return;
+
+            if (shared_.size() >= max_entries_)
+                evict(shared_, clock::now());
+            if (shared_.size() >= max_entries_)
+                return;
+
+            auto [it, inserted] = shared_.try_emplace(key, entry);
+            if (!inserted) {
+                it->second->invalid.store(true, std::memory_order_release);
+                it->second = entry;
+            }
+        }
+
+        auto &local = shard();
+        if (local.size() >= max_entries_)
+            evict(local, clock::now());
+        if (local.size() >= max_entries_)
+            local.clear();
+        local.insert_or_assign(key, std::move(entry));
+    }
+
+    /// removes the cached responses of a path, e.g. "/points/1", for all query
+    /// strings and headers
+    void invalidate(std::string_view path) {
+        invalidate_if([path](std::string_view p) { return p == path; });
+    }
+
+    /// removes the cached responses of all paths starting with prefix
+    void invalidate_prefix(std::string_view prefix) {
+        invalidate_if([prefix](std::string_view p) { return p.starts_with(prefix); });
+    }
+
+    void clear() {
+        invalidate_if([](std::string_view) { return true; });
+    }
+
+    /// maximum number of entries of the shared tier and of each shard
+    void max_entries(std::size_t value) { max_entries_ = value; }
+
+private:
+    struct cached_response {
+        std::string bytes;
+        std::string path;
+        std::size_t body_offset{0};
+        std::size_t date_offset{std::string::npos};
+        std::size_t date_size{0};
+        int status{200};
+        clock::time_point expires;
+        // set when the entry is invalidated or replaced, shards drop it lazily
+        std::atomic<bool> invalid{false};
+    };
+
+    using entry_ptr = std::shared_ptr<cached_response>;
+
+    struct key_hash {
+        using is_transparent = void;
+        std::size_t operator()(std::string_view key) const {
+            return std::hash<std::string_view>{}(key);
+        }
+    };
+
+    using entries_t =
+        std::unordered_map<std::string, entry_ptr, key_hash, std::equal_to<>>;
+
+    struct directives {
+        bool no_store{false};
+        bool no_cache{false};
+        bool is_private{false};
+        std::optional<long> max_age;
+        std::optional<long> s_maxage;
+    };
+
+    response_cache() = default;
+    response_cache(const response_cache &) = delete;
+    response_cache &operator=(const response_cache &) = delete;
+
+    static entries_t &shard() {
+        thread_local entries_t entries;
+        return entries;
+    }
+
+    static bool usable(const cached_response &entry, clock::time_point now) {
+        return entry.expires > now && !entry.invalid.load(std::memory_order_acquire);
+    }
+
+    static void evict(entries_t &entries, clock::time_point now) {
+        std::erase_if(entries, [now](auto &e) { return !usable(*e.second, now); });
+    }
+
+    static bool cacheable_status(int status) {
+        // RFC 7231 6.1, cacheable by default
+        switch (status) {
+        case 200: case 203: case 204: case 300: case 301: case 404: case 410:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    static void write(const cached_response &entry, context &ctx) {
+        auto start = ctx.write_serialized(entry.bytes, entry.body_offset, entry.status);
+
+        if (entry.date_offset != std::string::npos) {
+            auto date = date_manager::instance().get_http_time();
+            if (date.size() == entry.date_size) {
+                auto &output = *ctx.output_buffer_;
+                std::memcpy(output.data() + start + entry.date_offset, date.data(),
+                            date.size());
+            }
+        }
+    }
+
+    static directives parse_directives(std::string_view value) {
+        directives d;
+        while (!value.empty()) {
+            auto end = value.find(',');
+            auto directive = value.substr(0, end);
+            value = end == std::string_view::npos ? std::string_view{}
+                                                  : value.substr(end + 1);
+
+            while (!directive.empty() && directive.front() == ' ')
+                directive.remove_prefix(1);
+            while (!directive.empty() && directive.back() == ' ')
+                directive.remove_suffix(1);
+
+            auto name = directive.substr(0, directive.find('='));
+            auto seconds = [&]() -> std::optional<long> {
+                if (name.size() == directive.size())
+                    return {};
+                long v = 0;
+                auto arg = directive.substr(name.size() + 1);
+                if (std::from_chars(arg.data(), arg.data() + arg.size(), v).ec != std::errc{})
+                    return {};
+                return v;
+            };
+
+            if (iequals(name, "no-store"))
+                d.no_store = true;
+            else if (iequals(name, "no-cache"))
+                d.no_cache = true;
+            else if (iequals(name, "private"))
+                d.is_private = true;
+            else if (iequals(name, "max-age"))
+                d.max_age = seconds();
+            else if (iequals(name, "s-maxage"))
+                d.s_maxage = seconds();
+        }
+        return d;
+    }
+
+    static directives request_directives(const context &ctx) {
+        static const std::pmr::string field{"Cache-Control"};
+        auto &headers = ctx.request().headers();
+        auto it = headers.find(field);
+        if (it == headers.end())
+            return {};
+        auto d = parse_directives(it->second);
+        if (d.max_age && *d.max_age == 0)
+            d.no_cache = true;
+        return d;
+    }
+
+    // s-maxage replaces the ttl of the route, max-age can only shorten it
+    static std::chrono::seconds response_ttl(const response_cache_policy &policy,
+                                             const context &ctx) {
+        static const std::pmr::string cache_control{"Cache-Control"};
+        static const std::pmr::string set_cookie{"Set-Cookie"};
+        static const std::pmr::string vary{"Vary"};
+
+        auto &headers = ctx.response().headers();
+        if (headers.count(set_cookie))
+            return std::chrono::seconds{0};
+
+        // the key only covers the headers listed in the policy
+        for (auto [it, end] = headers.equal_range(vary); it != end; ++it)
+            if (!covered(policy, it->second))
+                return std::chrono::seconds{0};
+
+        auto ttl = policy.ttl_;
+        auto it = headers.find(cache_control);
+        if (it == headers.end())
+            return ttl;
+
+        auto d = parse_directives(it->second);
+        if (d.no_store || d.no_cache || d.is_private)
+            return std::chrono::seconds{0};
+        if (d.s_maxage)
+            return std::chrono::seconds{*d.s_maxage};
+        if (d.max_age)
+            return std::min(ttl, std::chrono::seconds{*d.max_age});
+        return ttl;
+    }
+
+    static bool covered(const response_cache_policy &policy, std::string_view vary) {
+        while (!vary.empty()) {
+            auto end = vary.find(',');
+            auto field = vary.substr(0, end);
+            vary = end == std::string_view::npos ? std::string_view{}
+                                                 : vary.substr(end + 1);
+            while (!field.empty() && field.front() == ' ')
+                field.remove_prefix(1);
+            while (!field.empty() && field.back() == ' ')
+                field.remove_suffix(1);
+
+            if (field.empty())
+                continue;
+            if (field == "*")
+                return false;
+            if (std::none_of(policy.vary_.begin(), policy.vary_.end(),
+                             [&](auto &f) { return iequals(f, field); }))
+                return false;
+        }
+        return true;
+    }
+
+    // method, path, query, the negotiated format and the values of the vary
+    // headers, separated by '\n'. The method keeps the body-less responses to
+    // HEAD apart from the ones to GET
+    static const std::string &build_key(const response_cache_policy &policy,
+                                        const context &ctx) {
+        thread_local std::string key;
+        key.clear();
+
+        key.push_back(static_cast<char>(ctx.method()));
+        key.push_back('\n');
+        key.append(ctx.path());
+        key.push_back('\n');
+
+        if (auto query = ctx.query(); !query.empty()) {
+            if (policy.query_.empty())
+                key.append(query);
+            else {
+                for (auto &name : policy.query_) {
+                    append_query_values(key, query, name);
+                    key.push_back('&');
+                }
+                // the projection of model responses
+                append_query_values(key, query, "fields");
+            }
+        }
+
+        key.push_back('\n');
+        key.push_back(static_cast<char>('0' + static_cast<int>(ctx.accepted_format())));
+
+        auto &headers = ctx.request().headers();
+        for (auto &field : policy.vary_) {
+            key.push_back('\n');
+            for (auto [it, end] = headers.equal_range(field); it != end; ++it) {
+                key.append(it->second);
+                key.push_back(',');
+            }
+        }
+        return key;
+    }
+
+    static void append_query_values(std::string &key, std::string_view query,
+                                    std::string_view name) {
+        while (!query.empty()) {
+            auto end = query.find('&');
+            auto pair = query.substr(0, end);
+            query = end == std::string_view::npos ? std::string_view{}
+                                                  : query.substr(end + 1);
+            if (pair.starts_with(name) &&
+                (pair.size() == name.size() || pair[name.size()] == '=')) {
+                key.append(pair);
+                key.push_back(';');
+            }
+        }
+    }
+
+    static bool iequals(std::string_view lhs, std::string_view rhs) {
+        return utils::simd::iequals(lhs, rhs);
+    }
+
+    template <class Predicate> void invalidate_if(Predicate predicate) {
+        std::unique_lock lock{mutex_};
+        generation_.fetch_add(1, std::memory_order_acq_rel);
+        std::erase_if(shared_, [&](auto &e) {
+            if (!predicate(e.second->path))
+                return false;
+            e.second->invalid.store(true, std::memory_order_release);
+            return true;
+        });
+    }
+
+    std::shared_mutex mutex_;
+    entries_t shared_;
+    std::atomic<uint64_t> generation_{0};
+    std::size_t max_entries_{10000};
+};
+
+} // namespace scymnus
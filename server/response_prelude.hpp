@@ -0,0 +1,117 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+
+#include "http/http_common.hpp"
+#include "server/date_manager.hpp"
+
+namespace scymnus {
+
+// The head of a response is written as a prelude (status line, Content-Type
+// and Server) that is concatenated at compile time for each (status, content
+// type), the custom headers, the Content-Length value and the Date header of
+// the thread. The prelude of a negotiated response also has "Vary: Accept".
+
+inline constexpr std::string_view server_field = "Server:scymnus\r\n";
+inline constexpr std::string_view vary_accept_field = "Vary:Accept\r\n";
+inline constexpr std::string_view content_length_field = "Content-Length:";
+
+namespace detail {
+
+inline constexpr char digit_pairs[] = "00010203040506070809"
+                                      "10111213141516171819"
+                                      "20212223242526272829"
+                                      "30313233343536373839"
+                                      "40414243444546474849"
+                                      "50515253545556575859"
+                                      "60616263646566676869"
+                                      "70717273747576777879"
+                                      "80818283848586878889"
+                                      "90919293949596979899";
+
+// writes value backwards, two digits at a time, ending at end. Returns the
+// first character written
+inline char *write_decimal(uint64_t value, char *end) {
+    while (value >= 100) {
+        auto pair = (value % 100) * 2;
+        value /= 100;
+        end -= 2;
+        std::memcpy(end, digit_pairs + pair, 2);
+    }
+    if (value >= 10) {
+        end -= 2;
+        std::memcpy(end, digit_pairs + value * 2, 2);
+    } else
+        *--end = static_cast<char>('0' + value);
+    return end;
+}
+
+template <std::size_t N> struct fixed_string {
+    std::array<char, N> data{};
+
+    constexpr operator std::string_view() const { return {data.data(), N}; }
+};
+
+template <const std::string_view &...Parts> constexpr auto concat() {
+    fixed_string<(Parts.size() + ...)> result;
+    std::size_t position = 0;
+    for (auto part : {Parts...})
+        for (auto c : part)
+            result.data[position++] = c;
+    return result;
+}
+
+} // namespace detail
+
+/// appends the decimal representation of value
+inline void append_decimal(std::pmr::string &output, uint64_t value) {
+    char buffer[20];
+    auto first = detail::write_decimal(value, buffer + sizeof(buffer));
+    output.append(first, buffer + sizeof(buffer));
+}
+
+template <int Status, http_content_type ContentType, bool Vary = false> struct prelude {
+    static constexpr std::string_view status_line = status_codes.at(Status);
+    static constexpr std::string_view content_type = to_string_view(ContentType);
+    static constexpr std::string_view vary = Vary ? vary_accept_field : std::string_view{};
+
+    static constexpr auto text = detail::concat<status_line, content_type, vary, server_field,
+                                                content_length_field>();
+
+    /// the whole prelude, ending with "Content-Length:"
+    static constexpr std::string_view value = text;
+
+    /// the prelude without "Content-Length:", custom headers follow
+    static constexpr std::string_view head =
+        value.substr(0, value.size() - content_length_field.size());
+};
+
+/// Responses without a body and custom headers, rendered along with the Date
+/// header of the thread. They are rendered again once a second, when the
+/// date changes.
+template <int Status> struct canned_response {
+    static constexpr std::string_view prelude_text =
+        prelude<Status, http_content_type::NONE>::value;
+    static constexpr std::string_view length = "0\r\n";
+    static constexpr auto text = detail::concat<prelude_text, length>();
+
+    static std::string_view get() {
+        thread_local std::string response;
+        thread_local uint64_t version = 0;
+
+        auto &date = date_manager::instance();
+        if (version != date.version()) {
+            response.assign(std::string_view{text});
+            response.append(date.get_http_time());
+            version = date.version();
+        }
+        return response;
+    }
+};
+
+} // namespace scymnus
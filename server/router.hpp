@@ -1,7 +1,11 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <set>
 #include <string>
@@ -16,255 +20,32 @@
 #include <boost/algorithm/string/trim.hpp>
 #include <boost/callable_traits.hpp>
 
+#include "core/cbor.hpp"
 #include "core/exception_handler.hpp"
+#include "core/json_reader.hpp"
+#include "core/msgpack.hpp"
 #include "core/named_tuples_utils.hpp"
 #include "core/opeartion.hpp"
 #include "core/response.hpp"
 #include "core/serializers.hpp"
 #include "core/typelist.hpp"
 #include "core/validator.hpp"
+#include "core/wire.hpp"
 #include "http/http_common.hpp"
 
 #include "aspects.hpp"
 #include "external/json.hpp"
 #include "http_context.hpp"
+#include "radix_tree.hpp"
+#include "response_cache.hpp"
+#include "settings.hpp"
 #include "utilities/utils.hpp"
 
 namespace scymnus {
 
 using json = nlohmann::json;
-class node;
-
-using callable_t = std::function<void(context &)>;
-using match_result = node *; // std::pair<node*, std::vector<std::string_view>>;
 namespace ct = boost::callable_traits;
 
-enum class FragmentType : uint8_t {
-    Simple,      // just a path segment
-    Integer,     //:I
-    Double,      //:D
-    String,      //:S
-    Regexp,      //:R
-    PathWildCard // denoted as *
-};
-
-inline std::string to_string(FragmentType name) {
-    if (name == FragmentType::Simple)
-        return "Simple";
-    else if (name == FragmentType::Double)
-        return "double";
-    else if (name == FragmentType::Regexp)
-        return "Regexp";
-    else if (name == FragmentType::String)
-        return "String";
-    else if (name == FragmentType::Integer)
-        return "Integer";
-    else if (name == FragmentType::PathWildCard)
-        return "PathWildCard";
-    else
-        return "Unknown";
-}
-
-struct node {
-    node(FragmentType t = FragmentType::Simple) : type{t} {}
-    node(FragmentType t, std::string v) : type{t}, value{v} {}
-
-    struct node_comperator {
-        bool operator()(const node *lhs, const node *rhs) const {
-
-            if (lhs->type == rhs->type) {
-                return lhs->value < rhs->value;
-            }
-
-            return lhs->type < rhs->type;
-        }
-    };
-
-    FragmentType type{FragmentType::Simple};
-    std::string value{};
-
-    // std::set<node*, node_comperator> children{};
-
-    std::vector<node *> children{};
-    callable_t handler;
-};
-
-class trie {
-    friend class router_manager;
-
-public:
-    [[nodiscard]] node *add(std::string url) {
-
-        std::vector<std::string> parts;
-        boost::trim_if(url,
-                       boost::is_any_of("/")); // could also use plain boost::trim
-        boost::split(parts, url, boost::is_any_of("/"), boost::token_compress_on);
-
-        if (!parts.size())
-            throw std::invalid_argument("url must not be empty");
-
-        node *current_node = &head_;
-        size_t index{};
-
-        for (auto it = std::begin(parts); it != std::end(parts); ++it, ++index) {
-            auto found = std::find_if(std::cbegin(current_node->children),
-                                      std::cend(current_node->children),
-                                      [&it](node *n) { return n->value == *it; });
-
-            if (found != std::cend(current_node->children)) {
-                current_node = *found;
-                continue;
-            }
-
-            // PathWildCard is considered as  being the last type of the url
-            if ((*it).compare(0, 2, ":*") == 0) {
-                auto n = new node{FragmentType::PathWildCard, std::string{}};
-                current_node->children.push_back(n);
-                current_node = n;
-                return current_node;
-            }
-
-            else if ((*it).compare(0, 3, ":R(") == 0 &&
-                     it->back() == ')') { // Regular expression
-
-                auto n =
-                    new node{FragmentType::Regexp, (*it).substr(3, it->size() - 4)};
-                current_node->children.push_back(n);
-                current_node = n;
-            }
-
-            else if ((*it).compare(0, 2, ":S") == 0) { // String type
-
-                auto n = new node{FragmentType::String, std::string{}};
-                current_node->children.push_back(n);
-                current_node = n;
-            }
-
-            else if ((*it).compare(0, 2, ":D") == 0) { // Double type
-                auto n = new node{FragmentType::Double, std::string{}};
-                current_node->children.push_back(n);
-                current_node = n;
-            }
-
-            else if ((*it).compare(0, 2, ":I") == 0) { // Integer type
-                auto n = new node{FragmentType::Integer, std::string{}};
-                current_node->children.push_back(n);
-                current_node = n;
-            }
-
-            else { // Simple type
-                // check if node exists
-                auto n = new node{FragmentType::Simple, *it};
-                current_node->children.push_back(n);
-                current_node = n;
-            }
-        }
-
-        return current_node;
-    }
-
-    match_result match(const std::string_view url) {
-        enum MatchType { NoMatch, PartialMatch, FullMatch } match_type{NoMatch};
-
-        // TODO: check root
-        auto path_start = url.find_first_not_of('/');
-        auto path_end = url.find_first_of('/', path_start);
-
-        node *current_node = &head_;
-
-        while ((path_start != std::string::npos) ||
-               (path_end != std::string::npos)) {
-            std::string_view part = url.substr(
-                path_start, path_end == std::string::npos ? url.size() - path_start
-                                                          : path_end - path_start);
-
-            for (auto iter = std::begin(current_node->children);
-                 iter != std::end(current_node->children); iter++) {
-
-                if ((*iter)->type == FragmentType::Simple) {
-                    if (part == (*iter)->value) {
-                        current_node = *iter;
-
-                        match_type = PartialMatch;
-                        break;
-                    }
-                    continue;
-                }
-
-                else if ((*iter)->type == FragmentType::Integer) {
-                    match_type = PartialMatch;
-                    for (const auto &c : part) {
-                        if ((c >= '0' && c <= '9') || c == '+' ||
-                            c == '-') { // TODO only allow + and - on the beginning
-                            continue;
-                        } else {
-                            match_type = NoMatch;
-                            break;
-                        }
-                    }
-                    if (match_type == NoMatch)
-                        continue;
-                    current_node = *iter;
-                    break; // we have match continue to the next fragment
-                }
-
-                else if ((*iter)->type == FragmentType::Double) {
-                    match_type = PartialMatch;
-                    for (const auto &c : part) {
-                        if ((c >= '0' && c <= '9') || c == '.' || c == '+' ||
-                            c == '-') { // TODO only allow + and - on the beginning
-                            continue;
-                        } else {
-                            match_type = NoMatch;
-                            break;
-                        }
-                    }
-                    if (match_type == NoMatch)
-                        continue;
-                    current_node = *iter;
-                    break; // we have match continue to the next fragment
-                }
-
-                else if ((*iter)->type == FragmentType::String) {
-                    // we do have a match by defalut
-                    current_node = *iter;
-                    match_type = PartialMatch;
-                    break; // we have match continue to the next fragment
-                }
-
-                // TODO: implement this
-                else if ((*iter)->type == FragmentType::Regexp) {
-                    match_type = PartialMatch;
-                    current_node = *iter;
-                    break;
-                }
-
-                else if ((*iter)->type == FragmentType::PathWildCard) {
-                    match_type = PartialMatch;
-                    current_node = *iter;
-                    break;
-                }
-            }
-
-            path_start = url.find_first_not_of('/', path_end);
-            path_end = url.find_first_of('/', path_start);
-        }
-
-        return current_node;
-    }
-
-    trie() : head_{} {
-
-        // method not found header
-        head_.handler = [](context &ctx) { ctx.write(status<404>); };
-    }
-
-    trie(const trie &tr) = delete;
-
-    // private:
-    node head_;
-};
-
 template <class... P> class operation {
 public:
     using parameters_t = scymnus::tl::typelist<P...>;
@@ -280,26 +61,36 @@ template <class T> struct unpacker;
 
 template <class T, auto Path> struct param_visitor;
 
+// index of the parameter {name} among the parameters of path
+constexpr std::size_t path_param_index(std::string_view path, std::string_view name) {
+    std::size_t index = 0;
+    for (std::size_t i = 0; i < path.size(); ++i) {
+        if (path[i] != '{' || (i && path[i - 1] != '/'))
+            continue;
+        auto end = path.find('}', i);
+        if (end == std::string_view::npos)
+            break;
+        if (path.substr(i + 1, end - i - 1) == name)
+            return index;
+        ++index;
+    }
+    return std::string_view::npos;
+}
+
 template <meta::ct_string Name, class T, meta::ct_string Path>
 struct param_visitor<path_param<Name, T>, Path> {
 
     static constexpr const char *name = Name.str();
     using type = T;
 
-    static decltype(auto) get(context &ctx) {
-        std::vector<std::string_view> parts = utils::split(Path.str());
-        std::string name_str = name;
-
-        std::string target = "{" + name_str + "}";
-
-        int counter = 0;
-        for (auto t : parts) {
-            if (target == std::string(t.data(), t.size()))
-                break;
-            ++counter;
-        };
+    static constexpr std::size_t index =
+        path_param_index({Path.str(), Path.size()}, {Name.str(), Name.size()});
+    static_assert(index != std::string_view::npos,
+                  "the name of a path_param must appear as {name} in the path");
 
-        return scymnus::path::traits<type>::get(ctx.raw_url(), counter);
+    // the segment was captured and validated by the router
+    static decltype(auto) get(context &ctx) {
+        return scymnus::path::traits<type>::get(ctx.path_param(index));
     }
 };
 
@@ -322,16 +113,73 @@ struct param_visitor<query_param<Name, T>, Path> {
     }
 };
 
+// whether a body_param of T accepts the wire format, see wire_body
+template <class T> constexpr bool accepts_wire() {
+    if constexpr (is_model_v<T>)
+        return wire_body<T>::value;
+    else if constexpr (is_compact_model_v<T>)
+        return wire_body<typename T::model_type>::value;
+    else
+        return false;
+}
+
 template <meta::ct_string Name, class T, meta::ct_string Path>
 struct param_visitor<body_param<Name, T>, Path> {
-    static decltype(auto) get(context &ctx) {
-        static constexpr const char *name = Name.str();
-        json value = json::parse(ctx.request_body());
-        T model = json::parse(ctx.request_body()).get<T>();
-        return model;
+    // models, vectors and scalars are read without building a DOM, in the
+    // format given by Content-Type
+    static T get(context &ctx) {
+        switch (ctx.request_format()) {
+        case http_content_type::MSGPACK:
+            return msgpack_reader::read<T>(ctx.request_body());
+        case http_content_type::CBOR:
+            return cbor_reader::read<T>(ctx.request_body());
+        case http_content_type::WIRE:
+            if constexpr (!accepts_wire<T>())
+                throw sc_exception{"wire: the body is not accepted in the wire format"};
+            else if constexpr (is_model_v<T>)
+                return wire_reader::read<T>(ctx.request_body());
+            else
+                return wire_reader::read<typename T::model_type>(ctx.request_body());
+        default:
+            return json_reader::read<T>(ctx.request_body());
+        }
+    }
+};
+
+// a body in the wire format, read in place from the request buffer
+template <meta::ct_string Name, class Model, meta::ct_string Path>
+struct param_visitor<body_param<Name, wire_view<Model>>, Path> {
+    static wire_view<Model> get(context &ctx) {
+        if (ctx.request_format() != http_content_type::WIRE)
+            throw sc_exception{"wire: Content-Type must be " +
+                               std::string{describe(http_content_type::WIRE)}};
+        return wire_view<Model>{ctx.request_body()};
     }
 };
 
+// the parameters of the aspects and the handler of a route, each one is
+// extracted at most once per request. The slots are laid out at compile time,
+// one for each distinct parameter type in L
+template <auto Path, class L> class param_cache;
+
+template <auto Path, template <class...> class L, class... P>
+class param_cache<Path, L<P...>> {
+    template <class T>
+    using value_t = std::remove_cvref_t<decltype(param_visitor<T, Path>::get(
+        std::declval<context &>()))>;
+
+public:
+    template <class T> value_t<T> &get(context &ctx) {
+        auto &slot = std::get<tl::index<L<P...>, T>::value>(values_);
+        if (!slot)
+            slot.emplace(param_visitor<T, Path>::get(ctx));
+        return *slot;
+    }
+
+private:
+    std::tuple<std::optional<value_t<P>>...> values_;
+};
+
 template <template <class...> class L, class... T> struct unpacker<L<T...>> {
     template <class F> static void execute(F &&f, context &ctx) {
 
@@ -343,6 +191,14 @@ template <template <class...> class L, class... T> struct unpacker<L<T...>> {
                     T{param_visitor<T, return_type::path>::get(ctx)}..., ctx);
     }
 
+    // the handler runs after the aspects, so it takes the cached values
+    template <class F, class Cache>
+    static void execute(F &&f, context &ctx, Cache &cache) {
+        std::invoke(std::forward<F>(f),
+                    T{std::move(cache.template get<std::remove_cvref_t<T>>(ctx))}...,
+                    ctx);
+    }
+
     static json describe() {
         json descr;
         auto describe_ = [&descr](const auto &t) {
@@ -361,11 +217,29 @@ public:
             Path)][to_string(Method)]["responses"][std::to_string(c)] =
                 traits<T>::describe();
 
+        if constexpr (Method == http_method::GET &&
+                      is_projectable_v<typename T::body_type> &&
+                      T::content_type != http_content_type::WIRE)
+            api_manager::instance().endpoint_fields_["paths"][std::string(Path)]
+                                                    [to_string(Method)] = true;
+
         if constexpr (T::content_type != http_content_type::NONE) {
-            api_manager::instance().endpoint_produce_types_["paths"][std::string(
-                Path)][to_string(Method)]["produces"] += describe(T::content_type);
+            produce(T::content_type);
+            if constexpr (T::negotiated) {
+                produce(http_content_type::MSGPACK);
+                produce(http_content_type::CBOR);
+            }
         }
     }
+
+private:
+    static void produce(http_content_type content_type) {
+        auto &produces = api_manager::instance().endpoint_produce_types_["paths"][std::string(
+            Path)][to_string(Method)]["produces"];
+        std::string type{describe(content_type)};
+        if (std::find(produces.begin(), produces.end(), type) == produces.end())
+            produces += type;
+    }
 };
 
 template <http_method Method, meta::ct_string Path, int C, class T = void>
@@ -395,25 +269,103 @@ public:
 template <class T>
 using is_context = std::is_same<context, std::remove_cvref_t<T>>;
 
+// the parameters of a handler or an aspect, without the context
+template <class F>
+using parameters_of = tl::transform<
+    std::remove_cvref_t,
+    typename tl::remove_if<is_context, ct::args_t<std::decay_t<F>, operation>,
+                           operation<>>::parameters_t>;
+
+template <class T> struct is_wire_body : std::false_type {};
+
+template <meta::ct_string Name, class Model>
+struct is_wire_body<body_param<Name, wire_view<Model>>> : std::true_type {};
+
+// whether one of the parameters of a list is a body read as a wire_view
+template <class L> struct has_wire_body;
+
+template <template <class...> class L, class... P>
+struct has_wire_body<L<P...>> : std::bool_constant<(is_wire_body<P>::value || ...)> {};
+
+template <class T> struct is_wire_model_body : std::false_type {};
+
+template <meta::ct_string Name, class T>
+struct is_wire_model_body<body_param<Name, T>> : std::bool_constant<accepts_wire<T>()> {};
+
+// whether one of the parameters of a list is a body that also accepts the
+// wire format
+template <class L> struct has_wire_model_body;
+
+template <template <class...> class L, class... P>
+struct has_wire_model_body<L<P...>>
+    : std::bool_constant<(is_wire_model_body<P>::value || ...)> {};
+
+template <class T> struct is_fields_query : std::false_type {};
+
+template <class T> struct is_fields_query<query_param<"fields", T>> : std::true_type {};
+
+// whether one of the parameters of a list is a query parameter named fields,
+// which turns off the projection of the responses
+template <class L> struct has_fields_query;
+
+template <template <class...> class L, class... P>
+struct has_fields_query<L<P...>> : std::bool_constant<(is_fields_query<P>::value || ...)> {};
+
+template <class T> struct is_enumeration : std::false_type {};
+
+template <class T, class... sl>
+struct is_enumeration<enumeration<T, sl...>> : std::true_type {
+    // the values of the enumeration separated by '|'
+    static std::string values() {
+        std::string result;
+        ((result.append(result.empty() ? "" : "|").append(sl::str())), ...);
+        return result;
+    }
+};
+
+template <class T> struct is_matching : std::false_type {};
+
+template <meta::ct_string Pattern>
+struct is_matching<matching<Pattern>> : std::true_type {};
+
+// the typed segment of the radix tree matching a path parameter of type T
+template <class T> std::string path_fragment() {
+    if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+        return sizeof(T) <= sizeof(int32_t) ? ":I" : ":L";
+    else if constexpr (std::is_integral_v<T>)
+        return ":U";
+    else if constexpr (std::is_floating_point_v<T>)
+        return ":D";
+    else if constexpr (std::is_same_v<T, uuid>)
+        return ":G";
+    else if constexpr (is_enumeration<T>::value)
+        return ":E(" + is_enumeration<T>::values() + ")";
+    else if constexpr (is_matching<T>::value)
+        return ":R(" + std::string(T::pattern) + ")";
+    else
+        return ":S";
+}
+
 template <bool contains_context, class RT, class T> struct aspect_unpacker;
 
 template <bool contains_context, class RT, template <class...> class L,
          class... T>
 struct aspect_unpacker<contains_context, RT, L<T...>> {
-    template <class F> static void execute(F &&f, context &ctx) {
-        // get the path
-
-        using return_type = RT;
-        constexpr meta::ct_string p = meta::ct_string(return_type::path);
+    // aspects get copies of the cached values, the handler may still need them
+    template <class F, class Cache>
+    static void execute(F &&f, context &ctx, Cache &cache) {
         if constexpr (contains_context) {
             std::invoke(std::forward<F>(f),
-                        T{param_visitor<T, return_type::path>::get(ctx)}..., ctx);
+                        T{copy(cache.template get<std::remove_cvref_t<T>>(ctx))}...,
+                        ctx);
 
         } else {
             std::invoke(std::forward<F>(f),
-                        T{param_visitor<T, return_type::path>::get(ctx)}...);
+                        T{copy(cache.template get<std::remove_cvref_t<T>>(ctx))}...);
         }
     }
+
+    template <class V> static V copy(const V &v) { return v; }
 };
 
 struct router_parameters {
@@ -422,6 +374,7 @@ struct router_parameters {
     std::string summary_{};
     std::string description_{};
     std::optional<std::string> tag_{}; // swagger tag
+    std::shared_ptr<response_cache_policy> cache_policy_{};
 
     router_parameters &description(const std::string &dsr) {
         description_ = dsr;
@@ -438,7 +391,29 @@ struct router_parameters {
         return *this;
     }
 
+    /// caches the responses of a GET endpoint for ttl. The key is the path, the
+    /// query string and the headers given to cache_vary()
+    router_parameters &cache(std::chrono::seconds ttl) {
+        if (method_ != http_method::GET)
+            throw std::invalid_argument("only GET endpoints can be cached");
+        cache_policy_->ttl_ = ttl;
+        return *this;
+    }
+
+    /// only the given query parameters are part of the cache key
+    router_parameters &cache_query(std::initializer_list<std::string> names) {
+        cache_policy_->query_.insert(cache_policy_->query_.end(), names);
+        return *this;
+    }
+
+    /// request header whose value is part of the cache key
+    router_parameters &cache_vary(const std::string &field) {
+        cache_policy_->vary_.emplace_back(field.begin(), field.end());
+        return *this;
+    }
+
     ~router_parameters() {
+        std::lock_guard lock{api_manager::instance().mutex()};
 
         std::string path(url_.data(), url_.size());
 
@@ -469,9 +444,31 @@ struct router_parameters {
                 api_manager::instance()
                     .endpoint_produce_types_["paths"][path][m]["produces"];
         }
+
+        if (api_manager::instance().endpoint_fields_["paths"][path][m] == true)
+            add_fields_parameter(api_manager::instance().swagger_["paths"][path][m]);
+
+        api_manager::instance().refresh_description();
+    }
+
+    // ?fields= of the model responses, unless the route reads it itself
+    static void add_fields_parameter(json &operation) {
+        auto &parameters = operation["parameters"];
+        for (const auto &p : parameters)
+            if (p.value("in", "") == "query" && p.value("name", "") == "fields")
+                return;
+
+        json v;
+        v["name"] = "fields";
+        v["in"] = "query";
+        v["type"] = "string";
+        v["description"] = "comma separated fields of the response, a.b selects the "
+                           "field b of the object a";
+        parameters += v;
     }
 };
 
+
 class router {
 public:
     router() = default;
@@ -479,23 +476,104 @@ public:
     void exec(context &ctx) {
         try {
 
-            // find path;
-            auto path_start = ctx.raw_url().find('/');
-            auto path_end = ctx.raw_url().find('?', path_start);
+            // decoded and normalized path, the captures point into it
+            std::string_view v = ctx.path();
+            if (v.empty()) {
+                ctx.write(status<400>);
+                return;
+            }
+
+            if (auto origin = allowed_origin(ctx); !origin.empty()) {
+                add_header(ctx, "Access-Control-Allow-Origin", origin);
+                if (origin != "*")
+                    add_header(ctx, "Vary", "Origin");
+            }
+
+            // OPTIONS * asks for the methods of the server, other methods
+            // have no resource to act on
+            if (v == "*") {
+                if (ctx.method() != http_method::OPTIONS) {
+                    ctx.write(status<400>);
+                    return;
+                }
+                auto methods = current_table().methods();
+                if (static_methods_)
+                    methods |= static_methods_(static_routes_.get(), v);
+                add_header(ctx, "Allow", route_table::allow(methods));
+                ctx.write(status<200>, "");
+                return;
+            }
+
+            if (static_dispatch_ && static_dispatch_(static_routes_.get(), ctx, v))
+                return;
 
-            std::string_view v = std::string_view(ctx.raw_url())
-                                     .substr(path_start, path_end == std::string::npos
-                                                             ? ctx.raw_url().size()
-                                                             : path_end - path_start);
-            method_data_[(std::size_t)ctx.method()].match(v)->handler(ctx);
+            auto &table = current_table();
+            auto &route = table.match(v, ctx.method(), ctx.path_params());
+            if (auto handler = table.handler(route, ctx.method())) {
+                (*handler)(ctx);
+                return;
+            }
+
+            // Allow lists the methods of every route matching the path,
+            // static routes included
+            auto methods = route.methods ? table.methods(v) : 0;
+            if (static_methods_)
+                methods |= static_methods_(static_routes_.get(), v);
+            std::string_view allow = route.allow;
+            std::string merged;
+            if (methods != route.methods) {
+                merged = route_table::allow(methods);
+                allow = merged;
+            }
+
+            if (!methods)
+                ctx.write(status<404>);
+            else if (ctx.method() == http_method::OPTIONS)
+                write_options(ctx, allow);
+            else {
+                add_header(ctx, "Allow", allow);
+                ctx.write(status<405>);
+            }
         }
 
         catch (...) {
-            exception_handler_(ctx);
+            handle_exception(ctx);
         }
     }
 
 private:
+    // the path of a handler in the syntax of the radix tree: "/points/{id}"
+    // becomes "/points/:I" when id is a path_param<"id", int>
+    template <class F> static std::string tree_path() {
+        using return_type = ct::return_type_t<F>;
+        using path_parameters =
+            tl::select_if<is_path_or_segment_param,
+                          ct::args_t<std::decay_t<F>, std::tuple>,
+                          std::tuple<>>::type;
+        std::string path = return_type::path.str();
+
+        if constexpr (std::tuple_size_v<path_parameters>) {
+            scymnus::for_each(path_parameters{}, [&path](const auto &v) {
+                using param = std::remove_cvref_t<decltype(v)>;
+                std::string str = "{" + std::string(v.name) + "}";
+
+                if constexpr (is_segment_param_v<param>)
+                    boost::replace_all(path, str, ":*");
+                else
+                    boost::replace_all(path, str, path_fragment<typename param::type>());
+            });
+        }
+
+        // parameters without an argument match any segment
+        for (auto start = path.find("/{"); start != std::string::npos;
+             start = path.find("/{", start + 1)) {
+            auto end = path.find('}', start);
+            if (end != std::string::npos)
+                path.replace(start + 1, end - start, ":S");
+        }
+        return path;
+    }
+
     template <class T>
     struct aspect_filter_t
         : tl::any_of<T, is_context, is_body_param, is_path_param> {};
@@ -503,6 +581,7 @@ private:
     /// routes an endpoint without  updating swagger documentation and without
     /// using aspects
     template <class F> void route_internal(F &&f) {
+        std::lock_guard lock{api_manager::instance().mutex()};
         // get output parameters
         // TODO: check arguments
         using designated_types =
@@ -515,39 +594,7 @@ private:
         // register aspect responses with endpoint
         // create the path for adding in trie
 
-        using path_parameters =
-            tl::select_if<is_path_or_segment_param,
-                          ct::args_t<std::decay_t<F>, std::tuple>,
-                          std::tuple<>>::type;
-        std::string path = return_type::path.str();
-
-        if constexpr (std::tuple_size_v<path_parameters>) {
-            scymnus::for_each(path_parameters{}, [&path](const auto &v) {
-                std::string str = "{" + std::string(v.name) + "}";
-
-                if constexpr (is_segment_param_v<
-                                  typename std::remove_cvref_t<decltype(v)>>) {
-                    boost::replace_all(path, str, ":*");
-                }
-
-                else if constexpr (std::is_same_v<
-                                       typename std::remove_cvref_t<decltype(v)>::type,
-                                       int>) {
-                    boost::replace_all(path, str, ":I");
-                }
-
-                else if (std::is_same_v<typename std::remove_cvref_t<decltype(v)>::type,
-                                        std::string>) {
-                    boost::replace_all(path, str, ":S");
-
-                }
-
-                else if (std::is_same_v<typename std::remove_cvref_t<decltype(v)>::type,
-                                        double>) {
-                    boost::replace_all(path, str, ":D");
-                }
-            });
-        }
+        std::string path = tree_path<F>();
 
         auto l = [f = std::conditional_t<
                       std::is_lvalue_reference<F>::value,
@@ -562,11 +609,13 @@ private:
             }
         };
 
-        auto node = method_data_[(std::size_t)return_type::method].add(path);
-        node->handler = l;
+        add(path, return_type::method, std::move(l));
     };
 
     template <class F, typename... T> router_parameters route(F &&f, T &&...t) {
+        // routes can be added while requests are served, the documentation
+        // and the tree are updated by one thread at a time
+        std::lock_guard lock{api_manager::instance().mutex()};
         // get output parameters
         using designated_types =
             tl::remove_if<is_context, ct::args_t<std::decay_t<F>, operation>,
@@ -583,10 +632,34 @@ private:
         json v = unpacker<typename union_t::parameters_t>::describe();
         using return_type = ct::return_type_t<F>;
 
+        // one slot for each parameter of the handler or of a before aspect
+        using cache_t = param_cache<return_type::path,
+                                   tl::unique_t<tl::merge_t<parameters_of<F>,
+                                                            parameters_of<T>...>>>;
+
+        static constexpr bool reads_fields =
+            has_fields_query<tl::merge_t<parameters_of<F>, parameters_of<T>...>>::value;
+
         if (v.size())
             api_manager::instance().swagger_["paths"][std::string(
                 return_type::path)][to_string(return_type::method)]["parameters"] = v;
 
+        // bodies are read as JSON, MessagePack or CBOR, and in the wire format
+        // when their model opts in. Views only in the wire format
+        if (std::any_of(v.begin(), v.end(),
+                        [](const json &p) { return p.value("in", "") == "body"; })) {
+            auto &consumes = api_manager::instance().swagger_["paths"][std::string(
+                return_type::path)][to_string(return_type::method)]["consumes"];
+            if constexpr (has_wire_body<parameters_of<F>>::value)
+                consumes = {describe(http_content_type::WIRE)};
+            else {
+                consumes = {describe(http_content_type::JSON), describe(http_content_type::MSGPACK),
+                            describe(http_content_type::CBOR)};
+                if constexpr (has_wire_model_body<parameters_of<F>>::value)
+                    consumes.push_back(describe(http_content_type::WIRE));
+            }
+        }
+
         // register aspect responses wth endpoint
 
         static constexpr bool has_aspects = sizeof...(t);
@@ -619,48 +692,17 @@ private:
 
         // create the path for adding in Trie
 
-        using path_parameters =
-            tl::select_if<is_path_or_segment_param,
-                          ct::args_t<std::decay_t<F>, std::tuple>,
-                          std::tuple<>>::type;
-        std::string path = return_type::path.str();
-
-        if constexpr (std::tuple_size_v<path_parameters>) {
-            scymnus::for_each(path_parameters{}, [&path](const auto &v) {
-                std::string str = "{" + std::string(v.name) + "}";
-
-                if constexpr (is_segment_param_v<
-                                  typename std::remove_cvref_t<decltype(v)>>) {
-                    boost::replace_all(path, str, ":*");
-                }
-
-                else if constexpr (std::is_same_v<
-                                       typename std::remove_cvref_t<decltype(v)>::type,
-                                       int>) {
-                    boost::replace_all(path, str, ":I");
-                }
+        std::string path = tree_path<F>();
 
-                else if (std::is_same_v<typename std::remove_cvref_t<decltype(v)>::type,
-                                        std::string>) {
-                    boost::replace_all(path, str, ":S");
-
-                }
-
-                else if (std::is_same_v<typename std::remove_cvref_t<decltype(v)>::type,
-                                        double>) {
-                    boost::replace_all(path, str, ":D");
-                }
-            });
-        }
-
-        // get before aspects. aspects with state must be supported
+        // get before aspects. aspects are copied, so that aspects with state
+        // outlive the call to route()
 
         auto before_aspects = std::apply(
             [](auto &&...t) {
                 return std::tuple_cat([](auto &&arg) {
                     if constexpr (std::remove_cvref_t<decltype(arg)>::hook ==
                                   hook_type::before)
-                        return std::tuple<decltype(arg)>{
+                        return std::tuple<std::remove_cvref_t<decltype(arg)>>{
                             std::forward<decltype(arg)>(arg)};
                     else
                         return std::tuple<>{};
@@ -674,7 +716,7 @@ private:
                 return std::tuple_cat([](auto &&arg) {
                     if constexpr (std::remove_cvref_t<decltype(arg)>::hook ==
                                   hook_type::after)
-                        return std::tuple<decltype(arg)>{
+                        return std::tuple<std::remove_cvref_t<decltype(arg)>>{
                             std::forward<decltype(arg)>(arg)};
                     else
                         return std::tuple<>{};
@@ -682,12 +724,17 @@ private:
             },
             aspects);
 
+        auto cache_policy = std::make_shared<response_cache_policy>();
+
         auto l = [before_aspects = std::move(before_aspects),
-                  after_aspects = std::move(after_aspects),
+                  after_aspects = std::move(after_aspects), cache_policy,
                   f = std::conditional_t<
                       std::is_lvalue_reference<F>::value,
                       std::reference_wrapper<std::remove_reference_t<F>>, F>{
-                      std::forward<F>(f)}](context &ctx) {
+                      std::forward<F>(f)}](context &ctx) mutable {
+            cache_t params;
+            if constexpr (reads_fields)
+                ctx.project_fields(false);
             try {
 
                 // execute before aspects
@@ -711,15 +758,27 @@ private:
                         using aspect_return_type =
                             ct::return_type_t<std::decay_t<decltype(a)>>;
                         aspect_unpacker<has_context, return_type,
-                                        aspect_arguments>::execute(a, ctx);
+                                        aspect_arguments>::execute(a, ctx, params);
                     });
                 }
 
-                if constexpr (has_aspects) {
+                auto handle = [&] {
+                    unpacker<typename designated_types::parameters_t>::execute(f, ctx,
+                                                                               params);
+                };
+
+                if (cache_policy->enabled() && !ctx.is_response_written()) {
+                    auto &cache = response_cache::instance();
+                    if (!cache.serve(*cache_policy, ctx)) {
+                        auto generation = cache.generation();
+                        handle();
+                        cache.store(*cache_policy, ctx, generation);
+                    }
+                } else if constexpr (has_aspects) {
                     if (!ctx.is_response_written())
-                        unpacker<typename designated_types::parameters_t>::execute(f, ctx);
+                        handle();
                 } else
-                    unpacker<typename designated_types::parameters_t>::execute(f, ctx);
+                    handle();
 
                 // execute after aspects
                 if constexpr (has_aspects) {
@@ -753,29 +812,146 @@ private:
                         using aspect_return_type =
                             ct::return_type_t<std::decay_t<decltype(a)>>;
                         aspect_unpacker<has_context, return_type,
-                                        aspect_arguments>::execute(a, ctx);
+                                        aspect_arguments>::execute(a, ctx, params);
                     });
                 }
             } catch (...) {
                 // try to clean whatever is written in the response buffer
                 ctx.clear();
                 // call exceptions handler:
-                exception_handler_(ctx);
+                handle_exception(ctx);
 
                 // should the mandatory after aspects run here?
             }
         };
 
-        auto node = method_data_[(std::size_t)return_type::method].add(path);
-        node->handler = std::move(l);
+        add(path, return_type::method, std::move(l));
 
-        return router_parameters{return_type::path.str(), return_type::method};
+        return router_parameters{return_type::path.str(), return_type::method, {}, {},
+                                 {}, std::move(cache_policy)};
     }
 
     friend class app;
 
-    static inline std::array<trie, (std::size_t)http_method::ENUM_MEMBERS_COUNT>
-        method_data_{};
+    // adds a route, published at once when the server is running
+    static void add(std::string_view path, http_method method, callable_t handler) {
+        std::lock_guard lock{api_manager::instance().mutex()};
+        tree_.add(path, method, std::move(handler));
+        if (running_)
+            publish();
+    }
+
+    // the tables are compiled outside of the threads serving requests
+    static void publish() {
+        auto table = tree_.seal();
+        {
+            std::lock_guard lock{table_mutex_};
+            table_.swap(table);
+        }
+        version_.fetch_add(1, std::memory_order_release);
+    }
+
+    // the table used by the current thread. While the routes do not change
+    // this is a single atomic load, after a change the thread takes the new
+    // table and releases its reference to the previous one, which is freed
+    // once no thread uses it
+    static const route_table &current_table() {
+        thread_local std::shared_ptr<const route_table> local;
+        thread_local uint64_t local_version = 0;
+
+        auto version = version_.load(std::memory_order_acquire);
+        if (version != local_version) {
+            std::lock_guard lock{table_mutex_};
+            local = table_;
+            local_version = version;
+        }
+        return *local;
+    }
+
+    static void add_header(context &ctx, std::string_view field, std::string_view value) {
+        auto pool = memory_resource_manager::instance().pool();
+        ctx.add_response_header(std::pmr::string{field, pool},
+                                std::pmr::string{value, pool});
+    }
+
+    // the origin of a request when the cors_origin setting allows it, "*"
+    // when any origin is, empty otherwise
+    static std::string_view allowed_origin(const context &ctx) {
+        const auto &allowed = settings<core>().get<"cors_origin">();
+        if (!allowed || allowed->empty())
+            return {};
+        static const std::pmr::string field{"Origin"};
+        auto &headers = ctx.request().headers();
+        auto it = headers.find(field);
+        if (it == headers.end())
+            return {};
+        if (*allowed == "*")
+            return "*";
+        std::string_view origin = it->second;
+        return origin == *allowed ? origin : std::string_view{};
+    }
+
+    // OPTIONS of a route without an OPTIONS handler. A CORS preflight from
+    // an allowed origin also gets the allowed methods and the requested
+    // headers
+    static void write_options(context &ctx, std::string_view allow) {
+        static const std::pmr::string method{"Access-Control-Request-Method"};
+        static const std::pmr::string headers{"Access-Control-Request-Headers"};
+
+        add_header(ctx, "Allow", allow);
+        auto &request = ctx.request().headers();
+        if (request.count(method) && !allowed_origin(ctx).empty()) {
+            add_header(ctx, "Access-Control-Allow-Methods", allow);
+            if (auto it = request.find(headers); it != request.end())
+                add_header(ctx, "Access-Control-Allow-Headers", it->second);
+        }
+        ctx.write(status<204>);
+    }
+
+    // a throwing exception handler leaves a 500 response
+    static void handle_exception(context &ctx) {
+        try {
+            exception_handler_(ctx);
+        } catch (...) {
+            ctx.clear();
+            ctx.write(status<500>);
+        }
+    }
+
+    // routes of a static_router, tried before the ones added with route()
+    template <class Router> void static_routes(std::shared_ptr<Router> routes) {
+        Router::describe();
+        static_routes_ = std::move(routes);
+        static_dispatch_ = [](void *r, context &ctx, std::string_view path) {
+            return static_cast<Router *>(r)->dispatch(ctx, path);
+        };
+        static_methods_ = [](const void *r, std::string_view path) {
+            return path == "*" ? Router::methods() : static_cast<const Router *>(r)->methods(path);
+        };
+    }
+
+    // publishes the routes added so far, called before the server starts.
+    // Routes added later are published at once
+    void seal() {
+        std::lock_guard lock{api_manager::instance().mutex()};
+        running_ = true;
+        publish();
+    }
+
+    // routes added so far, guarded by the mutex of the api_manager
+    static inline radix_tree tree_{};
+    static inline bool running_{false};
+
+    // the last published table, threads check version_ before copying it.
+    // std::atomic<std::shared_ptr> of libstdc++ 12 releases its lock with a
+    // relaxed store on load, so a short mutex guards the copy instead
+    static inline std::shared_ptr<const route_table> table_{radix_tree{}.seal()};
+    static inline std::mutex table_mutex_{};
+    static inline std::atomic<uint64_t> version_{1};
+
+    static inline std::shared_ptr<void> static_routes_{};
+    static inline bool (*static_dispatch_)(void *, context &, std::string_view){nullptr};
+    static inline uint64_t (*static_methods_)(const void *, std::string_view){nullptr};
 
     // default exception handler
     static inline exception_handler exception_handler_{[](context &ctx) {
@@ -1,10 +1,17 @@
 #pragma once
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <chrono>
 #include <string>
 #include <string_view>
 #include <vector>
 
 #include "connection.hpp"
+#include "connection_limits.hpp"
 #include "server/settings.hpp"
 #include "service_pool.hpp"
 
@@ -17,6 +24,11 @@ public:
 
     explicit http_server() : pool_(settings<core>()[CT_("workers")]) {}
 
+    ~http_server() {
+        if (reserve_fd_ >= 0)
+            ::close(reserve_fd_);
+    }
+
     bool listen(std::string_view address, uint16_t port) {
         settings<core>()[CT_("ip")] = address;
         settings<core>()[CT_("port")] = port;
@@ -39,6 +51,20 @@ public:
 
                 acceptor->bind(endpoint);
                 acceptor->listen();
+
+                connection_limits::instance().configure(
+                    pool_.size(), settings<core>()[CT_("max_connections")],
+                    settings<core>()[CT_("max_connections_per_worker")],
+                    [acceptor, this]() {
+                        boost::asio::post(acceptor->get_executor(),
+                                          [acceptor, this]() { start_accept(acceptor); });
+                    });
+
+                // kept open to be released when the process runs out of
+                // descriptors, so that pending connections can still be answered
+                if (reserve_fd_ < 0)
+                    reserve_fd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+
                 start_accept(acceptor);
                 return true;
             }
@@ -62,30 +88,93 @@ private:
     void start_accept(
         std::shared_ptr<boost::asio::ip::tcp::acceptor> const &acceptor) {
 
-        boost::asio::io_context &context = pool_.next();
+        auto &limits = connection_limits::instance();
+        auto worker = limits.select_worker(next_worker_++);
+        if (worker < 0) {
+            // resumed by the connection_limits when a connection closes
+            limits.pause();
+            return;
+        }
+
+        boost::asio::io_context &context = pool_.at(worker);
 
-        boost::asio::post(context, [&context, acceptor, this]() {
+        boost::asio::post(context, [&context, acceptor, worker, this]() {
             boost::intrusive_ptr<connection> handler(new connection{context});
 
-            acceptor->async_accept(handler->socket(),
-                                   [&context, handler, acceptor,
+            acceptor->async_accept(
+                handler->socket(), [&context, handler, acceptor, worker,
                                     this](const boost::system::error_code &e) {
-                                       start_accept(acceptor);
-                                       if (!e) {
-
-                                           handler->socket().set_option(
-                                               boost::asio::ip::tcp::no_delay(true));
-                                           handler->idle_timeout_setup(
-                                               settings<core>()[CT_("idle_timeout")]);
-                                           handler->read();
-                                       } else {
-                                           // TODO: log error
-                                       }
-                                   });
+                    if (!e) {
+                        handler->track(connection_limits::instance().slot(worker));
+                        start_accept(acceptor);
+
+                        boost::asio::post(context, [handler]() {
+                            boost::system::error_code ec;
+                            handler->socket().set_option(
+                                boost::asio::ip::tcp::no_delay(true), ec);
+                            handler->remote_address_setup();
+                            handler->max_body_size_setup(
+                                settings<core>()[CT_("max_body_size")]);
+                            handler->idle_timeout_setup(
+                                settings<core>()[CT_("idle_timeout")]);
+                            handler->read();
+                        });
+                    } else if (e == boost::asio::error::operation_aborted) {
+                        return;
+                    } else if (e == boost::asio::error::no_descriptors ||
+                               e == boost::system::errc::too_many_files_open_in_system) {
+                        reject(acceptor);
+                    } else {
+                        std::cout << "error in async_accept(): " << e.message()
+                                  << std::endl;
+                        retry_accept(acceptor, std::chrono::milliseconds(10));
+                    }
+                });
+        });
+    }
+
+    // out of descriptors: the reserved one is released to accept the pending
+    // connection, answer it with 503 and close it, instead of spinning on EMFILE
+    void reject(std::shared_ptr<boost::asio::ip::tcp::acceptor> const &acceptor) {
+        static constexpr std::string_view unavailable =
+            "HTTP/1.1 503 Service Unavailable\r\nContent-Length:0\r\n"
+            "Connection:close\r\nRetry-After:1\r\n\r\n";
+
+        if (reserve_fd_ >= 0) {
+            ::close(reserve_fd_);
+            reserve_fd_ = -1;
+        }
+
+        int fd = ::accept4(acceptor->native_handle(), nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd >= 0) {
+            ::send(fd, unavailable.data(), unavailable.size(),
+                   MSG_NOSIGNAL | MSG_DONTWAIT);
+            ::close(fd);
+            connection_limits::instance().rejected();
+        }
+
+        reserve_fd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+        // descriptors are still exhausted, back off before accepting again
+        if (fd < 0 || reserve_fd_ < 0)
+            retry_accept(acceptor, std::chrono::milliseconds(100));
+        else
+            start_accept(acceptor);
+    }
+
+    void retry_accept(std::shared_ptr<boost::asio::ip::tcp::acceptor> const &acceptor,
+                      std::chrono::milliseconds delay) {
+        auto timer = std::make_shared<boost::asio::steady_timer>(
+            acceptor->get_executor(), delay);
+        timer->async_wait([timer, acceptor, this](const boost::system::error_code &ec) {
+            if (!ec)
+                start_accept(acceptor);
         });
     }
 
     service_pool_policy pool_;
+    std::size_t next_worker_{0};
+    int reserve_fd_{-1};
 
     // idle timeout in seconds
     uint32_t idle_timeout_{60};
@@ -93,7 +182,6 @@ private:
 
     uint16_t max_headers_size_{8 * 1024};
     uint16_t max_url_size_{2 * 1024};
-    uint32_t max_body_size_{8 * 1024};
 };
 
 } // namespace scymnus
@@ -68,6 +68,10 @@ public:
         return context;
     }
 
+    std::size_t size() const { return pool_.size(); }
+
+    boost::asio::io_context &at(std::size_t i) { return *pool_[i]; }
+
 private:
     boost::asio::io_context io_context_;
     std::size_t next_io_service_;
@@ -39,10 +39,13 @@ using core_settings_model = model<
     field<"idle_timeout", std::optional<uint32_t>, init<[]() { return 60; }>{}, description("After idle_timeout seconds idle connections will be closed")>,
     field<"max_header_size", std::optional<uint16_t>, init<[]() { return 8 * 1024; }>{}, description("Maiximum accepted size of headers in a request")>,
     field<"max_url_size", std::optional<uint16_t>, init<[]() { return 2 * 1024; }>{}, description("Maiximum accepted size of url in a request")>,
-    field<"max_body_size", std::optional<uint16_t>, init<[]() { return 8 * 1024; }>{}, description("Maiximum accepted size of request body")>,
+    field<"max_body_size", std::optional<uint32_t>, init<[]() { return 0; }>{}, description("Maximum accepted size of request body, 0 for no limit. Larger bodies are answered with 413")>,
     field<"port", std::optional<uint16_t>, init<[]() { return 8080; }>{}, description("Server's listening port")>,
     field<"ip", std::optional<std::string>, init<[]() { return "0.0.0.0"; }>{}, description("Server's ip")>,
     field<"workers", std::optional<uint16_t>, init<[]() { return std::thread::hardware_concurrency(); }>{}, description("Number of working threads")>,
+    field<"max_connections", std::optional<uint32_t>, init<[]() { return 0; }>{}, description("Maximum number of open connections, 0 for no limit. Accepting is paused while the limit is reached")>,
+    field<"max_connections_per_worker", std::optional<uint32_t>, init<[]() { return 0; }>{}, description("Maximum number of open connections per working thread, 0 for no limit")>,
+    field<"cors_origin", std::optional<std::string>, description("Origin allowed to make cross-origin requests, * for any. CORS headers are not sent when not set")>,
     field<"enable_swagger", std::optional<bool>, init<[]() { return true; }>{}, description("enable swagger. Default value is false")>,
     field<"swagger", std::optional<doc_model>, description("swagger details")>
     >;
@@ -0,0 +1,449 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "server/router.hpp"
+
+namespace scymnus {
+
+// Routes whose handlers are all known at compile time. The method and the
+// segments of each route are taken from its response_for<> return type and
+// the type of each {param} from the path_param<> arguments of the handler.
+// Routes without parameters are found with a perfect hash of the method and
+// the segments, built at compile time by hash and displace: the hashes are
+// split into buckets, and each bucket, from the largest, gets the first
+// displacement that moves all of its routes to free slots. A request costs
+// one hash, the displacement of its bucket and one slot, whose route is
+// then compared. Each slot calls its handler directly through a jump table.
+// Routes with parameters are grouped by number of segments and the ones of
+// the request are tried in order.
+
+namespace detail {
+
+inline constexpr uint64_t route_hash_prime = 0x100000001b3;
+
+constexpr uint64_t route_hash(http_method method, const std::string_view *segments,
+                              std::size_t count) {
+    uint64_t h = (0xcbf29ce484222325 ^ static_cast<uint64_t>(method)) * route_hash_prime;
+    for (std::size_t i = 0; i < count; ++i) {
+        for (auto c : segments[i])
+            h = (h ^ static_cast<unsigned char>(c)) * route_hash_prime;
+        h = (h ^ '/') * route_hash_prime;
+    }
+    return h ^ (h >> 29);
+}
+
+// the slot of a route hash moved by the displacement of its bucket, the
+// finalizer of MurmurHash3 spreads the bits that the mask keeps
+constexpr std::size_t route_slot(uint64_t h, uint32_t displacement, std::size_t slots) {
+    h += displacement * 0x9e3779b97f4a7c15;
+    h = (h ^ (h >> 33)) * 0xff51afd7ed558ccd;
+    h = (h ^ (h >> 33)) * 0xc4ceb9fe1a85ec53;
+    return (h ^ (h >> 33)) & (slots - 1);
+}
+
+constexpr std::size_t count_segments(std::string_view path) {
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < path.size(); ++i)
+        if (path[i] != '/' && (i == 0 || path[i - 1] == '/'))
+            ++count;
+    return count;
+}
+
+// splits path into segments, returns max + 1 when there are more than max
+template <std::size_t Max>
+std::size_t split_segments(std::string_view path,
+                           std::array<std::string_view, Max + 1> &segments) {
+    std::size_t count = 0;
+    std::size_t start = path.find_first_not_of('/');
+    while (start != std::string_view::npos) {
+        if (count == Max)
+            return Max + 1;
+        auto end = path.find('/', start);
+        segments[count++] = path.substr(
+            start, end == std::string_view::npos ? std::string_view::npos : end - start);
+        start = path.find_first_not_of('/', end);
+    }
+    return count;
+}
+
+template <class F> struct static_route {
+    using return_type = ct::return_type_t<F>;
+    using designated_types =
+        tl::remove_if<is_context, ct::args_t<std::decay_t<F>, operation>, operation<>>;
+    using arguments = ct::args_t<std::decay_t<F>, std::tuple>;
+
+    static constexpr http_method method = return_type::method;
+    static constexpr std::string_view path{return_type::path.str(),
+                                           return_type::path.size()};
+    static constexpr std::size_t size = count_segments(path);
+
+    static constexpr std::array<std::string_view, size> segments = [] {
+        std::array<std::string_view, size> result{};
+        std::size_t count = 0;
+        for (std::size_t i = 0; i < path.size(); ++i) {
+            if (path[i] == '/' || (i && path[i - 1] != '/'))
+                continue;
+            auto end = path.find('/', i);
+            result[count++] = path.substr(i, end == std::string_view::npos
+                                                 ? std::string_view::npos
+                                                 : end - i);
+        }
+        return result;
+    }();
+
+    static constexpr bool is_param(std::string_view segment) {
+        return segment.size() > 2 && segment.front() == '{' && segment.back() == '}';
+    }
+
+    static constexpr std::size_t parameters = [] {
+        std::size_t count = 0;
+        for (auto s : segments)
+            count += is_param(s);
+        return count;
+    }();
+
+    static_assert(parameters <= path_captures::capacity, "too many path parameters");
+
+    static constexpr bool is_static = parameters == 0;
+
+    // validates a segment against the type of the path_param named name
+    template <std::size_t... I>
+    static bool valid(std::string_view name, std::string_view value,
+                      std::index_sequence<I...>) {
+        bool result = true;
+        (void)((check<std::tuple_element_t<I, arguments>>(name, value, result)) || ...);
+        return result;
+    }
+
+    template <class A>
+    static bool check(std::string_view name, std::string_view value, bool &result) {
+        using arg = std::remove_cvref_t<A>;
+        if constexpr (is_path_param_v<arg>) {
+            if (name != arg::name)
+                return false;
+            result = path::traits<typename arg::type>::valid(value);
+            return true;
+        } else
+            return false;
+    }
+
+    template <std::size_t Max>
+    static bool match(http_method m,
+                      const std::array<std::string_view, Max + 1> &request,
+                      std::size_t count, path_captures &captures) {
+        // GET routes answer HEAD requests
+        if (m != method && (m != http_method::HEAD || method != http_method::GET))
+            return false;
+        return match_path<Max>(request, count, captures);
+    }
+
+    template <std::size_t Max>
+    static bool match_path(const std::array<std::string_view, Max + 1> &request,
+                           std::size_t count, path_captures &captures) {
+        if (count != size)
+            return false;
+        captures.clear();
+        for (std::size_t i = 0; i < size; ++i) {
+            auto s = segments[i];
+            if (!is_param(s)) {
+                if (request[i] != s)
+                    return false;
+            } else if (valid(s.substr(1, s.size() - 2), request[i],
+                             std::make_index_sequence<std::tuple_size_v<arguments>>{}))
+                captures.push(request[i]);
+            else
+                return false;
+        }
+        return true;
+    }
+};
+
+} // namespace detail
+
+template <class... F> class static_router {
+    using routes = std::tuple<detail::static_route<F>...>;
+
+    template <std::size_t I> using route = std::tuple_element_t<I, routes>;
+
+    static constexpr std::size_t max_segments =
+        std::max({std::size_t{0}, detail::static_route<F>::size...});
+
+    using segments_t = std::array<std::string_view, max_segments + 1>;
+
+    static constexpr std::size_t static_count =
+        (std::size_t{0} + ... + detail::static_route<F>::is_static);
+
+    static constexpr std::size_t parameter_count = sizeof...(F) - static_count;
+
+    static constexpr uint16_t no_route = 0xffff;
+
+    // a route without parameters
+    struct entry {
+        uint64_t hash;
+        uint16_t index;
+        http_method method;
+        const std::string_view *segments;
+        std::size_t size;
+    };
+
+    // the routes without parameters in route order. Of two routes with the
+    // same method and path, the first one wins
+    static constexpr auto entries = []<std::size_t... I>(std::index_sequence<I...>) {
+        std::array<entry, std::max<std::size_t>(static_count, 1)> result{};
+        std::size_t count = 0;
+        auto add = [&]<std::size_t Index>() {
+            using R = route<Index>;
+            if constexpr (R::is_static)
+                result[count++] = {detail::route_hash(R::method, R::segments.data(), R::size),
+                                   static_cast<uint16_t>(Index), R::method,
+                                   R::segments.data(), R::size};
+        };
+        (add.template operator()<I>(), ...);
+        return result;
+    }(std::index_sequence_for<F...>{});
+
+    // routes repeating the hash of an earlier route have to be the same route
+    static_assert([] {
+        for (std::size_t i = 0; i < static_count; ++i)
+            for (std::size_t j = 0; j < i; ++j) {
+                auto &a = entries[i];
+                auto &b = entries[j];
+                if (a.hash != b.hash)
+                    continue;
+                if (a.method != b.method || a.size != b.size)
+                    return false;
+                for (std::size_t k = 0; k < a.size; ++k)
+                    if (a.segments[k] != b.segments[k])
+                        return false;
+            }
+        return true;
+    }(), "static_router: two routes have the same hash");
+
+    template <std::size_t Slots> struct hash_table {
+        static constexpr std::size_t buckets = std::max<std::size_t>(Slots / 2, 1);
+
+        std::array<uint32_t, buckets> displacements{};
+        std::array<uint16_t, Slots> routes{};
+        bool complete{false};
+
+        static constexpr std::size_t bucket(uint64_t h) { return (h >> 32) & (buckets - 1); }
+    };
+
+    // the largest buckets are placed first, while most slots are free. A
+    // bucket whose routes find no free slots leaves the table incomplete
+    template <std::size_t Slots> static constexpr hash_table<Slots> place() {
+        using table_t = hash_table<Slots>;
+        constexpr std::size_t size = std::max<std::size_t>(static_count, 1);
+        table_t t{};
+        t.routes.fill(no_route);
+
+        // the entries of bucket b are members[first[b]] to members[first[b + 1]],
+        // a route repeating an earlier one is left out
+        std::array<bool, size> repeated{};
+        for (std::size_t i = 0; i < static_count; ++i)
+            for (std::size_t j = 0; j < i && !repeated[i]; ++j)
+                repeated[i] = entries[j].hash == entries[i].hash;
+
+        std::array<uint16_t, table_t::buckets + 1> first{};
+        for (std::size_t i = 0; i < static_count; ++i)
+            if (!repeated[i])
+                ++first[table_t::bucket(entries[i].hash) + 1];
+        std::size_t largest = 0;
+        for (std::size_t b = 0; b < table_t::buckets; ++b) {
+            largest = std::max<std::size_t>(largest, first[b + 1]);
+            first[b + 1] += first[b];
+        }
+
+        std::array<uint16_t, size> members{};
+        std::array<uint16_t, table_t::buckets> filled{};
+        for (std::size_t i = 0; i < static_count; ++i)
+            if (!repeated[i]) {
+                auto b = table_t::bucket(entries[i].hash);
+                members[first[b] + filled[b]++] = static_cast<uint16_t>(i);
+            }
+
+        std::array<std::size_t, size> slots{};
+        for (auto count = largest; count > 0; --count)
+            for (std::size_t b = 0; b < table_t::buckets; ++b) {
+                if (first[b + 1] - first[b] != count)
+                    continue;
+
+                bool free = false;
+                uint32_t d = 0;
+                for (; d < 4096; ++d) {
+                    free = true;
+                    for (std::size_t k = 0; k < count && free; ++k) {
+                        slots[k] = detail::route_slot(entries[members[first[b] + k]].hash, d,
+                                                      Slots);
+                        free = t.routes[slots[k]] == no_route;
+                        for (std::size_t j = 0; j < k && free; ++j)
+                            free = slots[j] != slots[k];
+                    }
+                    if (free)
+                        break;
+                }
+                if (!free)
+                    return t;
+
+                t.displacements[b] = d;
+                for (std::size_t k = 0; k < count; ++k)
+                    t.routes[slots[k]] = entries[members[first[b] + k]].index;
+            }
+        t.complete = true;
+        return t;
+    }
+
+    // twice as many slots as routes, more in the unlikely case that a
+    // bucket finds no displacement
+    template <std::size_t Slots> static constexpr std::size_t find_size() {
+        if constexpr (place<Slots>().complete)
+            return Slots;
+        else
+            return find_size<Slots * 2>();
+    }
+
+    static constexpr std::size_t table_size =
+        find_size<std::bit_ceil(std::max<std::size_t>(2 * static_count, 1))>();
+
+    static constexpr hash_table<table_size> table = place<table_size>();
+
+    // the routes with parameters grouped by number of segments, in route
+    // order: the ones of count c are routes[first[c]] to routes[first[c + 1]]
+    struct segment_groups {
+        std::array<uint16_t, max_segments + 2> first{};
+        std::array<uint16_t, std::max<std::size_t>(parameter_count, 1)> routes{};
+    };
+
+    static constexpr segment_groups parameter_routes =
+        []<std::size_t... I>(std::index_sequence<I...>) {
+            segment_groups g{};
+            auto count = [&]<std::size_t Index>() {
+                using R = route<Index>;
+                if constexpr (!R::is_static)
+                    ++g.first[R::size + 1];
+            };
+            (count.template operator()<I>(), ...);
+            for (std::size_t c = 0; c <= max_segments; ++c)
+                g.first[c + 1] += g.first[c];
+
+            std::array<uint16_t, max_segments + 1> filled{};
+            auto place = [&]<std::size_t Index>() {
+                using R = route<Index>;
+                if constexpr (!R::is_static)
+                    g.routes[g.first[R::size] + filled[R::size]++] = static_cast<uint16_t>(Index);
+            };
+            (place.template operator()<I>(), ...);
+            return g;
+        }(std::index_sequence_for<F...>{});
+
+    using thunk_t = bool (*)(static_router &, context &, const segments_t &, std::size_t);
+
+    template <std::size_t... I>
+    static constexpr std::array<thunk_t, sizeof...(F)> make_jump_table(std::index_sequence<I...>) {
+        return {&static_router::template try_route<I>...};
+    }
+
+public:
+    static_assert(sizeof...(F) < 65535, "too many static routes");
+
+    explicit static_router(F... f) : handlers_{std::move(f)...} {}
+
+    /// calls the handler of the route matching the request, returns false
+    /// when there is none
+    bool dispatch(context &ctx, std::string_view path) {
+        segments_t segments;
+        auto count = detail::split_segments<max_segments>(path, segments);
+        if (count > max_segments)
+            return false;
+
+        static constexpr auto jump_table = make_jump_table(std::index_sequence_for<F...>{});
+
+        if constexpr (static_count > 0) {
+            auto find = [&](http_method method) {
+                auto h = detail::route_hash(method, segments.data(), count);
+                auto d = table.displacements[hash_table<table_size>::bucket(h)];
+                auto i = table.routes[detail::route_slot(h, d, table_size)];
+                return i != no_route && jump_table[i](*this, ctx, segments, count);
+            };
+            if (find(ctx.method()) ||
+                (ctx.method() == http_method::HEAD && find(http_method::GET)))
+                return true;
+        }
+
+        if constexpr (parameter_count > 0) {
+            auto &g = parameter_routes;
+            for (auto i = g.first[count]; i < g.first[count + 1]; ++i)
+                if (jump_table[g.routes[i]](*this, ctx, segments, count))
+                    return true;
+        }
+        return false;
+    }
+
+    /// the methods of the routes matching path, for the Allow header of a
+    /// request that dispatch() did not handle
+    uint64_t methods(std::string_view path) const {
+        segments_t segments;
+        auto count = detail::split_segments<max_segments>(path, segments);
+        if (count > max_segments)
+            return 0;
+
+        path_captures captures;
+        uint64_t mask = 0;
+        auto add = [&]<class R>() {
+            if (R::template match_path<max_segments>(segments, count, captures))
+                mask |= route_table::bit(R::method);
+        };
+        (add.template operator()<detail::static_route<F>>(), ...);
+        return mask;
+    }
+
+    /// the methods of all the routes, for OPTIONS *
+    static constexpr uint64_t methods() {
+        return (uint64_t{0} | ... | route_table::bit(detail::static_route<F>::method));
+    }
+
+    /// adds the routes to the swagger description
+    static void describe() { (describe<F>(), ...); }
+
+private:
+    template <std::size_t I>
+    static bool try_route(static_router &self, context &ctx, const segments_t &segments,
+                          std::size_t count) {
+        using R = route<I>;
+        if (!R::template match<max_segments>(ctx.method(), segments, count,
+                                             ctx.path_params()))
+            return false;
+
+        try {
+            unpacker<typename R::designated_types::parameters_t>::execute(
+                std::get<I>(self.handlers_), ctx);
+        } catch (...) {
+            // try to clean whatever is written in the response buffer
+            ctx.clear();
+            throw;
+        }
+        return true;
+    }
+
+    template <class H> static void describe() {
+        using R = detail::static_route<H>;
+        json v = unpacker<typename R::designated_types::parameters_t>::describe();
+        if (v.size())
+            api_manager::instance().swagger_["paths"][std::string(R::path)][to_string(
+                R::method)]["parameters"] = v;
+        router_parameters{R::path, R::method};
+    }
+
+    std::tuple<F...> handlers_;
+};
+
+template <class... F> static_router(F...) -> static_router<F...>;
+
+} // namespace scymnus
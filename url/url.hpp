@@ -2,11 +2,14 @@
 
 #include <limits>
 #include <map>
+#include <memory_resource>
 #include <optional>
 #include <string>
 #include <string_view>
 #include <vector>
 
+#include "utilities/simd.hpp"
+
 //#include <span> gcc 10
 
 namespace scymnus {
@@ -35,7 +38,7 @@ namespace details {
 
 // ref:
 // https://stackoverflow.com/questions/313970/how-to-convert-stdstring-to-lower-case
-char tolower_ascii(char in) {
+inline char tolower_ascii(char in) {
     if (in <= 'Z' && in >= 'A')
         return in - ('Z' - 'z');
     return in;
@@ -641,7 +644,7 @@ template <class F> std::string encode(const std::string &raw, F should_encode) {
     return encoded;
 }
 
-std::string encode_query(const std::string &raw) {
+inline std::string encode_query(const std::string &raw) {
     return encode(raw, [](int ch) -> bool {
         switch (ch) {
             // Encode '&', ';', and '=' since they are used
@@ -662,7 +665,7 @@ std::string encode_query(const std::string &raw) {
 /// Encodes a string by converting all characters except for RFC 3986 unreserved
 /// characters to their hexadecimal representation.
 /// </summary>
-std::string encode_data_string(const std::string &data) {
+inline std::string encode_data_string(const std::string &data) {
 
     return encode(data,
                   [](int ch) -> bool { return !details::is_unreserved(ch); });
@@ -719,4 +722,150 @@ template <class String> static String decode_template(const String &encoded) {
 template <class T> std::string uri<T>::decode(const std::string &encoded) {
     return decode_template<std::string>(encoded);
 }
+
+// The target of a request, parsed in one pass on the request path. The path is
+// percent-decoded, its dot segments are removed (RFC 3986 5.2.4), empty
+// segments and a trailing '/' are dropped. "%2F" and "%00" stay encoded, as
+// they would change the segments or end a C string, and so does an invalid
+// escape. The path points into the target when it is already in this form,
+// otherwise into the buffer given to parse_request_target. The query is the
+// raw text after '?', without the fragment.
+struct request_target {
+    std::string_view path;
+    std::string_view query;
+};
+
+namespace details {
+
+inline int hex_value(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// true when path has a '%', a "//", a "/." or a trailing '/', the cases that
+// the path has to be rewritten for. Paths without them are routed as they are
+inline bool needs_rewrite(std::string_view path) {
+    if (path.size() > 1 && path.back() == '/')
+        return true;
+    std::size_t i = 0;
+#ifdef SCYMNUS_SIMD_X86
+    // bit i of slash is set when path[i] == '/', a pair starts at a '/' whose
+    // next byte is '/' or '.'. The last '/' of a block is carried to the next
+    uint32_t carry = 0;
+    for (; i + 16 <= path.size(); i += 16) {
+        auto block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(path.data() + i));
+        auto slash = static_cast<uint32_t>(
+            _mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8('/'))));
+        auto dot = static_cast<uint32_t>(
+            _mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8('.'))));
+        auto percent = static_cast<uint32_t>(
+            _mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8('%'))));
+        if (percent || (((slash << 1) | carry) & (slash | dot)))
+            return true;
+        carry = slash >> 15;
+    }
+    if (carry && i < path.size() && (path[i] == '/' || path[i] == '.'))
+        return true;
+#endif
+    for (; i < path.size(); ++i) {
+        if (path[i] == '%')
+            return true;
+        if (path[i] == '/' && i + 1 < path.size() &&
+            (path[i + 1] == '/' || path[i + 1] == '.'))
+            return true;
+    }
+    return false;
+}
+
+// writes the normalized path into buffer, which is not reallocated once it has
+// grown to the size of the longest path
+inline std::string_view rewrite_path(std::string_view path, std::pmr::string &buffer) {
+    buffer.resize(path.size() + 1);
+    char *out = buffer.data();
+    std::size_t size = 0;
+
+    std::size_t i = 0;
+    while (i < path.size()) {
+        if (path[i] == '/') {
+            ++i;
+            continue;
+        }
+        auto end = utils::simd::find(path, '/', i);
+        if (end == std::string_view::npos)
+            end = path.size();
+
+        auto start = size;
+        out[size++] = '/';
+        for (; i < end; ++i) {
+            int h, l;
+            if (path[i] == '%' && i + 2 < end && (h = hex_value(path[i + 1])) >= 0 &&
+                (l = hex_value(path[i + 2])) >= 0 && (h | l) != 0 && !(h == 2 && l == 15)) {
+                out[size++] = static_cast<char>(h * 16 + l);
+                i += 2;
+            } else
+                out[size++] = path[i];
+        }
+
+        std::string_view segment{out + start + 1, size - start - 1};
+        if (segment == ".")
+            size = start;
+        else if (segment == "..") {
+            size = start;
+            while (size && out[size - 1] != '/')
+                --size;
+            if (size)
+                --size;
+        }
+    }
+
+    if (!size)
+        out[size++] = '/';
+    buffer.resize(size);
+    return buffer;
+}
+
+} // namespace details
+
+/// splits target into path and query. Origin-form ("/a/b?c"), absolute-form
+/// ("http://host/a/b?c", scheme and authority are skipped) and "*" are
+/// accepted, nullopt is returned for anything else
+inline std::optional<request_target> parse_request_target(std::string_view target,
+                                                          std::pmr::string &buffer) {
+    request_target result;
+    if (target == "*") {
+        result.path = target;
+        return result;
+    }
+
+    if (target.empty() || target.front() != '/') {
+        auto scheme = target.find("://");
+        if (scheme == 0 || scheme == std::string_view::npos)
+            return std::nullopt;
+        for (std::size_t i = 0; i < scheme; ++i)
+            if (!details::is_scheme_character(static_cast<unsigned char>(target[i])))
+                return std::nullopt;
+        auto start = utils::simd::find_first_of(target, "/?#", scheme + 3);
+        target.remove_prefix(start == std::string_view::npos ? target.size() : start);
+    }
+
+    auto end = utils::simd::find_first_of(target, "?#");
+    auto path = target.substr(0, end);
+    if (end != std::string_view::npos && target[end] == '?') {
+        auto query = target.substr(end + 1);
+        result.query = query.substr(0, utils::simd::find(query, '#'));
+    }
+
+    if (path.empty())
+        result.path = "/";
+    else if (details::needs_rewrite(path))
+        result.path = details::rewrite_path(path, buffer);
+    else
+        result.path = path;
+    return result;
+}
 } // namespace scymnus
@@ -0,0 +1,453 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace scymnus {
+namespace utils {
+
+// Regular expression compiled into a deterministic automaton, used to
+// validate path segments. The pattern always has to match the whole input
+// (^ and $ are accepted and ignored). Supported syntax: literals, '.',
+// classes ([a-z0-9_-], [^...]), the escapes \d \w \s \D \W \S, groups
+// ((...), (?:...)), alternation and the quantifiers * + ? {n} {n,} {n,m}.
+// Backreferences and lookarounds are not supported.
+//
+// The pattern is parsed, turned into an NFA and the NFA into a DFA by subset
+// construction. Bytes that no part of the pattern tells apart share a column
+// of the transition table, so matching is one table lookup per byte, in
+// linear time and without allocating.
+class regex_dfa {
+public:
+    /// throws std::invalid_argument when the pattern is not valid or its
+    /// automaton has more than max_states states
+    explicit regex_dfa(std::string_view pattern) {
+        parser p{pattern};
+        auto root = p.parse();
+
+        nfa n;
+        n.states.emplace_back();
+        auto accept = n.build(p.nodes, root, 0);
+
+        compile(n, accept);
+    }
+
+    /// whether the whole of text matches the pattern
+    bool match(std::string_view text) const {
+        uint32_t state = start;
+        for (unsigned char c : text) {
+            state = transitions_[state * class_count_ + classes_[c]];
+            if (state == dead)
+                return false;
+        }
+        return accepting_[state];
+    }
+
+    /// number of states of the automaton, the dead state included
+    std::size_t size() const { return accepting_.size(); }
+
+    static constexpr std::size_t max_states = 4096;
+    static constexpr int max_repetitions = 255;
+
+private:
+    using byte_set = std::bitset<256>;
+
+    static constexpr uint32_t dead = 0;
+    static constexpr uint32_t start = 1;
+
+    struct ast_node {
+        enum kind_t : uint8_t { Set, Concat, Alternation, Repeat } kind;
+        byte_set set{};
+        std::vector<int> children{};
+        int min{0};
+        int max{0}; // -1 for no upper bound
+    };
+
+    // recursive descent over pattern, the nodes are kept in nodes
+    struct parser {
+        std::string_view pattern;
+        std::size_t pos{0};
+        std::vector<ast_node> nodes{};
+
+        int parse() {
+            if (pos < pattern.size() && pattern[pos] == '^')
+                ++pos;
+            auto root = alternation();
+            if (pos != pattern.size())
+                fail("unbalanced ')'");
+            return root;
+        }
+
+        [[noreturn]] void fail(const char *what) const {
+            throw std::invalid_argument("invalid regular expression '" +
+                                        std::string(pattern) + "': " + what);
+        }
+
+        int add(ast_node n) {
+            nodes.push_back(std::move(n));
+            return static_cast<int>(nodes.size() - 1);
+        }
+
+        bool more() const {
+            return pos < pattern.size() && pattern[pos] != '|' && pattern[pos] != ')';
+        }
+
+        int alternation() {
+            auto first = concatenation();
+            if (pos == pattern.size() || pattern[pos] != '|')
+                return first;
+            ast_node n{ast_node::Alternation};
+            n.children.push_back(first);
+            while (pos < pattern.size() && pattern[pos] == '|') {
+                ++pos;
+                n.children.push_back(concatenation());
+            }
+            return add(std::move(n));
+        }
+
+        int concatenation() {
+            ast_node n{ast_node::Concat};
+            while (more()) {
+                if (pattern[pos] == '$' && pos + 1 == pattern.size()) {
+                    ++pos;
+                    break;
+                }
+                n.children.push_back(repetition());
+            }
+            return add(std::move(n));
+        }
+
+        int repetition() {
+            auto atom = this->atom();
+            while (pos < pattern.size()) {
+                int min, max;
+                char c = pattern[pos];
+                if (c == '*')
+                    min = 0, max = -1;
+                else if (c == '+')
+                    min = 1, max = -1;
+                else if (c == '?')
+                    min = 0, max = 1;
+                else if (c == '{' && bounds(min, max))
+                    ;
+                else
+                    break;
+                if (c != '{')
+                    ++pos;
+                ast_node n{ast_node::Repeat};
+                n.children.push_back(atom);
+                n.min = min;
+                n.max = max;
+                atom = add(std::move(n));
+            }
+            return atom;
+        }
+
+        // {n}, {n,} or {n,m}, a '{' not followed by them is a literal
+        bool bounds(int &min, int &max) {
+            auto p = pos + 1;
+            auto number = [&](int &value) {
+                auto begin = p;
+                value = 0;
+                while (p < pattern.size() && pattern[p] >= '0' && pattern[p] <= '9') {
+                    value = value * 10 + (pattern[p++] - '0');
+                    if (value > max_repetitions)
+                        fail("too many repetitions");
+                }
+                return p != begin;
+            };
+            if (!number(min))
+                return false;
+            max = min;
+            if (p < pattern.size() && pattern[p] == ',') {
+                ++p;
+                if (!number(max))
+                    max = -1;
+            }
+            if (p >= pattern.size() || pattern[p] != '}')
+                return false;
+            if (max != -1 && max < min)
+                fail("invalid repetition bounds");
+            pos = p + 1;
+            return true;
+        }
+
+        int atom() {
+            char c = pattern[pos++];
+            switch (c) {
+            case '(': {
+                if (pattern.substr(pos, 2) == "?:")
+                    pos += 2;
+                auto inner = alternation();
+                if (pos == pattern.size() || pattern[pos] != ')')
+                    fail("missing ')'");
+                ++pos;
+                return inner;
+            }
+            case '[':
+                return add({ast_node::Set, bracket()});
+            case '.':
+                return add({ast_node::Set, byte_set{}.set()});
+            case '\\':
+                return add({ast_node::Set, escape()});
+            case '*':
+            case '+':
+            case '?':
+                fail("nothing to repeat");
+            default: {
+                byte_set s;
+                s.set(static_cast<unsigned char>(c));
+                return add({ast_node::Set, s});
+            }
+            }
+        }
+
+        byte_set escape() {
+            if (pos == pattern.size())
+                fail("trailing '\\'");
+            byte_set s;
+            char c = pattern[pos++];
+            switch (c) {
+            case 'd':
+            case 'D':
+                for (int b = '0'; b <= '9'; ++b)
+                    s.set(b);
+                break;
+            case 'w':
+            case 'W':
+                for (int b = 0; b < 256; ++b)
+                    if ((b >= '0' && b <= '9') || (b >= 'a' && b <= 'z') ||
+                        (b >= 'A' && b <= 'Z') || b == '_')
+                        s.set(b);
+                break;
+            case 's':
+            case 'S':
+                for (char b : {' ', '\t', '\n', '\r', '\f', '\v'})
+                    s.set(static_cast<unsigned char>(b));
+                break;
+            case 'n':
+                s.set('\n');
+                return s;
+            case 't':
+                s.set('\t');
+                return s;
+            default:
+                if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                    (c >= '0' && c <= '9'))
+                    fail("unsupported escape");
+                s.set(static_cast<unsigned char>(c));
+                return s;
+            }
+            return c >= 'A' && c <= 'Z' ? ~s : s;
+        }
+
+        byte_set bracket() {
+            byte_set s;
+            bool negated = pos < pattern.size() && pattern[pos] == '^';
+            if (negated)
+                ++pos;
+            bool first = true;
+            while (true) {
+                if (pos == pattern.size())
+                    fail("missing ']'");
+                char c = pattern[pos];
+                if (c == ']' && !first)
+                    break;
+                first = false;
+                ++pos;
+
+                if (c == '\\') {
+                    auto e = escape();
+                    if (e.count() != 1) {
+                        s |= e;
+                        continue;
+                    }
+                    c = static_cast<char>(first_byte(e));
+                }
+
+                unsigned char low = c, high = c;
+                if (pos + 1 < pattern.size() && pattern[pos] == '-' &&
+                    pattern[pos + 1] != ']') {
+                    pos++;
+                    char h = pattern[pos++];
+                    if (h == '\\') {
+                        auto e = escape();
+                        if (e.count() != 1)
+                            fail("invalid range");
+                        h = static_cast<char>(first_byte(e));
+                    }
+                    high = h;
+                    if (high < low)
+                        fail("invalid range");
+                }
+                for (unsigned b = low; b <= high; ++b)
+                    s.set(b);
+            }
+            ++pos;
+            return negated ? ~s : s;
+        }
+
+        static unsigned first_byte(const byte_set &s) {
+            for (unsigned b = 0; b < 256; ++b)
+                if (s[b])
+                    return b;
+            return 0;
+        }
+    };
+
+    // Thompson construction, states are connected by epsilon moves and by
+    // moves on the bytes of a set
+    struct nfa {
+        struct state {
+            std::vector<uint32_t> epsilon;
+            std::vector<std::pair<uint32_t, uint32_t>> moves; // set, target
+        };
+
+        std::vector<state> states;
+        std::vector<byte_set> sets;
+
+        uint32_t add() {
+            if (states.size() > 64 * max_states)
+                throw std::invalid_argument("regular expression is too large");
+            states.emplace_back();
+            return static_cast<uint32_t>(states.size() - 1);
+        }
+
+        // the state reached after matching node n from state in
+        uint32_t build(const std::vector<ast_node> &nodes, int n, uint32_t in) {
+            auto &node = nodes[n];
+            switch (node.kind) {
+            case ast_node::Set: {
+                auto out = add();
+                sets.push_back(node.set);
+                states[in].moves.emplace_back(static_cast<uint32_t>(sets.size() - 1), out);
+                return out;
+            }
+            case ast_node::Concat:
+                for (auto c : node.children)
+                    in = build(nodes, c, in);
+                return in;
+            case ast_node::Alternation: {
+                auto out = add();
+                for (auto c : node.children) {
+                    auto s = add();
+                    states[in].epsilon.push_back(s);
+                    states[build(nodes, c, s)].epsilon.push_back(out);
+                }
+                return out;
+            }
+            case ast_node::Repeat: {
+                auto child = node.children[0];
+                for (int i = 0; i < node.min; ++i)
+                    in = build(nodes, child, in);
+                if (node.max == -1) {
+                    auto loop = add();
+                    states[in].epsilon.push_back(loop);
+                    states[build(nodes, child, loop)].epsilon.push_back(loop);
+                    return loop;
+                }
+                auto out = add();
+                states[in].epsilon.push_back(out);
+                for (int i = node.min; i < node.max; ++i) {
+                    in = build(nodes, child, in);
+                    states[in].epsilon.push_back(out);
+                }
+                return out;
+            }
+            }
+            return in;
+        }
+
+        void closure(std::vector<uint32_t> &set, std::vector<uint8_t> &seen) const {
+            std::fill(seen.begin(), seen.end(), 0);
+            std::vector<uint32_t> stack = set;
+            for (auto s : set)
+                seen[s] = 1;
+            while (!stack.empty()) {
+                auto s = stack.back();
+                stack.pop_back();
+                for (auto e : states[s].epsilon)
+                    if (!seen[e]) {
+                        seen[e] = 1;
+                        set.push_back(e);
+                        stack.push_back(e);
+                    }
+            }
+            std::sort(set.begin(), set.end());
+        }
+    };
+
+    void compile(const nfa &n, uint32_t accept) {
+        // bytes belonging to the same sets share a class
+        classes_.fill(0);
+        class_count_ = 1;
+        for (auto &set : n.sets) {
+            std::map<std::pair<uint16_t, bool>, uint16_t> split;
+            uint16_t count = 0;
+            for (unsigned b = 0; b < 256; ++b) {
+                auto [it, inserted] = split.try_emplace({classes_[b], set[b]}, count);
+                if (inserted)
+                    ++count;
+                classes_[b] = it->second;
+            }
+            class_count_ = count;
+        }
+        std::vector<unsigned char> representative(class_count_);
+        for (unsigned b = 256; b-- > 0;)
+            representative[classes_[b]] = static_cast<unsigned char>(b);
+
+        std::vector<uint8_t> seen(n.states.size());
+        std::map<std::vector<uint32_t>, uint32_t> known;
+        std::vector<std::vector<uint32_t>> pending;
+
+        auto state_of = [&](std::vector<uint32_t> set) -> uint32_t {
+            if (set.empty())
+                return dead;
+            n.closure(set, seen);
+            auto [it, inserted] =
+                known.try_emplace(set, static_cast<uint32_t>(accepting_.size()));
+            if (inserted) {
+                if (accepting_.size() == max_states)
+                    throw std::invalid_argument("regular expression is too large");
+                accepting_.push_back(std::binary_search(set.begin(), set.end(), accept));
+                transitions_.resize(accepting_.size() * class_count_, dead);
+                pending.push_back(std::move(set));
+            }
+            return it->second;
+        };
+
+        accepting_.push_back(false); // dead
+        transitions_.resize(class_count_, dead);
+        state_of({0});
+
+        for (uint32_t current = start; current - start < pending.size(); ++current) {
+            auto set = pending[current - start];
+            for (uint16_t c = 0; c < class_count_; ++c) {
+                std::vector<uint32_t> next;
+                for (auto s : set)
+                    for (auto [move, target] : n.states[s].moves)
+                        if (n.sets[move][representative[c]])
+                            next.push_back(target);
+                std::sort(next.begin(), next.end());
+                next.erase(std::unique(next.begin(), next.end()), next.end());
+                auto target = state_of(std::move(next));
+                transitions_[current * class_count_ + c] = target;
+            }
+        }
+    }
+
+    std::array<uint16_t, 256> classes_{};
+    uint32_t class_count_{1};
+    std::vector<uint32_t> transitions_;
+    std::vector<uint8_t> accepting_;
+};
+
+} // namespace utils
+} // namespace scymnus
@@ -0,0 +1,579 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#if defined(__x86_64__) && defined(__SSE4_2__)
+#include <immintrin.h>
+#define SCYMNUS_SIMD_X86 1
+#endif
+
+namespace scymnus {
+namespace utils {
+namespace simd {
+
+// Byte scanning and ASCII case folding for urls, query strings and headers,
+// and the JSON string kernels of the writers (the bytes to escape, UTF-8
+// validation). On x86-64 the set searches use the SSE4.2 string instructions
+// (pcmpestri, up to 16 delimiters) and the case folding, case insensitive
+// comparisons and JSON kernels use SSE2/SSSE3, with AVX2 versions picked at
+// runtime for long inputs (and small sets). Other targets use the scalar
+// versions, which are also the reference for the benchmarks.
+
+inline constexpr std::size_t npos = std::string_view::npos;
+
+namespace scalar {
+
+constexpr char to_lower(char c) { return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c; }
+
+inline std::size_t find(std::string_view s, char c, std::size_t pos = 0) {
+    for (; pos < s.size(); ++pos)
+        if (s[pos] == c)
+            return pos;
+    return npos;
+}
+
+inline std::size_t find_first_of(std::string_view s, std::string_view set,
+                                 std::size_t pos = 0) {
+    for (; pos < s.size(); ++pos)
+        if (set.find(s[pos]) != npos)
+            return pos;
+    return npos;
+}
+
+inline std::size_t find_first_not_of(std::string_view s, std::string_view set,
+                                     std::size_t pos = 0) {
+    for (; pos < s.size(); ++pos)
+        if (set.find(s[pos]) == npos)
+            return pos;
+    return npos;
+}
+
+inline void to_lower(char *data, std::size_t size) {
+    for (std::size_t i = 0; i < size; ++i)
+        data[i] = to_lower(data[i]);
+}
+
+// <0, 0 or >0 comparing the lower case forms of a and b
+inline int icompare(std::string_view a, std::string_view b) {
+    auto size = a.size() < b.size() ? a.size() : b.size();
+    for (std::size_t i = 0; i < size; ++i) {
+        auto l = static_cast<unsigned char>(to_lower(a[i]));
+        auto r = static_cast<unsigned char>(to_lower(b[i]));
+        if (l != r)
+            return l < r ? -1 : 1;
+    }
+    return a.size() == b.size() ? 0 : a.size() < b.size() ? -1 : 1;
+}
+
+inline bool iequals(std::string_view a, std::string_view b) {
+    return a.size() == b.size() && icompare(a, b) == 0;
+}
+
+// whether c is written escaped in a JSON string
+constexpr bool json_escaped(unsigned char c) { return c < 0x20 || c == '"' || c == '\\'; }
+
+inline std::size_t find_json_escape(std::string_view s, std::size_t pos = 0) {
+    for (; pos < s.size(); ++pos)
+        if (json_escaped(static_cast<unsigned char>(s[pos])))
+            return pos;
+    return npos;
+}
+
+// length of the UTF-8 sequence starting at p, 0 if it is not valid (overlong
+// forms, surrogates and code points above U+10FFFF included)
+inline std::size_t utf8_sequence(const char *p, const char *end) {
+    auto byte = [&](std::size_t i) { return static_cast<unsigned char>(p[i]); };
+    auto continuation = [&](std::size_t i, unsigned char low = 0x80, unsigned char high = 0xBF) {
+        return p + i < end && byte(i) >= low && byte(i) <= high;
+    };
+
+    auto lead = byte(0);
+    if (lead < 0x80)
+        return 1;
+    if (lead >= 0xC2 && lead <= 0xDF && continuation(1))
+        return 2;
+    if (lead >= 0xE0 && lead <= 0xEF &&
+        continuation(1, lead == 0xE0 ? 0xA0 : 0x80, lead == 0xED ? 0x9F : 0xBF) &&
+        continuation(2))
+        return 3;
+    if (lead >= 0xF0 && lead <= 0xF4 &&
+        continuation(1, lead == 0xF0 ? 0x90 : 0x80, lead == 0xF4 ? 0x8F : 0xBF) &&
+        continuation(2) && continuation(3))
+        return 4;
+    return 0;
+}
+
+inline bool valid_utf8(std::string_view s) {
+    auto p = s.data(), end = s.data() + s.size();
+    while (p != end) {
+        auto n = utf8_sequence(p, end);
+        if (!n)
+            return false;
+        p += n;
+    }
+    return true;
+}
+
+} // namespace scalar
+
+/// position of the first c in s at or after pos, or npos. memchr of the C
+/// library is already vectorized and faster than a loop of compares here
+inline std::size_t find(std::string_view s, char c, std::size_t pos = 0) {
+    if (pos >= s.size())
+        return npos;
+    auto p = static_cast<const char *>(std::memchr(s.data() + pos, c, s.size() - pos));
+    return p ? static_cast<std::size_t>(p - s.data()) : npos;
+}
+
+#ifdef SCYMNUS_SIMD_X86
+
+namespace detail {
+
+inline const bool avx2 = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+
+// below this size the AVX2 versions are not worth the call
+inline constexpr std::size_t avx2_threshold = 64;
+
+// size bytes at s, at most 16, in a zeroed block so nothing past s + size is read
+inline __m128i load_tail(const char *s, std::size_t size) {
+    alignas(16) char block[16]{};
+    std::memcpy(block, s, size);
+    return _mm_load_si128(reinterpret_cast<const __m128i *>(block));
+}
+
+inline __m128i load_set(std::string_view set) {
+    if (set.size() == 16)
+        return _mm_loadu_si128(reinterpret_cast<const __m128i *>(set.data()));
+    return load_tail(set.data(), set.size());
+}
+
+// 'A'..'Z' become 'a'..'z', bytes >= 0x80 are negative and left alone
+inline __m128i lower(__m128i v) {
+    auto upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+                               _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+    return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+__attribute__((target("avx2"))) inline __m256i lower(__m256i v) {
+    auto upper = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)),
+                                  _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));
+    return _mm256_or_si256(v, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
+
+// lower cases the blocks of 32 bytes of data, returns where they end
+__attribute__((target("avx2"))) inline std::size_t to_lower_avx2(char *data, std::size_t size) {
+    std::size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        auto p = reinterpret_cast<__m256i *>(data + i);
+        _mm256_storeu_si256(p, lower(_mm256_loadu_si256(p)));
+    }
+    return i;
+}
+
+// index of the first byte that differs ignoring case, or size
+__attribute__((target("avx2"))) inline std::size_t
+imismatch_avx2(const char *a, const char *b, std::size_t i, std::size_t size) {
+    for (; i + 32 <= size; i += 32) {
+        auto l = lower(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i)));
+        auto r = lower(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i)));
+        auto mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(l, r)));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return i;
+}
+
+inline std::size_t imismatch(const char *a, const char *b, std::size_t size) {
+    std::size_t i = 0;
+    if (size >= avx2_threshold && avx2) {
+        i = imismatch_avx2(a, b, 0, size);
+        if (i + 32 <= size)
+            return i;
+    }
+    for (; i + 16 <= size; i += 16) {
+        auto l = lower(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)));
+        auto r = lower(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+        auto mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(l, r))) ^ 0xffff;
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    for (; i < size; ++i)
+        if (scalar::to_lower(a[i]) != scalar::to_lower(b[i]))
+            return i;
+    return size;
+}
+
+// the bytes of v written escaped in a JSON string: controls, '"' and '\\'
+inline __m128i json_escaped(__m128i v) {
+    auto control = _mm_cmpeq_epi8(_mm_subs_epu8(v, _mm_set1_epi8(0x1F)), _mm_setzero_si128());
+    return _mm_or_si128(control, _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                                              _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))));
+}
+
+__attribute__((target("avx2"))) inline __m256i json_escaped(__m256i v) {
+    auto control =
+        _mm256_cmpeq_epi8(_mm256_subs_epu8(v, _mm256_set1_epi8(0x1F)), _mm256_setzero_si256());
+    return _mm256_or_si256(control,
+                           _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')),
+                                           _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))));
+}
+
+// sets searched with one compare per byte of the set, larger ones are faster
+// with pcmpestri
+inline constexpr std::size_t avx2_set_size = 6;
+
+// index of the first byte of s in set, of at most avx2_set_size bytes, or
+// where less than 32 bytes are left
+__attribute__((target("avx2"))) inline std::size_t
+find_first_of_avx2(const char *s, std::size_t i, std::size_t size, std::string_view set) {
+    __m256i needles[avx2_set_size];
+    for (std::size_t k = 0; k < set.size(); ++k)
+        needles[k] = _mm256_set1_epi8(set[k]);
+    for (; i + 32 <= size; i += 32) {
+        auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+        auto found = _mm256_cmpeq_epi8(v, needles[0]);
+        for (std::size_t k = 1; k < set.size(); ++k)
+            found = _mm256_or_si256(found, _mm256_cmpeq_epi8(v, needles[k]));
+        auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(found));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return i;
+}
+
+// index of the first byte to escape, or where less than 32 bytes are left
+__attribute__((target("avx2"))) inline std::size_t find_json_escape_avx2(const char *s,
+                                                                         std::size_t i,
+                                                                         std::size_t size) {
+    for (; i + 32 <= size; i += 32) {
+        auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+        auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(json_escaped(v)));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return i;
+}
+
+// UTF-8 validation after Keiser and Lemire, "Validating UTF-8 in less than
+// one instruction per byte" (2021): each byte is classified by three table
+// lookups, on the nibbles of the byte before it and on its high nibble, whose
+// intersection is the error of the pair. The continuation bytes expected two
+// and three bytes after a lead are checked with shifted copies of the input.
+namespace utf8 {
+
+constexpr char too_short = 1 << 0;
+constexpr char too_long = 1 << 1;
+constexpr char overlong_3 = 1 << 2;
+constexpr char too_large = 1 << 3;
+constexpr char surrogate = 1 << 4;
+constexpr char overlong_2 = 1 << 5;
+constexpr char too_large_1000 = 1 << 6;
+constexpr char overlong_4 = 1 << 6;
+constexpr char two_conts = static_cast<char>(1 << 7);
+constexpr char carry = too_short | too_long | two_conts;
+
+// by the high nibble of the first byte of a pair
+inline __m128i byte_1_high() {
+    return _mm_setr_epi8(too_long, too_long, too_long, too_long, too_long, too_long, too_long,
+                         too_long, two_conts, two_conts, two_conts, two_conts,
+                         too_short | overlong_2, too_short, too_short | overlong_3 | surrogate,
+                         too_short | too_large | too_large_1000 | overlong_4);
+}
+
+// by the low nibble of the first byte
+inline __m128i byte_1_low() {
+    constexpr char large = carry | too_large | too_large_1000;
+    return _mm_setr_epi8(carry | overlong_3 | overlong_2 | overlong_4, carry | overlong_2, carry,
+                         carry, carry | too_large, large, large, large, large, large, large,
+                         large, large, large | surrogate, large, large);
+}
+
+// by the high nibble of the second byte
+inline __m128i byte_2_high() {
+    return _mm_setr_epi8(too_short, too_short, too_short, too_short, too_short, too_short,
+                         too_short, too_short,
+                         too_long | overlong_2 | two_conts | overlong_3 | too_large_1000 |
+                             overlong_4,
+                         too_long | overlong_2 | two_conts | overlong_3 | too_large,
+                         too_long | overlong_2 | two_conts | surrogate | too_large,
+                         too_long | overlong_2 | two_conts | surrogate | too_large, too_short,
+                         too_short, too_short, too_short);
+}
+
+// a lead byte in the last three bytes of a block whose sequence goes on in
+// the next one
+inline __m128i incomplete_max() {
+    return _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                         static_cast<char>(0xF0 - 1), static_cast<char>(0xE0 - 1),
+                         static_cast<char>(0xC0 - 1));
+}
+
+inline __m128i high_nibble(__m128i v) {
+    return _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0F));
+}
+
+// non zero bytes where input, following previous, is not valid
+inline __m128i errors(__m128i input, __m128i previous) {
+    auto prev1 = _mm_alignr_epi8(input, previous, 15);
+    auto special = _mm_and_si128(
+        _mm_and_si128(_mm_shuffle_epi8(byte_1_high(), high_nibble(prev1)),
+                      _mm_shuffle_epi8(byte_1_low(), _mm_and_si128(prev1, _mm_set1_epi8(0x0F)))),
+        _mm_shuffle_epi8(byte_2_high(), high_nibble(input)));
+
+    // only 111_____ and 1111____ leads are >= 0x80 after the subtractions
+    auto third = _mm_subs_epu8(_mm_alignr_epi8(input, previous, 14), _mm_set1_epi8(0xE0 - 0x80));
+    auto fourth = _mm_subs_epu8(_mm_alignr_epi8(input, previous, 13), _mm_set1_epi8(0xF0 - 0x80));
+    auto continuation = _mm_and_si128(_mm_or_si128(third, fourth),
+                                      _mm_set1_epi8(static_cast<char>(0x80)));
+    return _mm_xor_si128(continuation, special);
+}
+
+__attribute__((target("avx2"))) inline __m256i twice(__m128i v) {
+    return _mm256_broadcastsi128_si256(v);
+}
+
+__attribute__((target("avx2"))) inline __m256i high_nibble(__m256i v) {
+    return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F));
+}
+
+__attribute__((target("avx2"))) inline __m256i errors(__m256i input, __m256i previous) {
+    // the 16 bytes before the high lane of input: the high lane of previous
+    // for the low lane, the low lane of input for the high lane
+    auto before = _mm256_permute2x128_si256(previous, input, 0x21);
+    auto prev1 = _mm256_alignr_epi8(input, before, 15);
+    auto special = _mm256_and_si256(
+        _mm256_and_si256(
+            _mm256_shuffle_epi8(twice(byte_1_high()), high_nibble(prev1)),
+            _mm256_shuffle_epi8(twice(byte_1_low()),
+                                _mm256_and_si256(prev1, _mm256_set1_epi8(0x0F)))),
+        _mm256_shuffle_epi8(twice(byte_2_high()), high_nibble(input)));
+
+    auto third =
+        _mm256_subs_epu8(_mm256_alignr_epi8(input, before, 14), _mm256_set1_epi8(0xE0 - 0x80));
+    auto fourth =
+        _mm256_subs_epu8(_mm256_alignr_epi8(input, before, 13), _mm256_set1_epi8(0xF0 - 0x80));
+    auto continuation = _mm256_and_si256(_mm256_or_si256(third, fourth),
+                                         _mm256_set1_epi8(static_cast<char>(0x80)));
+    return _mm256_xor_si256(continuation, special);
+}
+
+__attribute__((target("avx2"))) inline __m256i incomplete(__m256i input) {
+    auto max = _mm256_set_m128i(incomplete_max(), _mm_set1_epi8(-1));
+    return _mm256_subs_epu8(input, max);
+}
+
+inline __m128i incomplete(__m128i input) { return _mm_subs_epu8(input, incomplete_max()); }
+
+// blocks of 16 or 32 bytes, the last one padded with zeros (ASCII, so a
+// sequence cut by the end of s is an error); ASCII blocks only carry the
+// sequence left incomplete by the block before them
+inline bool valid(std::string_view s) {
+    auto previous = _mm_setzero_si128(), error = previous, pending = previous;
+    auto block = [&](__m128i input) {
+        if (_mm_movemask_epi8(input) == 0)
+            error = _mm_or_si128(error, pending);
+        else {
+            error = _mm_or_si128(error, errors(input, previous));
+            pending = incomplete(input);
+        }
+        previous = input;
+    };
+
+    std::size_t i = 0;
+    for (; i + 16 <= s.size(); i += 16)
+        block(_mm_loadu_si128(reinterpret_cast<const __m128i *>(s.data() + i)));
+    if (i < s.size())
+        block(load_tail(s.data() + i, s.size() - i));
+    error = _mm_or_si128(error, pending);
+    return _mm_testz_si128(error, error);
+}
+
+__attribute__((target("avx2"))) inline bool valid_avx2(std::string_view s) {
+    auto previous = _mm256_setzero_si256(), error = previous, pending = previous;
+    std::size_t i = 0;
+    for (;; i += 32) {
+        __m256i input;
+        if (i + 32 <= s.size())
+            input = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s.data() + i));
+        else if (i < s.size()) {
+            alignas(32) char tail[32]{};
+            std::memcpy(tail, s.data() + i, s.size() - i);
+            input = _mm256_load_si256(reinterpret_cast<const __m256i *>(tail));
+        } else
+            break;
+
+        if (_mm256_movemask_epi8(input) == 0)
+            error = _mm256_or_si256(error, pending);
+        else {
+            error = _mm256_or_si256(error, errors(input, previous));
+            pending = incomplete(input);
+        }
+        previous = input;
+    }
+    error = _mm256_or_si256(error, pending);
+    return _mm256_testz_si256(error, error);
+}
+
+} // namespace utf8
+
+} // namespace detail
+
+/// position of the first byte of s in set at or after pos, or npos. Sets of
+/// more than 16 bytes are searched by the scalar version
+inline std::size_t find_first_of(std::string_view s, std::string_view set,
+                                 std::size_t pos = 0) {
+    if (set.size() == 1)
+        return find(s, set[0], pos);
+    if (set.size() > 16 || set.empty())
+        return scalar::find_first_of(s, set, pos);
+    if (pos >= s.size())
+        return npos;
+
+    if (set.size() <= detail::avx2_set_size && s.size() - pos >= detail::avx2_threshold &&
+        detail::avx2) {
+        pos = detail::find_first_of_avx2(s.data(), pos, s.size(), set);
+        if (pos + 32 <= s.size())
+            return pos;
+    }
+
+    constexpr int mode = _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT;
+    auto needles = detail::load_set(set);
+    int count = static_cast<int>(set.size());
+
+    for (; pos + 16 <= s.size(); pos += 16) {
+        auto block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s.data() + pos));
+        int index = _mm_cmpestri(needles, count, block, 16, mode);
+        if (index < 16)
+            return pos + index;
+    }
+    int rest = static_cast<int>(s.size() - pos);
+    if (rest) {
+        int index = _mm_cmpestri(needles, count, detail::load_tail(s.data() + pos, rest),
+                                 rest, mode);
+        if (index < rest)
+            return pos + index;
+    }
+    return npos;
+}
+
+/// position of the first byte of s not in set at or after pos, or npos
+inline std::size_t find_first_not_of(std::string_view s, std::string_view set,
+                                     std::size_t pos = 0) {
+    if (set.size() > 16 || set.empty())
+        return scalar::find_first_not_of(s, set, pos);
+    if (pos >= s.size())
+        return npos;
+
+    // only the valid bytes of the block are negated
+    constexpr int mode = _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY |
+                         _SIDD_MASKED_NEGATIVE_POLARITY | _SIDD_LEAST_SIGNIFICANT;
+    auto needles = detail::load_set(set);
+    int count = static_cast<int>(set.size());
+
+    for (; pos + 16 <= s.size(); pos += 16) {
+        auto block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s.data() + pos));
+        int index = _mm_cmpestri(needles, count, block, 16, mode);
+        if (index < 16)
+            return pos + index;
+    }
+    int rest = static_cast<int>(s.size() - pos);
+    if (rest) {
+        int index = _mm_cmpestri(needles, count, detail::load_tail(s.data() + pos, rest),
+                                 rest, mode);
+        if (index < rest)
+            return pos + index;
+    }
+    return npos;
+}
+
+/// lower cases the ASCII letters of data in place
+inline void to_lower(char *data, std::size_t size) {
+    if (size < 16) {
+        scalar::to_lower(data, size);
+        return;
+    }
+    std::size_t i = 0;
+    if (size >= detail::avx2_threshold && detail::avx2)
+        i = detail::to_lower_avx2(data, size);
+    for (; i + 16 <= size; i += 16) {
+        auto p = reinterpret_cast<__m128i *>(data + i);
+        _mm_storeu_si128(p, detail::lower(_mm_loadu_si128(p)));
+    }
+    // lower casing twice changes nothing, the tail is the last 16 bytes
+    if (i < size) {
+        auto p = reinterpret_cast<__m128i *>(data + size - 16);
+        _mm_storeu_si128(p, detail::lower(_mm_loadu_si128(p)));
+    }
+}
+
+/// <0, 0 or >0 comparing the lower case forms of a and b
+inline int icompare(std::string_view a, std::string_view b) {
+    auto size = a.size() < b.size() ? a.size() : b.size();
+    auto i = detail::imismatch(a.data(), b.data(), size);
+    if (i < size) {
+        auto l = static_cast<unsigned char>(scalar::to_lower(a[i]));
+        auto r = static_cast<unsigned char>(scalar::to_lower(b[i]));
+        return l < r ? -1 : 1;
+    }
+    return a.size() == b.size() ? 0 : a.size() < b.size() ? -1 : 1;
+}
+
+/// equality ignoring the case of ASCII letters
+inline bool iequals(std::string_view a, std::string_view b) {
+    return a.size() == b.size() && detail::imismatch(a.data(), b.data(), a.size()) == a.size();
+}
+
+/// position of the first byte of s at or after pos that is written escaped in
+/// a JSON string (a control character, '"' or '\\'), or npos
+inline std::size_t find_json_escape(std::string_view s, std::size_t pos = 0) {
+    if (pos >= s.size())
+        return npos;
+    if (s.size() - pos >= detail::avx2_threshold && detail::avx2) {
+        pos = detail::find_json_escape_avx2(s.data(), pos, s.size());
+        if (pos + 32 <= s.size())
+            return pos;
+    }
+    for (; pos + 16 <= s.size(); pos += 16) {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s.data() + pos));
+        auto mask = static_cast<uint32_t>(_mm_movemask_epi8(detail::json_escaped(v)));
+        if (mask)
+            return pos + __builtin_ctz(mask);
+    }
+    // the padding of the tail is made of zeros, which are controls
+    auto rest = s.size() - pos;
+    if (rest) {
+        auto v = detail::load_tail(s.data() + pos, rest);
+        auto mask = static_cast<uint32_t>(_mm_movemask_epi8(detail::json_escaped(v))) &
+                    ((1u << rest) - 1);
+        if (mask)
+            return pos + __builtin_ctz(mask);
+    }
+    return npos;
+}
+
+/// whether s is valid UTF-8, without overlong forms, surrogates or code
+/// points above U+10FFFF
+inline bool valid_utf8(std::string_view s) {
+    if (s.size() >= detail::avx2_threshold && detail::avx2)
+        return detail::utf8::valid_avx2(s);
+    return detail::utf8::valid(s);
+}
+
+#else
+
+using scalar::find_first_not_of;
+using scalar::find_first_of;
+using scalar::find_json_escape;
+using scalar::icompare;
+using scalar::iequals;
+using scalar::to_lower;
+using scalar::valid_utf8;
+
+#endif
+
+} // namespace simd
+} // namespace utils
+} // namespace scymnus
@@ -1,5 +1,11 @@
 #pragma once
+#include <charconv>
 #include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+#include "utilities/simd.hpp"
 
 namespace scymnus {
 namespace utils {
@@ -9,7 +15,7 @@ namespace utils {
 constexpr std::string_view whitespace{" \t\f\v\n\r"};
 
 inline std::string_view ltrim(std::string_view source) {
-    const std::string_view::size_type pos = source.find_first_not_of(whitespace);
+    const std::string_view::size_type pos = simd::find_first_not_of(source, whitespace);
     if (pos != std::string_view::npos) {
         source.remove_prefix(pos);
     } else {
@@ -38,17 +44,35 @@ inline std::string_view trim(std::string_view source) {
 [[nodiscard]] inline std::vector<std::string_view>
 split(std::string_view sv, std::string_view delimeter = "/") {
     std::vector<std::string_view> output;
-    for (auto first = sv.data(), second = sv.data(), last = first + sv.size();
-         second != last && first != last; first = second + 1) {
-        second = std::find_first_of(first, last, std::cbegin(delimeter),
-                                    std::cend(delimeter));
+    std::size_t first = 0;
+    while (first < sv.size()) {
+        auto second = simd::find_first_of(sv, delimeter, first);
+        if (second == std::string_view::npos)
+            second = sv.size();
 
         if (first != second)
-            output.emplace_back(first, second - first);
+            output.emplace_back(sv.substr(first, second - first));
+        first = second + 1;
     }
 
     return output;
 }
 
+// parses the whole of text as a number, a leading '+' is accepted
+template <class T> bool parse_number(std::string_view text, T &value) {
+    if (!text.empty() && text.front() == '+')
+        text.remove_prefix(1);
+    if (text.empty())
+        return false;
+    if constexpr (std::is_floating_point_v<T>) {
+        // from_chars also accepts "inf" and "nan"
+        auto c = text.front() == '-' && text.size() > 1 ? text[1] : text.front();
+        if (c != '.' && (c < '0' || c > '9'))
+            return false;
+    }
+    auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return ec == std::errc{} && ptr == text.data() + text.size();
+}
+
 } // namespace utils
 } // namespace scymnus